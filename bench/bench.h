@@ -0,0 +1,130 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+namespace vg::bench
+{
+	// Handed to every case. The body loops on next(); only the time between the first
+	// call and the last one is measured, minus any pause()/resume() sections.
+	class State
+	{
+		using Clock = std::chrono::steady_clock;
+
+		uint64_t remaining = 0;
+		uint64_t iterations = 0;
+		int64_t argument = 0;
+		bool started = false;
+		bool running = false;
+
+		Clock::time_point start;
+		std::clock_t cpuStart = 0;
+		double elapsed = 0.0;
+		double cpuElapsed = 0.0;
+
+		uint64_t bytes = 0;
+		uint64_t items = 0;
+
+		friend class Runner;
+	public:
+		State(uint64_t iterations, int64_t argument) : remaining(iterations), iterations(iterations), argument(argument) {}
+
+		bool next() {
+			if (!started) {
+				started = true;
+				resume();
+			}
+			if (remaining == 0) {
+				pause();
+				return false;
+			}
+			remaining--;
+			return true;
+		}
+
+		// both ignore a second call, so pausing after next() returned false is harmless
+		void pause() {
+			if (!running) {
+				return;
+			}
+			running = false;
+			elapsed += std::chrono::duration<double>(Clock::now() - start).count();
+			cpuElapsed += double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+		}
+
+		void resume() {
+			if (running) {
+				return;
+			}
+			running = true;
+			cpuStart = std::clock();
+			start = Clock::now();
+		}
+
+		int64_t arg() const { return argument; }
+		uint64_t count() const { return iterations; }
+
+		// totals over all iterations, reported as rates
+		void setBytesProcessed(uint64_t value) { bytes = value; }
+		void setItemsProcessed(uint64_t value) { items = value; }
+	};
+
+	// Keeps the compiler from discarding a result or the stores that produced it.
+	template<typename T> inline void doNotOptimize(T&& value)
+	{
+#if defined(_MSC_VER)
+		static const void* volatile sink;
+		sink = &value;
+#else
+		asm volatile("" : : "r,m"(value) : "memory");
+#endif
+	}
+
+	using Function = void(*)(State&);
+
+	struct Case
+	{
+		std::string name;
+		Function function;
+		std::vector<int64_t> args;
+	};
+
+	std::vector<Case>& registry();
+
+	struct Register
+	{
+		Register(const char* name, Function function, std::vector<int64_t> args = {}) {
+			registry().push_back({ name, function, std::move(args) });
+		}
+	};
+
+	// VG_BENCHMARK(function) or VG_BENCHMARK(function, { args... }); every argument is
+	// a separate case named function/arg.
+	#define VG_BENCHMARK_CAT2(a, b) a##b
+	#define VG_BENCHMARK_CAT(a, b) VG_BENCHMARK_CAT2(a, b)
+	#define VG_BENCHMARK(function, ...) \
+		static ::vg::bench::Register VG_BENCHMARK_CAT(vgBenchmark, __LINE__)(#function, function, ##__VA_ARGS__)
+
+	struct Result
+	{
+		std::string name;
+		uint64_t iterations = 0;
+		double realNanoseconds = 0.0;
+		double cpuNanoseconds = 0.0;
+		double bytesPerSecond = 0.0;
+		double itemsPerSecond = 0.0;
+	};
+
+	class Runner
+	{
+	public:
+		double minTime = 0.5;
+
+		// Doubles the iteration count, scaled by how far off the last run was, until one
+		// run takes at least minTime.
+		Result run(const Case& c, int64_t arg) const;
+	};
+}
@@ -0,0 +1,319 @@
+#include <render/renderer.h>
+#include <util/geometry.h>
+#include <core/camera.h>
+#include <core/log.h>
+#include <imgui/imgui.h>
+#include <glm/ext.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// End to end frame benchmark: synthetic scenes of N objects with M triangles each are
+// rendered headless through Renderer while the camera orbits them.
+//
+// vg_frame_bench [--objects 10000,100000,1000000] [--triangles 64] [--frames 300]
+//                [--warmup 30] [--u32 0.5] [--width 1280] [--height 720] [--seed 1]
+//                [--json vg_frame_bench.json]
+//
+// The first physical device is used; point VK_ICD_FILENAMES at lavapipe's ICD json to
+// measure the software rasterizer instead.
+namespace
+{
+	struct Options
+	{
+		std::vector<uint32_t> objects = { 10000, 100000, 1000000 };
+		uint32_t triangles = 64;
+		uint32_t frames = 300;
+		uint32_t warmup = 30;
+		float u32Ratio = 0.5f;
+		uint32_t width = 1280;
+		uint32_t height = 720;
+		uint32_t seed = 1;
+		const char* jsonPath = "vg_frame_bench.json";
+	};
+
+	// gives up on pipelines that never arrive instead of hanging
+	constexpr uint32_t maxWarmupFrames = 10000;
+
+	// Latitude/longitude sphere with about `triangles` triangles, indexed with u32.
+	struct Mesh
+	{
+		std::vector<vg::SimpleGeometry::Vertex> vertices;
+		std::vector<uint32_t> indices;
+	};
+
+	Mesh createMesh(uint32_t triangles)
+	{
+		uint32_t rings = std::max(2u, static_cast<uint32_t>(std::sqrt(triangles / 4.0f)));
+		uint32_t segments = std::max(3u, (triangles + rings * 2 - 1) / (rings * 2));
+
+		Mesh mesh;
+		for (uint32_t r = 0; r <= rings; r++) {
+			float v = float(r) / rings;
+			float theta = v * glm::pi<float>();
+			for (uint32_t s = 0; s <= segments; s++) {
+				float u = float(s) / segments;
+				float phi = u * glm::two_pi<float>();
+				glm::vec3 n(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+				mesh.vertices.emplace_back(n * 0.5f, n, glm::vec2(u, v));
+			}
+		}
+		for (uint32_t r = 0; r < rings; r++) {
+			for (uint32_t s = 0; s < segments; s++) {
+				uint32_t a = r * (segments + 1) + s;
+				uint32_t b = a + segments + 1;
+				mesh.indices.insert(mesh.indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+			}
+		}
+		return mesh;
+	}
+
+	// Renderer draws every geometry in world space, so each object's transform is baked
+	// into its own copy of the vertices.
+	void addScene(vg::Renderer& renderer, const Options& options, uint32_t objects, float extent)
+	{
+		Mesh mesh = createMesh(options.triangles);
+		bool fitsU16 = mesh.vertices.size() <= 0x10000;
+		std::vector<uint16_t> indices16(mesh.indices.begin(), mesh.indices.end());
+
+		std::mt19937 random(options.seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::vector<vg::SimpleGeometry::Vertex> vertices = mesh.vertices;
+		for (uint32_t i = 0; i < objects; i++) {
+			glm::vec3 position = (glm::vec3(unit(random), unit(random), unit(random)) - 0.5f) * extent;
+			glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + 0.01f);
+			glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+			model = glm::rotate(model, unit(random) * glm::two_pi<float>(), axis);
+			model = glm::scale(model, glm::vec3(0.5f + unit(random)));
+			glm::mat3 normalMatrix = glm::mat3(model);
+
+			for (size_t v = 0; v < vertices.size(); v++) {
+				vertices[v].position = glm::vec3(model * glm::vec4(mesh.vertices[v].position, 1.0f));
+				vertices[v].normal = glm::normalize(normalMatrix * mesh.vertices[v].normal);
+			}
+
+			vg::GeometryBufferInfo info;
+			info.vertexData(vertices);
+			if (fitsU16 && unit(random) >= options.u32Ratio) {
+				info.indexData(uint32_t(indices16.size() * sizeof(uint16_t)), indices16.data(), vg::IndexType::u16);
+			}
+			else {
+				info.indexData(uint32_t(mesh.indices.size() * sizeof(uint32_t)), mesh.indices.data(), vg::IndexType::u32);
+			}
+			renderer.addGeometry(i, info);
+		}
+	}
+
+	struct Distribution
+	{
+		double mean = 0.0;
+		double p50 = 0.0;
+		double p90 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+	};
+
+	Distribution distribution(std::vector<double> values)
+	{
+		Distribution d;
+		if (values.empty()) {
+			return d;
+		}
+		std::sort(values.begin(), values.end());
+		auto percentile = [&](double p) {
+			return values[std::min(values.size() - 1, static_cast<size_t>(p * (values.size() - 1) + 0.5))];
+		};
+		for (double v : values) {
+			d.mean += v;
+		}
+		d.mean /= values.size();
+		d.p50 = percentile(0.5);
+		d.p90 = percentile(0.9);
+		d.p99 = percentile(0.99);
+		d.max = values.back();
+		return d;
+	}
+
+	struct SceneResult
+	{
+		uint32_t objects = 0;
+		uint64_t triangles = 0;
+		uint32_t draws = 0;
+		double setupSeconds = 0.0;
+		uint32_t warmupFrames = 0;
+
+		Distribution cpu;
+		Distribution fence;
+		Distribution gpu;
+		Distribution frame;
+		Distribution drawsPerSecond;
+		Distribution trianglesPerSecond;
+	};
+
+	SceneResult runScene(const Options& options, uint32_t objects)
+	{
+		using Clock = std::chrono::steady_clock;
+		SceneResult result;
+		result.objects = objects;
+
+		// objects about two units apart, whatever their count
+		float extent = 2.0f * std::cbrt(float(objects));
+		float distance = extent * 1.5f + 2.0f;
+		auto camera = vg::Camera::Perspactive(45.0f, 0.1f, distance * 4.0f);
+		camera.translate(glm::vec3(0, 0, -distance));
+		camera.rotate(glm::vec3(20.0f, 0.0f, 0.0f));
+
+		vg::Renderer renderer;
+		auto setupStart = Clock::now();
+		renderer.setupHeadless(options.width, options.height);
+		addScene(renderer, options, objects, extent);
+		renderer.bindCamera(camera);
+		renderer.finish();
+		result.setupSeconds = std::chrono::duration<double>(Clock::now() - setupStart).count();
+
+		// one full orbit over the measured frames
+		glm::vec3 step(0.0f, 360.0f / std::max(1u, options.frames), 0.0f);
+
+		// pipelines are built on workers; until they are in, frames draw with fallbacks
+		vg::RenderStats stats;
+		do {
+			camera.rotate(step);
+			renderer.bindCamera(camera);
+			renderer.finish();
+			stats = renderer.getStats();
+			result.warmupFrames++;
+		} while (result.warmupFrames < options.warmup || (stats.pendingPipelines > 0 && result.warmupFrames < maxWarmupFrames));
+
+		std::vector<double> cpu, fence, gpu, frame, drawRate, triangleRate;
+		for (uint32_t f = 0; f < options.frames; f++) {
+			camera.rotate(step);
+			auto start = Clock::now();
+			renderer.bindCamera(camera);
+			renderer.finish();
+			double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			stats = renderer.getStats();
+
+			cpu.push_back(stats.frameMilliseconds);
+			fence.push_back(stats.fenceMilliseconds);
+			gpu.push_back(stats.gpuMilliseconds);
+			frame.push_back(seconds * 1e3);
+			drawRate.push_back(seconds > 0.0 ? stats.draws / seconds : 0.0);
+			triangleRate.push_back(seconds > 0.0 ? stats.triangles / seconds : 0.0);
+			result.draws = stats.draws;
+			result.triangles = stats.triangles;
+		}
+		renderer.shutdown();
+
+		result.cpu = distribution(cpu);
+		result.fence = distribution(fence);
+		result.gpu = distribution(gpu);
+		result.frame = distribution(frame);
+		result.drawsPerSecond = distribution(drawRate);
+		result.trianglesPerSecond = distribution(triangleRate);
+		return result;
+	}
+
+	void writeDistribution(FILE* file, const char* name, const Distribution& d, bool last)
+	{
+		std::fprintf(file, "      \"%s\": { \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s\n",
+			name, d.mean, d.p50, d.p90, d.p99, d.max, last ? "" : ",");
+	}
+
+	void writeJson(FILE* file, const Options& options, const std::vector<SceneResult>& results)
+	{
+		std::fprintf(file, "{\n  \"context\": {\n");
+		std::fprintf(file, "    \"width\": %u,\n    \"height\": %u,\n", options.width, options.height);
+		std::fprintf(file, "    \"triangles_per_object\": %u,\n", options.triangles);
+		std::fprintf(file, "    \"frames\": %u,\n    \"u32_ratio\": %g,\n    \"seed\": %u\n", options.frames, options.u32Ratio, options.seed);
+		std::fprintf(file, "  },\n  \"scenes\": [\n");
+		for (size_t i = 0; i < results.size(); i++) {
+			const auto& r = results[i];
+			std::fprintf(file, "    {\n");
+			std::fprintf(file, "      \"objects\": %u,\n", r.objects);
+			std::fprintf(file, "      \"draws\": %u,\n", r.draws);
+			std::fprintf(file, "      \"triangles\": %llu,\n", static_cast<unsigned long long>(r.triangles));
+			std::fprintf(file, "      \"setup_seconds\": %.3f,\n", r.setupSeconds);
+			std::fprintf(file, "      \"warmup_frames\": %u,\n", r.warmupFrames);
+			writeDistribution(file, "cpu_ms", r.cpu, false);
+			writeDistribution(file, "fence_wait_ms", r.fence, false);
+			writeDistribution(file, "gpu_ms", r.gpu, false);
+			writeDistribution(file, "frame_ms", r.frame, false);
+			writeDistribution(file, "draws_per_second", r.drawsPerSecond, false);
+			writeDistribution(file, "triangles_per_second", r.trianglesPerSecond, true);
+			std::fprintf(file, "    }%s\n", i + 1 < results.size() ? "," : "");
+		}
+		std::fprintf(file, "  ]\n}\n");
+	}
+
+	std::vector<uint32_t> parseList(const char* text)
+	{
+		std::vector<uint32_t> values;
+		for (const char* p = text; *p;) {
+			char* end = nullptr;
+			unsigned long value = std::strtoul(p, &end, 10);
+			if (end == p) {
+				break;
+			}
+			values.push_back(static_cast<uint32_t>(value));
+			p = *end == ',' ? end + 1 : end;
+		}
+		return values;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		const char* value = argv[i + 1];
+		if (!std::strcmp(argv[i], "--objects")) options.objects = parseList(value);
+		else if (!std::strcmp(argv[i], "--triangles")) options.triangles = std::max(8, std::atoi(value));
+		else if (!std::strcmp(argv[i], "--frames")) options.frames = std::max(1, std::atoi(value));
+		else if (!std::strcmp(argv[i], "--warmup")) options.warmup = std::max(1, std::atoi(value));
+		else if (!std::strcmp(argv[i], "--u32")) options.u32Ratio = static_cast<float>(std::atof(value));
+		else if (!std::strcmp(argv[i], "--width")) options.width = std::max(1, std::atoi(value));
+		else if (!std::strcmp(argv[i], "--height")) options.height = std::max(1, std::atoi(value));
+		else if (!std::strcmp(argv[i], "--seed")) options.seed = static_cast<uint32_t>(std::atoi(value));
+		else if (!std::strcmp(argv[i], "--json")) options.jsonPath = value;
+		else {
+			std::fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	// the renderer uploads the font atlas even when no UI is drawn
+	ImGui::CreateContext();
+
+	std::vector<SceneResult> results;
+	std::printf("%10s %12s %8s %22s %22s %14s %14s\n", "objects", "triangles", "setup s", "cpu ms p50/p99", "gpu ms p50/p99", "draws/s p50", "tris/s p50");
+	for (uint32_t objects : options.objects) {
+		SceneResult r = runScene(options, objects);
+		char cpu[32], gpu[32];
+		std::snprintf(cpu, sizeof(cpu), "%.3f / %.3f", r.cpu.p50, r.cpu.p99);
+		std::snprintf(gpu, sizeof(gpu), "%.3f / %.3f", r.gpu.p50, r.gpu.p99);
+		std::printf("%10u %12llu %8.2f %22s %22s %13.2fM %13.2fM\n", r.objects, static_cast<unsigned long long>(r.triangles), r.setupSeconds,
+			cpu, gpu, r.drawsPerSecond.p50 / 1e6, r.trianglesPerSecond.p50 / 1e6);
+		std::fflush(stdout);
+		results.push_back(r);
+	}
+
+	FILE* file = std::fopen(options.jsonPath, "w");
+	if (!file) {
+		std::fprintf(stderr, "can not write %s\n", options.jsonPath);
+		return 1;
+	}
+	writeJson(file, options, results);
+	std::fclose(file);
+	std::printf("results written to %s\n", options.jsonPath);
+
+	ImGui::DestroyContext();
+	vg::Log::shutdown();
+	return 0;
+}
@@ -0,0 +1,134 @@
+#include "bench.h"
+#include <util/geometry.h>
+#include <util/mesh.h>
+#include <render/geometryBuffer.h>
+#include <algorithm>
+#include <cmath>
+
+namespace vg::bench
+{
+	// segments around the equator; half as many rings, 64K vertices at most for u16 indices
+	static void createSphere(State& state)
+	{
+		uint32_t segments = static_cast<uint32_t>(state.arg());
+		size_t vertices = 0;
+		while (state.next()) {
+			auto sphere = SimpleGeometry::createSphere(1.0f, segments, segments / 2);
+			vertices = sphere.vertex.size();
+			doNotOptimize(sphere);
+		}
+		state.setItemsProcessed(state.count() * vertices);
+	}
+	VG_BENCHMARK(createSphere, { 8, 32, 64, 128, 256 });
+
+	// attribute setup and bounds of GeometryBuffer, without the upload
+	static void describeGeometry(State& state)
+	{
+		uint32_t segments = static_cast<uint32_t>(state.arg());
+		auto sphere = SimpleGeometry::createSphere(1.0f, segments, segments / 2);
+		GeometryBufferInfo info;
+		info.vertexData(sphere.vertex);
+		info.indexData(uint32_t(sphere.indices.size() * sizeof(uint16_t)), sphere.indices.data());
+
+		GeometryBuffer geometry;
+		while (state.next()) {
+			geometry.describe(info);
+			doNotOptimize(geometry.bounds);
+		}
+		state.setItemsProcessed(state.count() * sphere.vertex.size());
+		state.setBytesProcessed(state.count() * info.vertexSize);
+	}
+	VG_BENCHMARK(describeGeometry, { 8, 64, 256 });
+
+	// welding, normal generation and bounds of a sphere with u16 indices
+	static void importSphere(State& state)
+	{
+		uint32_t segments = static_cast<uint32_t>(state.arg());
+		auto sphere = SimpleGeometry::createSphere(1.0f, segments, segments / 2);
+		GeometryBufferInfo info;
+		info.vertexData(sphere.vertex);
+		info.indexData(uint32_t(sphere.indices.size() * sizeof(uint16_t)), sphere.indices.data());
+
+		MeshImportOptions options;
+		options.generateNormals = true;
+		while (state.next()) {
+			auto mesh = importMesh(info, options);
+			doNotOptimize(mesh);
+		}
+		state.setItemsProcessed(state.count() * (sphere.indices.size() / 3));
+	}
+	VG_BENCHMARK(importSphere, { 8, 64, 256 });
+
+	// cache, overdraw and fetch reordering of a sphere whose triangles were shuffled into a soup
+	static void optimizeSoup(State& state)
+	{
+		uint32_t segments = static_cast<uint32_t>(state.arg());
+		auto sphere = SimpleGeometry::createSphere(1.0f, segments, segments / 2);
+		MeshImportOptions options;
+		options.optimize = false;
+		GeometryBufferInfo info;
+		info.vertexData(sphere.vertex);
+		info.indexData(uint32_t(sphere.indices.size() * sizeof(uint16_t)), sphere.indices.data());
+		auto soup = importMesh(info, options);
+		uint64_t seed = 1;
+		for (size_t t = soup.indices.size() / 3; t > 1; t--) {
+			seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+			size_t other = (seed >> 33) % t;
+			std::swap_ranges(soup.indices.begin() + (t - 1) * 3, soup.indices.begin() + t * 3, soup.indices.begin() + other * 3);
+		}
+
+		while (state.next()) {
+			auto mesh = soup;
+			optimizeMesh(mesh);
+			doNotOptimize(mesh);
+		}
+		state.setItemsProcessed(state.count() * (soup.indices.size() / 3));
+	}
+	VG_BENCHMARK(optimizeSoup, { 64, 256 });
+
+	// quantization into the 16 byte compact encoding; bytes are the float input
+	static void encodeCompact(State& state)
+	{
+		uint32_t segments = static_cast<uint32_t>(state.arg());
+		auto sphere = SimpleGeometry::createSphere(1.0f, segments, segments / 2);
+		MeshImportOptions options;
+		options.optimize = false;
+		GeometryBufferInfo info;
+		info.vertexData(sphere.vertex);
+		info.indexData(uint32_t(sphere.indices.size() * sizeof(uint16_t)), sphere.indices.data());
+		auto mesh = importMesh(info, options);
+
+		while (state.next()) {
+			encodeMesh(mesh, VertexEncoding::compact());
+			doNotOptimize(mesh.encoded);
+		}
+		state.setItemsProcessed(state.count() * mesh.vertexCount());
+		state.setBytesProcessed(state.count() * mesh.vertices.size() * sizeof(float));
+	}
+	VG_BENCHMARK(encodeCompact, { 64, 256 });
+
+	// arg small spheres on a grid merged into static batches; items are the parts
+	static void buildBatches(State& state)
+	{
+		uint32_t count = static_cast<uint32_t>(state.arg());
+		auto sphere = SimpleGeometry::createSphere(0.1f, 8, 4);
+		GeometryBufferInfo info;
+		info.vertexData(sphere.vertex);
+		info.indexData(uint32_t(sphere.indices.size() * sizeof(uint16_t)), sphere.indices.data());
+
+		std::vector<StaticPart> parts(count);
+		uint32_t side = static_cast<uint32_t>(std::ceil(std::cbrt(double(count))));
+		for (uint32_t i = 0; i < count; i++) {
+			parts[i].id = i;
+			parts[i].geometry = info;
+			parts[i].transform[3] = glm::vec4(float(i % side), float(i / side % side), float(i / (side * side)), 1.0f);
+		}
+
+		while (state.next()) {
+			auto batches = buildStaticBatches(parts);
+			doNotOptimize(batches);
+		}
+		state.setItemsProcessed(state.count() * count);
+	}
+	VG_BENCHMARK(buildBatches, { 1000, 10000 });
+}
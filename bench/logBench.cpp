@@ -0,0 +1,45 @@
+#include "bench.h"
+#include <core/log.h>
+
+namespace vg::bench
+{
+	// Producer side of the asynchronous logger; the ring is drained outside the timed
+	// section so no message is dropped.
+	static void logEnqueue(State& state)
+	{
+		uint64_t count = 0;
+		while (state.next()) {
+			LogSite site;
+			Log::log(site, Log::Info, "INFO : ", "frame ", count, " took ", 16.6f, " ms");
+			if (++count % 512 == 0) {
+				state.pause();
+				Log::flush();
+				state.resume();
+			}
+		}
+		Log::flush();
+		state.setItemsProcessed(state.count());
+	}
+	VG_BENCHMARK(logEnqueue);
+
+	// a call site over its rate limit only counts the message
+	static void logSuppressed(State& state)
+	{
+		LogSite site;
+		while (state.next()) {
+			Log::log(site, Log::Info, "INFO : ", "suppressed ", 1);
+		}
+		Log::flush();
+		state.setItemsProcessed(state.count());
+	}
+	VG_BENCHMARK(logSuppressed);
+
+	static void logCompiledOut(State& state)
+	{
+		while (state.next()) {
+			log_debug("compiled out ", 1);
+		}
+		state.setItemsProcessed(state.count());
+	}
+	VG_BENCHMARK(logCompiledOut);
+}
@@ -0,0 +1,136 @@
+#include "bench.h"
+#include <core/log.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace vg::bench
+{
+	std::vector<Case>& registry()
+	{
+		static std::vector<Case> cases;
+		return cases;
+	}
+
+	Result Runner::run(const Case& c, int64_t arg) const
+	{
+		uint64_t iterations = 1;
+		for (;;) {
+			State state(iterations, arg);
+			c.function(state);
+
+			if (state.elapsed >= minTime || iterations >= (1ull << 40)) {
+				Result result;
+				result.iterations = iterations;
+				result.realNanoseconds = state.elapsed * 1e9 / iterations;
+				result.cpuNanoseconds = state.cpuElapsed * 1e9 / iterations;
+				if (state.elapsed > 0.0) {
+					result.bytesPerSecond = state.bytes / state.elapsed;
+					result.itemsPerSecond = state.items / state.elapsed;
+				}
+				return result;
+			}
+
+			double scale = state.elapsed > 0.0 ? minTime * 1.4 / state.elapsed : 10.0;
+			scale = std::min(std::max(scale, 2.0), 10.0);
+			iterations = static_cast<uint64_t>(iterations * scale);
+		}
+	}
+
+	static void writeJson(FILE* file, const std::vector<Result>& results, double minTime)
+	{
+		char date[64] = {};
+		std::time_t now = std::time(nullptr);
+		std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+		std::fprintf(file, "{\n  \"context\": {\n");
+		std::fprintf(file, "    \"date\": \"%s\",\n", date);
+		std::fprintf(file, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+		std::fprintf(file, "    \"min_time\": %g,\n", minTime);
+#if defined(NDEBUG)
+		std::fprintf(file, "    \"library_build_type\": \"release\"\n");
+#else
+		std::fprintf(file, "    \"library_build_type\": \"debug\"\n");
+#endif
+		std::fprintf(file, "  },\n  \"benchmarks\": [\n");
+		for (size_t i = 0; i < results.size(); i++) {
+			const auto& r = results[i];
+			std::fprintf(file, "    {\n");
+			std::fprintf(file, "      \"name\": \"%s\",\n", r.name.c_str());
+			std::fprintf(file, "      \"iterations\": %llu,\n", static_cast<unsigned long long>(r.iterations));
+			std::fprintf(file, "      \"real_time\": %.3f,\n", r.realNanoseconds);
+			std::fprintf(file, "      \"cpu_time\": %.3f,\n", r.cpuNanoseconds);
+			std::fprintf(file, "      \"time_unit\": \"ns\"");
+			if (r.bytesPerSecond > 0.0) {
+				std::fprintf(file, ",\n      \"bytes_per_second\": %.1f", r.bytesPerSecond);
+			}
+			if (r.itemsPerSecond > 0.0) {
+				std::fprintf(file, ",\n      \"items_per_second\": %.1f", r.itemsPerSecond);
+			}
+			std::fprintf(file, "\n    }%s\n", i + 1 < results.size() ? "," : "");
+		}
+		std::fprintf(file, "  ]\n}\n");
+	}
+}
+
+// vg_bench [--filter <substring>] [--min-time <seconds>] [--json <path>]
+int main(int argc, char** argv)
+{
+	using namespace vg::bench;
+
+	const char* filter = "";
+	const char* jsonPath = "vg_bench.json";
+	Runner runner;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!std::strcmp(argv[i], "--filter")) filter = argv[i + 1];
+		else if (!std::strcmp(argv[i], "--min-time")) runner.minTime = std::atof(argv[i + 1]);
+		else if (!std::strcmp(argv[i], "--json")) jsonPath = argv[i + 1];
+		else {
+			std::fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	// the logging cases would otherwise flood the table
+	vg::Log::setConsole(false);
+
+	std::vector<Result> results;
+	std::printf("%-40s %14s %14s %12s %14s\n", "benchmark", "time (ns)", "cpu (ns)", "iterations", "rate");
+	for (const auto& c : registry()) {
+		std::vector<int64_t> args = c.args.empty() ? std::vector<int64_t>{ 0 } : c.args;
+		for (int64_t arg : args) {
+			std::string name = c.args.empty() ? c.name : c.name + "/" + std::to_string(arg);
+			if (!std::strstr(name.c_str(), filter)) {
+				continue;
+			}
+
+			Result r = runner.run(c, arg);
+			r.name = name;
+
+			char rate[32] = "";
+			if (r.bytesPerSecond > 0.0) {
+				std::snprintf(rate, sizeof(rate), "%.2f GB/s", r.bytesPerSecond / 1e9);
+			}
+			else if (r.itemsPerSecond > 0.0) {
+				std::snprintf(rate, sizeof(rate), "%.2f M/s", r.itemsPerSecond / 1e6);
+			}
+			std::printf("%-40s %14.1f %14.1f %12llu %14s\n", name.c_str(), r.realNanoseconds, r.cpuNanoseconds, static_cast<unsigned long long>(r.iterations), rate);
+			results.push_back(std::move(r));
+		}
+	}
+
+	FILE* file = std::fopen(jsonPath, "w");
+	if (!file) {
+		std::fprintf(stderr, "can not write %s\n", jsonPath);
+		return 1;
+	}
+	writeJson(file, results, runner.minTime);
+	std::fclose(file);
+	std::printf("results written to %s\n", jsonPath);
+
+	vg::Log::shutdown();
+	return 0;
+}
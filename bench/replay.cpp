@@ -0,0 +1,52 @@
+#include <render/renderer.h>
+#include <util/trace.h>
+#include <core/log.h>
+#include <imgui/imgui.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+// Replays a trace written with Renderer::setTrace (VG_TRACE in the example) on a headless
+// renderer. Input events are counted but not replayed, there is no window to send them to.
+//
+// vg_replay <trace> [--realtime]
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		std::fprintf(stderr, "usage: vg_replay <trace> [--realtime]\n");
+		return 1;
+	}
+	auto timing = vg::TraceTiming::AsFastAsPossible;
+	for (int i = 2; i < argc; i++) {
+		if (!std::strcmp(argv[i], "--realtime")) timing = vg::TraceTiming::Recorded;
+		else {
+			std::fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	vg::TraceReader reader(argv[1]);
+	if (!reader.isOpen()) {
+		vg::Log::shutdown();
+		return 1;
+	}
+
+	// the renderer uploads the font atlas even when no UI is drawn
+	ImGui::CreateContext();
+
+	vg::Renderer renderer;
+	uint64_t events = 0;
+	auto start = std::chrono::steady_clock::now();
+	uint64_t frames = renderer.replay(reader, timing, [&](const vg::TraceRecord&) { events++; });
+	renderer.finish();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::printf("%llu frames in %.3f s (%.1f fps), %llu input events skipped\n", static_cast<unsigned long long>(frames), seconds,
+		seconds > 0.0 ? frames / seconds : 0.0, static_cast<unsigned long long>(events));
+
+	renderer.shutdown();
+	ImGui::DestroyContext();
+	vg::Log::shutdown();
+	return 0;
+}
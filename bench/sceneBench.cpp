@@ -0,0 +1,63 @@
+#include "bench.h"
+#include <core/camera.h>
+#include <core/arena.h>
+#include <render/renderQueue.h>
+
+#include <random>
+
+namespace vg::bench
+{
+	static void cameraMatrices(State& state)
+	{
+		auto camera = Camera::Perspactive(45.0f);
+		camera.translate(glm::vec3(0, 0, -10));
+		while (state.next()) {
+			camera.rotate(glm::vec3(0.1f, 0.2f, 0.0f));
+			auto projection = camera.getProjectionMatrix(16.0f / 9.0f);
+			auto view = camera.getViewMatrix();
+			doNotOptimize(projection);
+			doNotOptimize(view);
+		}
+		state.setItemsProcessed(state.count());
+	}
+	VG_BENCHMARK(cameraMatrices);
+
+	// The CPU side of visibility as GeometryRenderState does it per frame: view depth of
+	// every object's bounds center, key packing, and the radix sort of the queue.
+	static void drawQueue(State& state)
+	{
+		struct Item
+		{
+			uint32_t id;
+		};
+
+		uint32_t count = static_cast<uint32_t>(state.arg());
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+		std::vector<glm::vec3> centers(count);
+		std::vector<uint32_t> pipelines(count);
+		for (uint32_t i = 0; i < count; i++) {
+			centers[i] = glm::vec3(coordinate(random), coordinate(random), coordinate(random));
+			pipelines[i] = random() % 8;
+		}
+
+		auto camera = Camera::Perspactive(45.0f);
+		camera.translate(glm::vec3(0, 0, -150));
+		glm::mat4 view = camera.getViewMatrix();
+
+		FrameArena arena;
+		RenderQueueStats stats;
+		while (state.next()) {
+			arena.reset();
+			auto queue = RenderQueue<Item>(arena, count);
+			for (uint32_t i = 0; i < count; i++) {
+				auto depth = SortKey::depthBucket(-(view * glm::vec4(centers[i], 1.0f)).z);
+				queue.push(SortKey::pack(0, pipelines[i], 0, 0, depth), { i });
+			}
+			queue.sort(stats);
+			doNotOptimize(queue);
+		}
+		state.setItemsProcessed(state.count() * count);
+	}
+	VG_BENCHMARK(drawQueue, { 1000, 10000, 100000 });
+}
@@ -0,0 +1,36 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace vg::bench
+{
+	// Copy into a staging chunk, as Uploader does for every buffer and image upload.
+	// The source is reused so it stays cached; the destination matches the 4 MiB chunk
+	// size and is rewritten from the start once full.
+	static void stagingCopy(State& state)
+	{
+		size_t size = static_cast<size_t>(state.arg());
+		constexpr size_t chunkSize = 4 << 20;
+		size_t capacity = std::max(size, chunkSize);
+
+		std::vector<uint8_t> source(size, 0x5a);
+		auto chunk = static_cast<uint8_t*>(std::malloc(capacity));
+		std::memset(chunk, 0, capacity);
+
+		size_t offset = 0;
+		while (state.next()) {
+			if (offset + size > capacity) {
+				offset = 0;
+			}
+			std::memcpy(chunk + offset, source.data(), size);
+			doNotOptimize(chunk);
+			offset += size;
+		}
+		std::free(chunk);
+		state.setBytesProcessed(state.count() * size);
+	}
+	VG_BENCHMARK(stagingCopy, { 256, 4 << 10, 64 << 10, 1 << 20, 16 << 20 });
+}
@@ -1,9 +1,11 @@
 #include <util/entry.h>
 #include <util/geometry.h>
 #include <render/renderer.h>
+#include <render/statsHud.h>
 #include <imgui/imgui.h>
 #include <glm/ext.hpp>
 #include <core/camera.h>
+#include <cstdlib>
 
 class Demo : public vg::Entry
 {
@@ -11,15 +13,26 @@ class Demo : public vg::Entry
 public:
 	virtual void init() override
 	{
+		setRenderMode(RenderMode::OnDemand);
 		renderer.setup(getInfo().handle);
+
+		// VG_TRACE=<file> records the session for vg_replay
+		if (const char* path = std::getenv("VG_TRACE")) {
+			auto trace = std::make_shared<vg::TraceWriter>(path);
+			renderer.setTrace(trace);
+			setTrace(trace);
+		}
 		camera.translate(glm::vec3(0, 0, -10));
 		camera.rotate(glm::vec3(45, -45, 0.0f));
 
 		auto geometry = vg::SimpleGeometry::createSphere();
 		auto info = vg::GeometryBufferInfo();
-		info.vertexData(uint32_t(geometry.vertex.size() * sizeof(vg::SimpleGeometry::Vertex)), geometry.vertex.data(),vg::VertexType::PNT);
+		info.vertexData(geometry.vertex);
 		info.indexData(uint32_t(geometry.indices.size() * sizeof(uint16_t)), geometry.indices.data());
-		renderer.addGeometry(0, info);
+		// picking then fetches only the positions
+		vg::MeshImportOptions options;
+		options.encoding.separatePositions = true;
+		renderer.importGeometry(0, info, options);
 	}
 
 	virtual void update() override
@@ -28,6 +41,7 @@ public:
 
 		static bool show_demo_window = false;
 		static bool show_another_window = false;
+		static bool show_stats = true;
 		static float clear_color[3] = { 0.0f };
 
 		if (show_demo_window)
@@ -50,6 +64,11 @@ public:
 				if (ImGui::MenuItem("Paste", "CTRL+V")) {}
 				ImGui::EndMenu();
 			}
+			if (ImGui::BeginMenu("View"))
+			{
+				ImGui::MenuItem("Render stats", nullptr, &show_stats);
+				ImGui::EndMenu();
+			}
 			ImGui::EndMainMenuBar();
 		}
 
@@ -86,6 +105,9 @@ public:
 			ImGui::End();
 		}
 
+		if (show_stats)
+			vg::showStatsHud(renderer.getStats(), &show_stats);
+
 		// Rendering
 		ImGui::Render();
 
@@ -156,9 +178,17 @@ public:
 		}
 	}
 
+	virtual void shutdown() override
+	{
+		renderer.shutdown();
+	}
+
 	virtual void draw() override
 	{
 		renderer.draw();
+		if (renderer.needsRedraw()) {
+			requestRedraw();
+		}
 	}
 
 private:
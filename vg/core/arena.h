@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <new>
+#include <type_traits>
+
+namespace vg
+{
+	// Linear bump allocator reset once per frame. Memory comes from malloc so it never
+	// shows up in the operator new counter; when a frame overflows the block, the
+	// overflow is served from temporary blocks and the main block grows on the next reset.
+	class FrameArena
+	{
+		struct Overflow
+		{
+			Overflow* next;
+		};
+
+		uint8_t* data = nullptr;
+		size_t capacity = 0;
+		size_t offset = 0;
+		size_t peak = 0;
+		Overflow* overflow = nullptr;
+	public:
+		explicit FrameArena(size_t capacity = 1 << 20) : capacity(capacity) {
+			data = static_cast<uint8_t*>(std::malloc(capacity));
+		}
+
+		~FrameArena() {
+			releaseOverflow();
+			std::free(data);
+		}
+
+		FrameArena(const FrameArena&) = delete;
+		FrameArena& operator=(const FrameArena&) = delete;
+
+		void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+			size_t aligned = (offset + align - 1) & ~(align - 1);
+			if (aligned + size <= capacity) {
+				offset = aligned + size;
+				peak = offset > peak ? offset : peak;
+				return data + aligned;
+			}
+
+			peak += size + align;
+			auto block = static_cast<uint8_t*>(std::malloc(sizeof(Overflow) + size + align));
+			auto node = reinterpret_cast<Overflow*>(block);
+			node->next = overflow;
+			overflow = node;
+			auto p = reinterpret_cast<uintptr_t>(block + sizeof(Overflow));
+			return reinterpret_cast<void*>((p + align - 1) & ~(uintptr_t(align) - 1));
+		}
+
+		template<typename T> T* alloc(size_t count = 1) {
+			static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destructed");
+			return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+		}
+
+		template<typename T> T* copy(const T* src, size_t count) {
+			auto dst = alloc<T>(count);
+			std::memcpy(dst, src, sizeof(T) * count);
+			return dst;
+		}
+
+		void reset() {
+			releaseOverflow();
+			if (peak > capacity) {
+				while (capacity < peak) capacity *= 2;
+				std::free(data);
+				data = static_cast<uint8_t*>(std::malloc(capacity));
+			}
+			offset = 0;
+			peak = 0;
+		}
+
+		size_t used() const { return offset; }
+		size_t size() const { return capacity; }
+	private:
+		void releaseOverflow() {
+			while (overflow) {
+				auto next = overflow->next;
+				std::free(overflow);
+				overflow = next;
+			}
+		}
+	};
+
+	// Non-owning view over arena memory, growable up to the reserved count.
+	template<typename T> class FrameArray
+	{
+		T* data_ = nullptr;
+		size_t size_ = 0;
+		size_t capacity_ = 0;
+	public:
+		FrameArray() {}
+		FrameArray(FrameArena& arena, size_t capacity) : data_(arena.alloc<T>(capacity)), capacity_(capacity) {}
+
+		void push_back(const T& value) {
+			assert(size_ < capacity_);
+			data_[size_++] = value;
+		}
+
+		T& operator[](size_t i) { return data_[i]; }
+		const T& operator[](size_t i) const { return data_[i]; }
+		T* begin() { return data_; }
+		T* end() { return data_ + size_; }
+		const T* begin() const { return data_; }
+		const T* end() const { return data_ + size_; }
+		T* data() { return data_; }
+		size_t size() const { return size_; }
+		bool empty() const { return size_ == 0; }
+	};
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace vg
+{
+	// Fast non-cryptographic hashing for change detection, processes 8 bytes per step.
+	inline uint64_t hashMix(uint64_t h)
+	{
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	inline uint64_t hashCombine(uint64_t seed, uint64_t value)
+	{
+		return hashMix(seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2)));
+	}
+
+	inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0)
+	{
+		auto p = static_cast<const uint8_t*>(data);
+		uint64_t h = seed ^ (size * 0x9e3779b97f4a7c15ull);
+		while (size >= 8) {
+			uint64_t v;
+			std::memcpy(&v, p, 8);
+			h = (h ^ hashMix(v)) * 0x100000001b3ull;
+			p += 8;
+			size -= 8;
+		}
+		uint64_t tail = 0;
+		std::memcpy(&tail, p, size);
+		return hashMix(h ^ tail);
+	}
+
+	template<typename T> uint64_t hashValue(const T& value, uint64_t seed = 0)
+	{
+		return hashBytes(&value, sizeof(T), seed);
+	}
+}
@@ -0,0 +1,236 @@
+#include "jobs.h"
+
+#include <cassert>
+#include <chrono>
+
+namespace vg
+{
+	// index of the worker running on this thread in the pool it belongs to
+	static thread_local const JobSystem* currentPool = nullptr;
+	static thread_local uint32_t currentWorker = 0;
+
+	static uint64_t nanoseconds(std::chrono::steady_clock::duration d)
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+	}
+
+	JobSystem::JobSystem(uint32_t workerCount)
+	{
+		if (workerCount == 0) {
+			workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+		}
+		for (uint32_t i = 0; i < workerCount; i++) {
+			workers.emplace_back(new Worker());
+		}
+		for (uint32_t i = 0; i < workerCount; i++) {
+			workers[i]->thread = std::thread([this, i] { workerLoop(i); });
+		}
+	}
+
+	JobSystem::~JobSystem()
+	{
+		running = false;
+		{
+			std::lock_guard<std::mutex> lock(sleepLock);
+			sleepCondition.notify_all();
+		}
+		// workers leave only once the queues are empty, and a job still running pushes its
+		// continuations to its own worker, so nothing queued before this point is dropped
+		for (auto& worker : workers) {
+			worker->thread.join();
+		}
+		assert(queued.load() == 0);
+	}
+
+	void JobSystem::run(JobGroup& group, std::function<void()> task)
+	{
+		group.pending.fetch_add(1, std::memory_order_relaxed);
+		push({ &group, std::move(task) });
+	}
+
+	void JobSystem::run(JobGroup& group, std::function<void()> task, JobGroup& dependency)
+	{
+		group.pending.fetch_add(1, std::memory_order_relaxed);
+		{
+			// finish() drops the count under the same lock, so either we see the dependency
+			// still pending and it will release us, or it is already done
+			std::lock_guard<std::mutex> lock(dependency.lock);
+			if (dependency.pending.load(std::memory_order_acquire) > 0) {
+				dependency.continuations.push_back({ &group, std::move(task) });
+				return;
+			}
+		}
+		push({ &group, std::move(task) });
+	}
+
+	void JobSystem::wait(JobGroup& group)
+	{
+		uint32_t self = currentPool == this ? currentWorker : 0;
+		Job job;
+		while (!group.done()) {
+			if (pop(self, job)) {
+				execute(job);
+				continue;
+			}
+			// woken by push() for more work or by finish() once the group is done
+			std::unique_lock<std::mutex> lock(sleepLock);
+			sleeping.fetch_add(1);
+			sleepCondition.wait(lock, [this, &group] { return queued.load() > 0 || group.done(); });
+			sleeping.fetch_sub(1);
+		}
+		// the last finish() may still hold the lock
+		std::lock_guard<std::mutex> lock(group.lock);
+	}
+
+	void JobSystem::pin(std::function<void()> task)
+	{
+		pinned.push(std::move(task));
+		std::lock_guard<std::mutex> lock(pinnedLock);
+		if (pinnedWakeup) {
+			pinnedWakeup();
+		}
+	}
+
+	void JobSystem::setPinnedWakeup(std::function<void()> wakeup)
+	{
+		std::lock_guard<std::mutex> lock(pinnedLock);
+		pinnedWakeup = std::move(wakeup);
+	}
+
+	uint32_t JobSystem::runPinned()
+	{
+		uint32_t count = 0;
+		std::function<void()> task;
+		while (pinned.pop(task)) {
+			task();
+			count++;
+		}
+		return count;
+	}
+
+	std::vector<WorkerStats> JobSystem::getStats() const
+	{
+		std::vector<WorkerStats> stats(workers.size());
+		for (size_t i = 0; i < workers.size(); i++) {
+			auto& worker = *workers[i];
+			stats[i].jobs = worker.executed.load(std::memory_order_relaxed);
+			stats[i].steals = worker.steals.load(std::memory_order_relaxed);
+			stats[i].busyMilliseconds = worker.busyNanoseconds.load(std::memory_order_relaxed) * 1e-6f;
+			stats[i].idleMilliseconds = worker.idleNanoseconds.load(std::memory_order_relaxed) * 1e-6f;
+		}
+		return stats;
+	}
+
+	void JobSystem::resetStats()
+	{
+		for (auto& worker : workers) {
+			worker->executed = 0;
+			worker->steals = 0;
+			worker->busyNanoseconds = 0;
+			worker->idleNanoseconds = 0;
+		}
+	}
+
+	void JobSystem::push(Job&& job)
+	{
+		uint32_t index = currentPool == this ? currentWorker : nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+		{
+			auto& worker = *workers[index];
+			std::lock_guard<std::mutex> lock(worker.lock);
+			worker.jobs.push_back(std::move(job));
+		}
+		queued.fetch_add(1);
+		if (sleeping.load() > 0) {
+			std::lock_guard<std::mutex> lock(sleepLock);
+			sleepCondition.notify_one();
+		}
+	}
+
+	bool JobSystem::pop(uint32_t self, Job& job)
+	{
+		uint32_t count = static_cast<uint32_t>(workers.size());
+		for (uint32_t i = 0; i < count; i++) {
+			auto& worker = *workers[(self + i) % count];
+			std::lock_guard<std::mutex> lock(worker.lock);
+			if (worker.jobs.empty()) {
+				continue;
+			}
+			// own jobs LIFO for locality, stolen ones FIFO to take the oldest, largest work
+			if (i == 0) {
+				job = std::move(worker.jobs.back());
+				worker.jobs.pop_back();
+			}
+			else {
+				job = std::move(worker.jobs.front());
+				worker.jobs.pop_front();
+				if (currentPool == this) {
+					workers[self]->steals.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+			queued.fetch_sub(1);
+			return true;
+		}
+		return false;
+	}
+
+	void JobSystem::execute(Job& job)
+	{
+		auto start = std::chrono::steady_clock::now();
+		job.task();
+		job.task = nullptr;
+		if (currentPool == this) {
+			auto& worker = *workers[currentWorker];
+			worker.executed.fetch_add(1, std::memory_order_relaxed);
+			worker.busyNanoseconds.fetch_add(nanoseconds(std::chrono::steady_clock::now() - start), std::memory_order_relaxed);
+		}
+		finish(*job.group);
+	}
+
+	void JobSystem::finish(JobGroup& group)
+	{
+		std::vector<JobGroup::Continuation> ready;
+		bool completed = false;
+		{
+			std::lock_guard<std::mutex> lock(group.lock);
+			if (group.pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				ready.swap(group.continuations);
+				completed = true;
+			}
+		}
+		for (auto& continuation : ready) {
+			push({ continuation.group, std::move(continuation.task) });
+		}
+		if (completed) {
+			// wait() checks done() under sleepLock, so taking it here cannot miss a waiter
+			std::lock_guard<std::mutex> lock(sleepLock);
+			sleepCondition.notify_all();
+		}
+	}
+
+	void JobSystem::workerLoop(uint32_t index)
+	{
+		currentPool = this;
+		currentWorker = index;
+		auto& worker = *workers[index];
+
+		Job job;
+		while (true) {
+			if (pop(index, job)) {
+				execute(job);
+				continue;
+			}
+			if (!running) {
+				break;
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			{
+				std::unique_lock<std::mutex> lock(sleepLock);
+				sleeping.fetch_add(1);
+				sleepCondition.wait(lock, [this] { return queued.load() > 0 || !running; });
+				sleeping.fetch_sub(1);
+			}
+			worker.idleNanoseconds.fetch_add(nanoseconds(std::chrono::steady_clock::now() - start), std::memory_order_relaxed);
+		}
+	}
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "mpscQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vg
+{
+	class JobSystem;
+
+	// Set of jobs that can be waited on, and that later jobs can depend on.
+	// Must outlive its jobs; JobSystem::wait guarantees that.
+	class JobGroup
+	{
+		friend class JobSystem;
+
+		struct Continuation
+		{
+			JobGroup* group;
+			std::function<void()> task;
+		};
+
+		std::atomic<uint32_t> pending{ 0 };
+		std::mutex lock;
+		std::vector<Continuation> continuations;
+	public:
+		JobGroup() {}
+		JobGroup(const JobGroup&) = delete;
+		JobGroup& operator=(const JobGroup&) = delete;
+
+		bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+	};
+
+	struct WorkerStats
+	{
+		uint64_t jobs = 0;
+		uint64_t steals = 0;
+		float busyMilliseconds = 0.0f;
+		float idleMilliseconds = 0.0f;
+
+		// busy time over wall time since the last resetStats()
+		float utilization() const {
+			float total = busyMilliseconds + idleMilliseconds;
+			return total > 0.0f ? busyMilliseconds / total : 0.0f;
+		}
+	};
+
+	// Work-stealing scheduler. Every worker owns a deque: it pushes and pops at the back,
+	// idle workers steal from the front of the others. Jobs submitted from outside the
+	// pool are spread over the workers round robin.
+	class JobSystem
+	{
+		struct Job
+		{
+			JobGroup* group = nullptr;
+			std::function<void()> task;
+		};
+
+		struct Worker
+		{
+			std::mutex lock;
+			std::deque<Job> jobs;
+			std::thread thread;
+
+			std::atomic<uint64_t> executed{ 0 };
+			std::atomic<uint64_t> steals{ 0 };
+			std::atomic<uint64_t> busyNanoseconds{ 0 };
+			std::atomic<uint64_t> idleNanoseconds{ 0 };
+		};
+
+		std::vector<std::unique_ptr<Worker>> workers;
+		std::atomic<uint32_t> nextWorker{ 0 };
+		std::atomic<bool> running{ true };
+
+		std::atomic<uint32_t> queued{ 0 };
+		std::atomic<uint32_t> sleeping{ 0 };
+		std::mutex sleepLock;
+		std::condition_variable sleepCondition;
+
+		MpscQueue<std::function<void()>> pinned;
+		std::mutex pinnedLock;
+		std::function<void()> pinnedWakeup;
+	public:
+		// workerCount 0 uses one worker per hardware thread but the calling one.
+		explicit JobSystem(uint32_t workerCount = 0);
+		// Finishes the queued jobs and their continuations, then joins the workers.
+		~JobSystem();
+
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		void run(JobGroup& group, std::function<void()> task);
+
+		// Runs task once dependency has no jobs left: right away if it is done, otherwise when
+		// its count drops to zero, which waits for jobs added to it meanwhile as well.
+		void run(JobGroup& group, std::function<void()> task, JobGroup& dependency);
+
+		// Splits [0, count) into ranges of at most batch elements and calls body(begin, end) for each.
+		template<typename F> void parallelFor(JobGroup& group, uint32_t count, uint32_t batch, F body) {
+			batch = std::max(batch, 1u);
+			for (uint32_t begin = 0; begin < count; begin += batch) {
+				uint32_t end = std::min(count, begin + batch);
+				run(group, [body, begin, end]() { body(begin, end); });
+			}
+		}
+
+		// Blocks until the group is done, executing queued jobs in the meantime.
+		void wait(JobGroup& group);
+
+		// Queues a task for the thread that calls runPinned(), e.g. one owning a graphics API
+		// context. Safe to call from any thread, including workers.
+		void pin(std::function<void()> task);
+
+		// Runs the pinned tasks queued so far and returns how many ran.
+		uint32_t runPinned();
+
+		// Called after pin(), so the owning thread can wake up if it sleeps. Once this returns
+		// the previous wakeup is not running and will not be called again.
+		void setPinnedWakeup(std::function<void()> wakeup);
+
+		uint32_t workerCount() const { return static_cast<uint32_t>(workers.size()); }
+
+		std::vector<WorkerStats> getStats() const;
+		void resetStats();
+	private:
+		void push(Job&& job);
+		bool pop(uint32_t self, Job& job);
+		void execute(Job& job);
+		void finish(JobGroup& group);
+		void workerLoop(uint32_t index);
+	};
+}
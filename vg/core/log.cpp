@@ -0,0 +1,224 @@
+#include "log.h"
+
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstddef>
+#include <memory>
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#endif
+
+namespace vg
+{
+    namespace
+    {
+        // Bounded multi producer queue (Vyukov): a cell whose sequence equals the write position
+        // is free, sequence == position + 1 means it holds a finished record. Producers only
+        // touch the write position and their own cell, so logging never waits on a lock.
+        struct Cell
+        {
+            alignas(64) std::atomic<size_t> sequence;
+            uint8_t data[Log::slotSize];
+        };
+
+        class Sink
+        {
+        public:
+            static constexpr size_t capacity = 1024;
+
+            Sink() : cells(new Cell[capacity]) {
+                for (size_t i = 0; i < capacity; i++) {
+                    cells[i].sequence.store(i, std::memory_order_relaxed);
+                }
+                thread = std::thread([this] { run(); });
+                std::atexit([] { Log::flush(); });
+            }
+
+            uint8_t* claim() {
+                size_t pos = writePos.load(std::memory_order_relaxed);
+                for (;;) {
+                    Cell& cell = cells[pos & (capacity - 1)];
+                    size_t seq = cell.sequence.load(std::memory_order_acquire);
+                    intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+                    if (diff == 0) {
+                        if (writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                            return cell.data;
+                        }
+                    }
+                    else if (diff < 0) {
+                        dropped.fetch_add(1, std::memory_order_relaxed);
+                        return nullptr;
+                    }
+                    else {
+                        pos = writePos.load(std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            void commit(uint8_t* slot, Log::Level level) {
+                Cell& cell = *reinterpret_cast<Cell*>(slot - offsetof(Cell, data));
+                cell.sequence.store(cell.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+                if (!running.load(std::memory_order_acquire)) {
+                    drain();
+                }
+                else if (level >= Log::Warning) {
+                    wake.notify_one();
+                }
+            }
+
+            // Writes every finished record; the mutex keeps a single consumer.
+            void drain() {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (;;) {
+                    Cell& cell = cells[readPos & (capacity - 1)];
+                    if (cell.sequence.load(std::memory_order_acquire) != readPos + 1) {
+                        break;
+                    }
+
+                    Log::Record record;
+                    std::memcpy(&record, cell.data, sizeof(record));
+                    LogBuffer buf;
+                    buf.format("[%.3f] ", record.time * 1e-9);
+                    buf.put(record.severity);
+                    record.decode(cell.data + sizeof(record), buf);
+                    if (record.truncated || buf.truncated) {
+                        buf.ellipsis();
+                    }
+                    if (record.suppressed) {
+                        buf.format(" (%u similar messages suppressed)", record.suppressed);
+                    }
+                    write(buf);
+
+                    cell.sequence.store(readPos + capacity, std::memory_order_release);
+                    readPos++;
+                }
+
+                uint64_t lost = dropped.load(std::memory_order_relaxed);
+                if (lost != reported) {
+                    LogBuffer buf;
+                    buf.format("WARNING : log buffer full, %llu messages dropped", static_cast<unsigned long long>(lost - reported));
+                    write(buf);
+                    reported = lost;
+                }
+            }
+
+            void setFile(const char* path) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (file) {
+                    std::fclose(file);
+                    file = nullptr;
+                }
+                if (path) {
+                    file = std::fopen(path, "w");
+                }
+            }
+
+            void setConsole(bool enabled) {
+                std::lock_guard<std::mutex> lock(mutex);
+                console = enabled;
+            }
+
+            void stop() {
+                if (running.exchange(false)) {
+                    wake.notify_one();
+                    thread.join();
+                }
+                drain();
+            }
+
+            std::atomic<uint64_t> dropped{ 0 };
+        private:
+            void run() {
+                while (running.load(std::memory_order_acquire)) {
+                    {
+                        std::unique_lock<std::mutex> lock(wakeMutex);
+                        wake.wait_for(lock, std::chrono::milliseconds(10));
+                    }
+                    drain();
+                }
+            }
+
+            void write(LogBuffer& buf) {
+                buf.data[buf.size++] = '\n';
+                buf.data[buf.size] = 0;
+                if (console) {
+#if defined(_MSC_VER)
+                    OutputDebugStringA(buf.data);
+#else
+                    std::fwrite(buf.data, 1, buf.size, stdout);
+                    std::fflush(stdout);
+#endif
+                }
+                if (file) {
+                    std::fwrite(buf.data, 1, buf.size, file);
+                    std::fflush(file);
+                }
+            }
+
+            std::unique_ptr<Cell[]> cells;
+            alignas(64) std::atomic<size_t> writePos{ 0 };
+            alignas(64) size_t readPos = 0;
+            uint64_t reported = 0;
+            FILE* file = nullptr;
+            bool console = true;
+
+            std::atomic<bool> running{ true };
+            std::mutex mutex;
+            std::mutex wakeMutex;
+            std::condition_variable wake;
+            std::thread thread;
+        };
+
+        // never destroyed: messages may still arrive from static destructors
+        Sink& sink()
+        {
+            static Sink* instance = new Sink();
+            return *instance;
+        }
+    }
+
+    int64_t Log::now()
+    {
+        static const auto start = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    uint8_t* Log::claim()
+    {
+        return sink().claim();
+    }
+
+    void Log::commit(uint8_t* slot, Level level)
+    {
+        sink().commit(slot, level);
+    }
+
+    void Log::setFile(const char* path)
+    {
+        sink().setFile(path);
+    }
+
+    void Log::setConsole(bool enabled)
+    {
+        sink().setConsole(enabled);
+    }
+
+    void Log::flush()
+    {
+        sink().drain();
+    }
+
+    void Log::shutdown()
+    {
+        sink().stop();
+    }
+
+    uint64_t Log::dropped()
+    {
+        return sink().dropped.load(std::memory_order_relaxed);
+    }
+}
@@ -1,28 +1,256 @@
 #pragma once
 
-#include <iostream>
-#include <sstream>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+#include <type_traits>
+
+// Messages below this level are compiled out: 0 debug, 1 info, 2 warning, 3 error.
+#ifndef VG_LOG_LEVEL
+#define VG_LOG_LEVEL 1
+#endif
 
 namespace vg
 {
+    // Formats into a fixed stack buffer so logging never touches the heap.
+    struct LogBuffer
+    {
+        char data[1024];
+        size_t size = 0;
+        bool truncated = false;
+
+        void put(const char* value) {
+            while (*value && size < sizeof(data) - 2) data[size++] = *value++;
+            if (*value) truncated = true;
+        }
+        void put(char* value) { put(static_cast<const char*>(value)); }
+        void put(const std::string& value) { put(value.c_str()); }
+        void put(char value) { char s[2] = { value,0 }; put(s); }
+        void put(bool value) { put(value ? "true" : "false"); }
+
+        template<typename T> void put(T value) {
+            if constexpr (std::is_enum<T>::value) {
+                put(static_cast<typename std::underlying_type<T>::type>(value));
+            }
+            else if constexpr (std::is_pointer<T>::value) {
+                format("%p", static_cast<const void*>(value));
+            }
+            else if constexpr (std::is_floating_point<T>::value) {
+                format("%g", static_cast<double>(value));
+            }
+            else if constexpr (std::is_signed<T>::value) {
+                format("%lld", static_cast<long long>(value));
+            }
+            else {
+                format("%llu", static_cast<unsigned long long>(value));
+            }
+        }
+
+        template<typename T> void format(const char* fmt, T value) {
+            int n = std::snprintf(data + size, sizeof(data) - 1 - size, fmt, value);
+            if (n > 0) {
+                if (size + n > sizeof(data) - 2) truncated = true;
+                size = std::min(size + n, sizeof(data) - 2);
+            }
+        }
+
+        // Appends "…" to a cut message, over its last character if the buffer is full.
+        void ellipsis() {
+            if (size > sizeof(data) - 5) {
+                size = sizeof(data) - 5;
+                while (size > 0 && (static_cast<unsigned char>(data[size]) & 0xc0) == 0x80) size--;
+            }
+            std::memcpy(data + size, "\xe2\x80\xa6", 3);
+            size += 3;
+        }
+    };
+
+    // Per call site state of the rate limiter: at most `limit` messages a second get through,
+    // the rest are counted and reported with the next one that does.
+    struct LogSite
+    {
+        static constexpr uint32_t limit = 20;
+
+        std::atomic<int64_t> second{ -1 };
+        std::atomic<uint32_t> count{ 0 };
+        std::atomic<uint32_t> suppressed{ 0 };
+
+        bool allow(int64_t now, uint32_t& skipped) {
+            int64_t current = second.load(std::memory_order_relaxed);
+            if (current != now && second.compare_exchange_strong(current, now, std::memory_order_relaxed)) {
+                count.store(0, std::memory_order_relaxed);
+            }
+            if (count.fetch_add(1, std::memory_order_relaxed) < limit) {
+                skipped = suppressed.exchange(0, std::memory_order_relaxed);
+                return true;
+            }
+            suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    };
+
+    // Asynchronous logger. A call copies its arguments as raw bytes into a slot of a
+    // lock-free ring buffer and returns; a background thread formats them and writes to the
+    // console and, if set, a file. When the ring is full the message is dropped and counted
+    // instead of blocking the caller.
     class Log
     {
     public:
-        template <typename... TS> static void log(const char* severity, TS... args)
+        enum Level : uint8_t { Debug, Info, Warning, Error };
+
+        using Decoder = void(*)(const uint8_t* data, LogBuffer& out);
+
+        struct Record
         {
-            std::stringstream ss;
-            ss << severity;
-            int a[] = {((ss << args),0)...};
-#if defined(_MSC_VER)
-            ss << "\n";
-            OutputDebugString(ss.str().c_str());
-#else
-            std::cout << ss.str() << std::endl;
-#endif
+            Decoder decode;
+            const char* severity;
+            int64_t time;
+            uint32_t suppressed;
+            uint32_t size;
+            Level level;
+            bool truncated;
+        };
+
+        // as much as a formatted line can hold, so only the line limit cuts messages
+        static constexpr size_t payloadSize = sizeof(LogBuffer::data);
+        static constexpr size_t slotSize = sizeof(Record) + payloadSize;
+
+        template <typename... TS> static void log(LogSite& site, Level level, const char* severity, TS... args)
+        {
+            int64_t time = now();
+            uint32_t skipped = 0;
+            if (!site.allow(time / 1000000000, skipped)) {
+                return;
+            }
+
+            uint8_t* slot = claim();
+            if (!slot) {
+                return;
+            }
+
+            static_assert(fixedSize<TS...>() <= payloadSize, "too many log arguments");
+            Encoder encoder = { slot + sizeof(Record), 0, payloadSize - fixedSize<TS...>(), stringCount<TS...>() };
+            int a[] = { 0, (encoder.put(args),0)... };
+            (void)a;
+
+            Record record = { &decode<typename Stored<TS>::type...>, severity, time, skipped, static_cast<uint32_t>(encoder.size), level, encoder.truncated };
+            std::memcpy(slot, &record, sizeof(record));
+            commit(slot, level);
+        }
+
+        // Also writes every message to path; nullptr closes the file.
+        static void setFile(const char* path);
+
+        // Turns the debugger/stdout output on or off, the file is not affected.
+        static void setConsole(bool enabled);
+
+        // Blocks until every message logged so far has been written.
+        static void flush();
+
+        // Writes what is left and stops the background thread; later messages are written
+        // synchronously. Runs at exit if nobody called it before.
+        static void shutdown();
+
+        static uint64_t dropped();
+    private:
+        // const char*, char* and std::string are copied as length + characters
+        template<typename T> struct Stored
+        {
+            using type = typename std::conditional<
+                std::is_same<T, const char*>::value || std::is_same<T, char*>::value || std::is_same<T, std::string>::value,
+                const char*, T>::type;
+        };
+
+        // bytes every argument needs regardless of string length
+        template<typename... TS> static constexpr size_t fixedSize() {
+            size_t size = 0;
+            bool a[] = { false, (size += std::is_same<typename Stored<TS>::type, const char*>::value ? sizeof(uint32_t) + 1 : sizeof(TS), false)... };
+            (void)a;
+            return size;
+        }
+
+        template<typename... TS> static constexpr size_t stringCount() {
+            size_t count = 0;
+            bool a[] = { false, (count += std::is_same<typename Stored<TS>::type, const char*>::value, false)... };
+            (void)a;
+            return count;
+        }
+
+        struct Encoder
+        {
+            uint8_t* data;
+            size_t size;
+            // characters left to all strings of the message; long ones are truncated so that
+            // the strings after them still get a few characters
+            size_t budget;
+            size_t strings;
+            bool truncated = false;
+
+            void string(const char* value, size_t length) {
+                size_t reserve = std::min(budget, (--strings) * 32);
+                uint32_t n = static_cast<uint32_t>(std::min(length, budget - reserve));
+                if (n < length) {
+                    // cut before a UTF-8 sequence rather than in it
+                    while (n > 0 && (static_cast<unsigned char>(value[n]) & 0xc0) == 0x80) n--;
+                    truncated = true;
+                }
+                budget -= n;
+                std::memcpy(data + size, &n, sizeof(n));
+                std::memcpy(data + size + sizeof(n), value, n);
+                data[size + sizeof(n) + n] = 0;
+                size += sizeof(n) + n + 1;
+            }
+
+            void put(const char* value) { string(value, std::strlen(value)); }
+            void put(char* value) { string(value, std::strlen(value)); }
+            void put(const std::string& value) { string(value.c_str(), value.size()); }
+
+            template<typename T> void put(const T& value) {
+                static_assert(std::is_trivially_copyable<T>::value, "log arguments are copied as raw bytes");
+                std::memcpy(data + size, &value, sizeof(T));
+                size += sizeof(T);
+            }
+        };
+
+        template<typename T> static void read(const uint8_t*& data, LogBuffer& out) {
+            if constexpr (std::is_same<T, const char*>::value) {
+                uint32_t n;
+                std::memcpy(&n, data, sizeof(n));
+                out.put(reinterpret_cast<const char*>(data + sizeof(n)));
+                data += sizeof(n) + n + 1;
+            }
+            else {
+                T value;
+                std::memcpy(&value, data, sizeof(T));
+                out.put(value);
+                data += sizeof(T);
+            }
+        }
+
+        template<typename... TS> static void decode(const uint8_t* data, LogBuffer& out) {
+            int a[] = { 0, (read<TS>(data, out),0)... };
+            (void)a;
+            (void)data;
         }
+
+        static int64_t now();
+        static uint8_t* claim();
+        static void commit(uint8_t* slot, Level level);
     };
 
-    #define log_info(...)  Log::log("INFO : ",##__VA_ARGS__)
-    #define log_warning(...) Log::log("WARNING : ",##__VA_ARGS__)
-    #define log_error(...) Log::log("ERROR : ",##__VA_ARGS__)
-}
\ No newline at end of file
+    // the severity string is the first of the variadic arguments so empty messages expand cleanly
+    #define VG_LOG(level, ...) do { \
+        if constexpr (level >= VG_LOG_LEVEL) { \
+            static ::vg::LogSite vgLogSite; \
+            ::vg::Log::log(vgLogSite, level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+    #define log_debug(...)  VG_LOG(::vg::Log::Debug, "DEBUG : ", ##__VA_ARGS__)
+    #define log_info(...)  VG_LOG(::vg::Log::Info, "INFO : ", ##__VA_ARGS__)
+    #define log_warning(...) VG_LOG(::vg::Log::Warning, "WARNING : ", ##__VA_ARGS__)
+    #define log_error(...) VG_LOG(::vg::Log::Error, "ERROR : ", ##__VA_ARGS__)
+}
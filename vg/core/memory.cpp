@@ -0,0 +1,75 @@
+#include "memory.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace vg::memory
+{
+#if VG_TRACK_ALLOCATIONS
+	// per thread, so other threads allocating never trip the render thread's steady-state check
+	static thread_local uint64_t counter = 0;
+
+	uint64_t allocationCount()
+	{
+		return counter;
+	}
+
+	static void* allocate(std::size_t size)
+	{
+		counter++;
+		if (void* p = std::malloc(size ? size : 1)) {
+			return p;
+		}
+		throw std::bad_alloc();
+	}
+
+	static void* allocateAligned(std::size_t size, std::size_t align)
+	{
+		counter++;
+		size = (size + align - 1) & ~(align - 1);
+#if defined(_MSC_VER)
+		void* p = _aligned_malloc(size ? size : align, align);
+#else
+		void* p = std::aligned_alloc(align, size ? size : align);
+#endif
+		if (p) {
+			return p;
+		}
+		throw std::bad_alloc();
+	}
+
+	static void freeAligned(void* p)
+	{
+#if defined(_MSC_VER)
+		_aligned_free(p);
+#else
+		std::free(p);
+#endif
+	}
+#else
+	uint64_t allocationCount()
+	{
+		return 0;
+	}
+#endif
+}
+
+#if VG_TRACK_ALLOCATIONS
+void* operator new(std::size_t size) { return vg::memory::allocate(size); }
+void* operator new[](std::size_t size) { return vg::memory::allocate(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { try { return vg::memory::allocate(size); } catch (...) { return nullptr; } }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { try { return vg::memory::allocate(size); } catch (...) { return nullptr; } }
+void* operator new(std::size_t size, std::align_val_t align) { return vg::memory::allocateAligned(size, static_cast<std::size_t>(align)); }
+void* operator new[](std::size_t size, std::align_val_t align) { return vg::memory::allocateAligned(size, static_cast<std::size_t>(align)); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { vg::memory::freeAligned(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { vg::memory::freeAligned(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { vg::memory::freeAligned(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { vg::memory::freeAligned(p); }
+#endif
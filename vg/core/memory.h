@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+#if !defined(VG_TRACK_ALLOCATIONS) && !defined(NDEBUG)
+#define VG_TRACK_ALLOCATIONS 1
+#endif
+
+namespace vg::memory
+{
+	// Number of global operator new calls made by the calling thread so far.
+	// Always returns 0 when VG_TRACK_ALLOCATIONS is off.
+	uint64_t allocationCount();
+
+	class AllocationScope
+	{
+		uint64_t begin;
+	public:
+		AllocationScope() : begin(allocationCount()) {}
+
+		void restart() { begin = allocationCount(); }
+
+		uint64_t count() const { return allocationCount() - begin; }
+	};
+}
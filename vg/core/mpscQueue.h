@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace vg
+{
+	// Unbounded multi-producer single-consumer queue (Vyukov). push() is wait-free and may be
+	// called from any thread; pop() never blocks and must only be called by the consumer.
+	template<typename T> class MpscQueue
+	{
+		struct Node
+		{
+			std::atomic<Node*> next{ nullptr };
+			T value;
+		};
+
+		std::atomic<Node*> head;
+		Node* tail;
+	public:
+		MpscQueue() {
+			tail = new Node();
+			head.store(tail, std::memory_order_relaxed);
+		}
+
+		~MpscQueue() {
+			T value;
+			while (pop(value)) {}
+			delete tail;
+		}
+
+		MpscQueue(const MpscQueue&) = delete;
+		MpscQueue& operator=(const MpscQueue&) = delete;
+
+		void push(T value) {
+			auto node = new Node();
+			node->value = std::move(value);
+			auto prev = head.exchange(node, std::memory_order_acq_rel);
+			prev->next.store(node, std::memory_order_release);
+		}
+
+		// A push that is still in progress may not be visible yet; its producer wakes the
+		// consumer afterwards, so a false return never loses an element.
+		bool pop(T& value) {
+			Node* next = tail->next.load(std::memory_order_acquire);
+			if (!next) {
+				return false;
+			}
+			value = std::move(next->value);
+			delete tail;
+			tail = next;
+			return true;
+		}
+	};
+}
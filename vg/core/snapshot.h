@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace vg
+{
+	// Lock-free single-producer single-consumer snapshot exchange. The producer fills write()
+	// and publishes it, the consumer acquires the most recent publication and reads it while
+	// the producer already fills the next one. Three slots, so neither side ever waits;
+	// snapshots the consumer did not get to are dropped.
+	template<typename T> class SnapshotBuffer
+	{
+		static constexpr uint32_t fresh = 4;
+		static constexpr uint32_t slot = 3;
+
+		T slots[3];
+		std::atomic<uint32_t> middle{ 1 };
+		uint32_t back = 0;
+		uint32_t front = 2;
+	public:
+		T& write() { return slots[back]; }
+
+		void publish() {
+			back = middle.exchange(back | fresh, std::memory_order_acq_rel) & slot;
+		}
+
+		// Returns true if a new snapshot was published since the last acquire.
+		bool acquire() {
+			if ((middle.load(std::memory_order_relaxed) & fresh) == 0) {
+				return false;
+			}
+			front = middle.exchange(front, std::memory_order_acq_rel) & slot;
+			return true;
+		}
+
+		const T& read() const { return slots[front]; }
+	};
+}
@@ -2,6 +2,12 @@
 
 //#include <vku.hpp>
 #include "vk/vkt.h"
+#include "uploader.h"
+#include <core/arena.h>
+#include <core/jobs.h>
+#include <core/memory.h>
+#include <algorithm>
+#include <cstdio>
 
 namespace vg
 {
@@ -28,29 +34,86 @@ namespace vg
 			vk::Image depth;
 		}multiSample;
 
+		VkExtent2D attachmentExtent = {};
+
 		std::vector<vk::FrameBuffer> frameBuffers;
 		std::vector<vk::CommandBuffer> commandBuffers;
 
+		FrameArena frameArena;
+		memory::AllocationScope frameAllocations;
+		uint32_t steadyFrames = 0;
+		uint64_t resourceVersion = 0;
+
+		static constexpr const char* pipelineCachePath = "pipeline.cache";
+
 		VkSampleCountFlagBits sampeCount = VK_SAMPLE_COUNT_8_BIT;
 		VkFormat colorFormat = VK_FORMAT_B8G8R8A8_UNORM;
 		VkFormat depthFormat = VK_FORMAT_D24_UNORM_S8_UINT;
+
+		// A timestamp pair per target image for the GPU time of a frame; left null when the
+		// graphics queue does not support timestamps.
+		vk::QueryPool timestamps;
+		float timestampPeriod = 0.0f;
+
+		// Without a window, frames go to images of a fixed size that nobody presents.
+		struct
+		{
+			VkExtent2D extent = {};
+			std::vector<vk::Image> images;
+		}offscreen;
+
+		Uploader uploader;
+
+		// shared by loaders, culling and recording; declared last so workers stop first
+		JobSystem jobs;
 	public:
+		static constexpr uint32_t offscreenImageCount = 2;
+		static constexpr uint32_t maxTimedImages = 8;
+
 		Context_T(const void* windowHandle)
 		{
 			vk::InstanceMaker im;
 			instance = im.create();
 
 			surface = instance->createSurface(windowHandle);
+			if (!createDevice()) {
+				return;
+			}
+
+			swapchain = device->createSwapchain(surface);
+			colorFormat = swapchain->getColorFormat();
+			createRenderPass(VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+			createFrameBuffer();
+		}
 
+		// Headless context for benchmarks and tests; the resolved images are left in
+		// TRANSFER_SRC so they can be read back.
+		Context_T(VkExtent2D extent)
+		{
+			vk::InstanceMaker im;
+			instance = im.create();
+			if (!createDevice()) {
+				return;
+			}
+
+			offscreen.extent = extent;
+			for (uint32_t i = 0; i < offscreenImageCount; i++) {
+				offscreen.images.emplace_back(device->createColorAttachment(extent.width, extent.height, VK_SAMPLE_COUNT_1_BIT, colorFormat));
+			}
+			createRenderPass(VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+			createFrameBuffer();
+		}
+
+		bool createDevice() {
 			auto gpus = instance->getPhysicalDevice();
 			VkPhysicalDevice physicalDevice = gpus[0];
 
+			auto queueProps = vk::getQueueFamilyProperties(physicalDevice);
 			{
-				auto queueProps = vk::getQueueFamilyProperties(physicalDevice);
 				VkQueueFlags search = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
 				for (uint32_t qi = 0; qi != queueProps.size(); ++qi) {
 					auto& qprop = queueProps[qi];
-					std::cout << std::to_string(qprop.queueFlags) << "\n";
+					log_debug("queue family ", qi, " flags ", qprop.queueFlags);
 					if ((qprop.queueFlags & search) == search) {
 						graphicsQueueFamilyIndex = qi;
 						computerQueueFamilyIndex = qi;
@@ -60,16 +123,33 @@ namespace vg
 
 				if (graphicsQueueFamilyIndex == ~0 || computerQueueFamilyIndex == ~0) {
 					log_error("oops, missing a queue\n");
-					return;
+					return false;
 				}
 			}
 
-			if (!vk::getSurfaceSupport(physicalDevice, graphicsQueueFamilyIndex, *surface)) {
+			if (surface && !vk::getSurfaceSupport(physicalDevice, graphicsQueueFamilyIndex, *surface)) {
 				log_error("surface not support");
 			}
 
 			vk::DeviceMaker dm;
 			dm.extension(VK_KHR_MAINTENANCE1_EXTENSION_NAME);
+
+			// pipeline variants are then linked from shared parts instead of built whole
+			auto extensions = vk::getDeviceExtensions(physicalDevice);
+			VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipelineLibrary = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT };
+			if (vk::hasDeviceExtension(extensions, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+				vk::hasDeviceExtension(extensions, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+				VkPhysicalDeviceFeatures2 features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+				features.pNext = &pipelineLibrary;
+				vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+				if (pipelineLibrary.graphicsPipelineLibrary) {
+					dm.extension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+					dm.extension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+					pipelineLibrary.pNext = nullptr;
+					dm.next(&pipelineLibrary);
+				}
+			}
+
 			VkPhysicalDeviceFeatures feature = {};
 			feature.wideLines = VK_TRUE;
 			feature.geometryShader = VK_TRUE;
@@ -80,11 +160,24 @@ namespace vg
 				dm.queue(computerQueueFamilyIndex);
 			}
 			device = dm.create(physicalDevice);
+			loadPipelineCache();
 
 			auto prop = device->getPhysicalDeviceProperties();
 			log_info("Use device : ", prop.deviceName);
+			log_info("Graphics pipeline library : ", device->graphicsPipelineLibrary() ? "yes" : "no");
 			log_info("Max memory allocation count : ", prop.limits.maxMemoryAllocationCount);
 
+			// software rasterizers stop at 4 samples
+			VkSampleCountFlags supported = prop.limits.framebufferColorSampleCounts & prop.limits.framebufferDepthSampleCounts;
+			while (sampeCount > VK_SAMPLE_COUNT_1_BIT && !(supported & sampeCount)) {
+				sampeCount = static_cast<VkSampleCountFlagBits>(sampeCount >> 1);
+			}
+
+			if (queueProps[graphicsQueueFamilyIndex].timestampValidBits > 0) {
+				timestamps = device->createQueryPool(VK_QUERY_TYPE_TIMESTAMP, maxTimedImages * 2);
+				timestampPeriod = prop.limits.timestampPeriod;
+			}
+
 			graphicsQueue = device->getQueue(graphicsQueueFamilyIndex);
 			if (computerQueueFamilyIndex == graphicsQueueFamilyIndex) {
 				computerQueue = graphicsQueue->clone();
@@ -95,16 +188,20 @@ namespace vg
 
 			descriptorPool = device->createDescriptorPool();
 			commandPool = device->createCommandPool(graphicsQueueFamilyIndex);
-			
-			swapchain = device->createSwapchain(surface);
-			colorFormat = swapchain->getColorFormat();
+			uploader = Uploader(device.get(), commandPool, graphicsQueue);
+			return true;
+		}
+
+		// The resolve target ends up in resolveLayout: presentable for the swapchain,
+		// TRANSFER_SRC for offscreen images.
+		void createRenderPass(VkImageLayout resolveLayout) {
 			vk::RenderpassMaker rm;
 			rm.attachmentBegin(colorFormat,VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 			rm.attachmentSamples(sampeCount);
 			rm.attachmentLoadOp(VK_ATTACHMENT_LOAD_OP_CLEAR);
 			rm.attachmentStoreOp(VK_ATTACHMENT_STORE_OP_STORE);
 
-			rm.attachmentBegin(colorFormat, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+			rm.attachmentBegin(colorFormat, resolveLayout);
 			rm.attachmentStoreOp(VK_ATTACHMENT_STORE_OP_STORE);
 
 			rm.attachmentBegin(depthFormat,VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
@@ -119,35 +216,80 @@ namespace vg
 			rm.subpassResolveAttachment(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 1);
 			rm.subpassDepthStencilAttachment(VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 2);
 			renderPass = rm.create(device);
+		}
 
-			createFrameBuffer();
+		~Context_T()
+		{
+			// release everything still queued before the surface and device go away
+			if (device) {
+				savePipelineCache();
+				device->waitIdle();
+				device->flushGarbage();
+			}
+		}
+
+		// Pipelines compiled by a previous run, so startup mostly skips shader compilation;
+		// the device checks the header before trusting any of it.
+		void loadPipelineCache() {
+			std::vector<uint8_t> data;
+			if (FILE* file = std::fopen(pipelineCachePath, "rb")) {
+				std::fseek(file, 0, SEEK_END);
+				long size = std::ftell(file);
+				std::fseek(file, 0, SEEK_SET);
+				data.resize(size > 0 ? size_t(size) : 0);
+				data.resize(std::fread(data.data(), 1, data.size(), file));
+				std::fclose(file);
+			}
+			device->loadPipelineCache(data);
+		}
+
+		void savePipelineCache() {
+			auto data = device->savePipelineCache();
+			if (FILE* file = std::fopen(pipelineCachePath, "wb")) {
+				std::fwrite(data.data(), 1, data.size(), file);
+				std::fclose(file);
+			}
 		}
 
 		void createFrameBuffer() {
-			const auto extent = swapchain->getExtent();
+			const auto extent = getExtent();
 			if (extent.width == 0 || extent.height == 0) {return;}
 
-			depth = device->createDepthStencilAttachment(extent.width, extent.height);
+			// Attachments are only reallocated when the window grows past them, with some
+			// headroom so dragging a window edge settles into one allocation. Framebuffers
+			// may be smaller than their attachments.
+			if (extent.width > attachmentExtent.width || extent.height > attachmentExtent.height) {
+				auto grow = [](uint32_t size) { return (size + size / 4 + 63) & ~63u; };
+				attachmentExtent.width = std::max(attachmentExtent.width, grow(extent.width));
+				attachmentExtent.height = std::max(attachmentExtent.height, grow(extent.height));
+
+				depth = device->createDepthStencilAttachment(attachmentExtent.width, attachmentExtent.height);
 
-			multiSample.color = device->createColorAttachment(extent.width, extent.height, sampeCount);
-			multiSample.depth = device->createDepthStencilAttachment(extent.width, extent.height, sampeCount);
+				multiSample.color = device->createColorAttachment(attachmentExtent.width, attachmentExtent.height, sampeCount);
+				multiSample.depth = device->createDepthStencilAttachment(attachmentExtent.width, attachmentExtent.height, sampeCount);
+			}
 
 			frameBuffers.swap(std::vector<vk::FrameBuffer>());
-			for (uint32_t i = 0; i < swapchain->getImageCount(); i++)
+			for (uint32_t i = 0; i < getImageCount(); i++)
 			{
-				std::array<VkImageView, 4> attachments = { multiSample.color->view(), swapchain->getView(i),multiSample.depth->view(), depth->view() };
+				VkImageView target = swapchain ? swapchain->getView(i) : offscreen.images[i]->view();
+				std::array<VkImageView, 4> attachments = { multiSample.color->view(), target,multiSample.depth->view(), depth->view() };
 				frameBuffers.emplace_back(device->createFrameBuffer(renderPass, extent.width, extent.height, attachments));
 			}
 
-			if (commandBuffers.size() == 0) {
-				for (uint32_t i = 0; i < swapchain->getImageCount(); i++)
-				{
-					commandBuffers.emplace_back(commandPool->createCommandBuffer());
-				}
+			while (commandBuffers.size() < getImageCount())
+			{
+				commandBuffers.emplace_back(commandPool->createCommandBuffer());
 			}
 		}
 
+		// The new swapchain is created with the current one as oldSwapchain; the old one and
+		// its framebuffers are retired through the deletion queue, so frames still in flight
+		// finish presenting from it.
 		bool resize() {
+			if (!swapchain) {
+				return true;
+			}
 			if (swapchain->reCreate()) {
 				createFrameBuffer();
 				return true;
@@ -155,16 +297,57 @@ namespace vg
 			return false;
 		}
 
+		// Per-frame scratch memory is reset here; everything the render loop needs
+		// transiently must come from the arena or the stack.
+		void beginFrame() {
+			frameArena.reset();
+			frameAllocations.restart();
+		}
+
+		// After a couple of warm-up frames with no resource churn, a frame must not
+		// have called global operator new.
+		void endFrame() {
+#if VG_TRACK_ALLOCATIONS
+			if (steadyFrames >= 2) {
+				assert(frameAllocations.count() == 0 && "heap allocation in steady-state frame");
+			}
+#endif
+			steadyFrames++;
+		}
+
+		// Resize, geometry upload, picking and buffer growth legitimately allocate, and may
+		// replace resources that cached command buffers reference.
+		void invalidateFrame() {
+			steadyFrames = 0;
+			resourceVersion++;
+		}
+
+		// Streaming allocates while it has work, without replacing anything recorded commands use.
+		void restartSteadyState() {
+			steadyFrames = 0;
+		}
+
+		uint64_t getResourceVersion() const { return resourceVersion; }
+
+		FrameArena& getFrameArena() { return frameArena; }
+		JobSystem& getJobs() { return jobs; }
+		Uploader& getUploader() { return uploader; }
+
 		vk::Device& getDevice() { return device; }
 		vk::Swapchain& getSwapchain() { return swapchain; }
 		vk::Queue& getGraphicsQueue() { return graphicsQueue; }
-		VkExtent2D getExtent() const { return swapchain->getExtent(); }
+		VkExtent2D getExtent() const { return swapchain ? swapchain->getExtent() : offscreen.extent; }
+		uint32_t getImageCount() const { return swapchain ? swapchain->getImageCount() : static_cast<uint32_t>(offscreen.images.size()); }
+		bool isHeadless() const { return !swapchain; }
+		vk::Image& getOffscreenImage(uint32_t index) { return offscreen.images.at(index); }
+		vk::QueryPool& getTimestamps() { return timestamps; }
+		float getTimestampPeriod() const { return timestampPeriod; }
 		vk::FrameBuffer& getFrameBuffer(uint32_t index) { return frameBuffers.at(index); }
 		vk::CommandBuffer& getCommandBuffer(uint32_t index) { return commandBuffers.at(index); }
 		vk::RenderPass& getRenderPass() { return renderPass; }
 		vk::CommandPool& getCommandPool() { return commandPool; }
 		vk::DescriptorPool& getDescriptorPool() { return descriptorPool; }
-		vk::CommandBuffer createCommandBuffer() { return commandPool->createCommandBuffer(); }
+		vk::CommandBuffer createCommandBuffer(VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY) { return commandPool->createCommandBuffer(level); }
 		VkSampleCountFlagBits getSampleCount() { return sampeCount; }
 		
 	};
@@ -174,4 +357,8 @@ namespace vg
 	static Context createContext(const void* windowHandle) {
 		return std::make_unique<Context_T>(windowHandle);
 	}
+
+	static Context createHeadlessContext(uint32_t width, uint32_t height) {
+		return std::make_unique<Context_T>(VkExtent2D{ width, height });
+	}
 }
\ No newline at end of file
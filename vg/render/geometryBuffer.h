@@ -1,44 +1,109 @@
 #pragma once
 #include "context.h"
 #include "geometryInfo.h"
-#include <functional>
+#include "vertexArena.h"
+#include <util/mesh.h>
+#include <glm/glm.hpp>
 
 namespace vg
 {
 	struct GeometryBuffer
 	{
+		// owned vertices, empty when they were placed in the VertexArena
 		vk::Buffer vertexBuffer;
 		vk::Buffer indexBuffer;
 
-		std::vector<VkVertexInputBindingDescription> bindings;
-		std::vector<VkVertexInputAttributeDescription> attributes;
+		// where the vertices are read from: vertexBuffer or the arena at vertexOffset
+		VkBuffer vertices = VK_NULL_HANDLE;
+		VkDeviceSize vertexOffset = 0;
+
+		VertexFormat format;
+		// start of binding 1 relative to vertexOffset when the positions are separate
+		VkDeviceSize attributeOffset = 0;
+
+		// In the arena, so vertex shaders can fetch the vertices from its storage buffer with
+		// pullLayout instead of going through fixed function vertex input: byte offsets of
+		// the position and attribute streams; position stride(8) | attribute stride(8) |
+		// position(12); normal(12) | texcoord(12), each attribute as VertexFormat::pack.
+		bool pulled = false;
+		glm::uvec4 pullLayout = glm::uvec4(0);
 
 		VkIndexType indexType = VK_INDEX_TYPE_UINT16;
 		uint32_t count = 0;
 
+		GeometryBounds bounds;
+
+		// Slot of the virtual texture sampled with the texcoords, -1 when untextured.
+		int32_t virtualTexture = -1;
+
+		// Shaders take offset + stored * scale as the position, which undoes the quantization
+		// to the bounds and is the identity for floats.
+		glm::vec4 positionOffset = glm::vec4(0.0f);
+		glm::vec4 positionScale = glm::vec4(1.0f);
+		bool octahedralNormals = false;
+
+		// format.key(); equal for geometries that can share pipelines.
+		uint64_t layoutKey = 0;
+
 		GeometryBuffer() {}
 
-		GeometryBuffer(const Context& ctx,const GeometryBufferInfo& info) {
-			vertexBuffer = ctx->getDevice()->createVertexBuffer(info.vertexSize);
-			vertexBuffer->upload(ctx->getCommandPool(), ctx->getGraphicsQueue(), info.vertex);
-			indexBuffer = ctx->getDevice()->createIndexBuffer(info.vertexSize);
-			indexBuffer->upload(ctx->getCommandPool(), ctx->getGraphicsQueue(), info.index);
+		// Vertices go into the arena while it has room, the rest get a vertex buffer of their
+		// own. An invalid format leaves the buffer empty, with nothing to draw.
+		GeometryBuffer(const Context& ctx, const GeometryBufferInfo& info, VertexArena* arena = nullptr) {
+			if (!describe(info)) {
+				return;
+			}
+			if (arena && arena->place(ctx, info.vertex, info.vertexSize, vertexOffset)) {
+				vertices = arena->getBuffer()->get();
+				pulled = true;
+				pullLayout.x = static_cast<uint32_t>(vertexOffset);
+				pullLayout.y = static_cast<uint32_t>(vertexOffset + attributeOffset);
+				pullLayout.z = format.positionBindingStride() | (format.stride << 8) | (VertexFormat::pack(format.position) << 16);
+				pullLayout.w = VertexFormat::pack(format.normal) | (VertexFormat::pack(format.texcoord) << 12);
+			}
+			else {
+				vertexBuffer = ctx->getDevice()->createVertexBuffer(info.vertexSize);
+				ctx->getUploader().buffer(vertexBuffer, info.vertex, info.vertexSize);
+				vertices = vertexBuffer->get();
+			}
+			indexBuffer = ctx->getDevice()->createIndexBuffer(info.indexSize);
+			ctx->getUploader().buffer(indexBuffer, info.index, info.indexSize);
+		}
+
+		// Vertex format, bounds and index count of info; needs no device. Returns false
+		// without reading the vertices if the format is invalid.
+		bool describe(const GeometryBufferInfo& info) {
+			format = info.format;
+			layoutKey = format.key();
+			count = 0;
+			if (!format.valid()) {
+				log_error("invalid vertex format ", layoutKey);
+				return false;
+			}
+			bool quantized = format.quantizedPosition();
+			octahedralNormals = format.octahedralNormals();
+			attributeOffset = format.attributeOffset(info.vertexSize);
 
-			uint32_t offset = 0;
-			if ((info.flags & VertexType::position) == VertexType::position) {
-				attributes.push_back({ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offset });
-				offset += sizeof(float) * 3;
+			if (info.hasBounds) {
+				bounds = info.bounds;
 			}
-			if ((info.flags & VertexType::normal) == VertexType::normal) {
-				attributes.push_back({ 1, 0, VK_FORMAT_R32G32B32_SFLOAT, offset });
-				offset += sizeof(float) * 3;
+			else if (quantized) {
+				log_error("quantized positions need the bounds they were quantized to");
 			}
-			if ((info.flags & VertexType::texcoord) == VertexType::texcoord) {
-				attributes.push_back({ 2, 0, VK_FORMAT_R32G32_SFLOAT, offset });
-				offset += sizeof(float) * 2;
+			else if (format.position.present()) {
+				// the positions come first when they are a stream of their own
+				uint32_t stride = format.positionBindingStride();
+				bounds = computeBounds(info.vertex, format.vertexCount(info.vertexSize) * stride, stride, format.position.offset);
 			}
 
-			bindings.push_back({ 0, offset, VK_VERTEX_INPUT_RATE_VERTEX });
+			if (quantized) {
+				positionOffset = glm::vec4(bounds.min, 0.0f);
+				positionScale = glm::vec4(bounds.max - bounds.min, 0.0f);
+			}
+			else {
+				positionOffset = glm::vec4(0.0f);
+				positionScale = glm::vec4(1.0f);
+			}
 
 			if (info.indexType == IndexType::u32) {
 				indexType = VK_INDEX_TYPE_UINT32;
@@ -47,6 +112,36 @@ namespace vg
 			else {
 				count = info.indexSize >> 1;
 			}
+			return true;
+		}
+
+		void vertexInput(vk::PipelineMaker& pm) const {
+			pm.vertexFormat(format);
+		}
+
+		// Vertex and index buffers for pipelines made with vertexInput.
+		void bind(vk::CommandBuffer& cmd) const {
+			if (format.separatePositions() && format.stride) {
+				std::array<VkBuffer, 2> buffers = { vertices, vertices };
+				std::array<VkDeviceSize, 2> offsets = { vertexOffset, vertexOffset + attributeOffset };
+				cmd->bindVertexBuffer(0, buffers, offsets);
+			}
+			else {
+				cmd->bindVertexBuffer(0, vertices, vertexOffset);
+			}
+			bindIndices(cmd);
+		}
+
+		// Binding 0 alone, for pipelines made with PipelineMaker::vertexPositions; only the
+		// positions are fetched when they are a stream of their own.
+		void bindPositions(vk::CommandBuffer& cmd) const {
+			cmd->bindVertexBuffer(0, vertices, vertexOffset);
+			bindIndices(cmd);
+		}
+
+		// All a pulled draw binds besides the arena's descriptor set.
+		void bindIndices(vk::CommandBuffer& cmd) const {
+			cmd->bindIndexBuffer(indexBuffer->get(), 0, indexType);
 		}
 	};
 
@@ -54,15 +149,28 @@ namespace vg
 	class GeometryManager
 	{
 		std::unordered_map<uint32_t, GeometryBuffer> geometries;
+		VertexArena arena;
+		uint64_t version = 0;
 
 	public:
-		void addGeometry(const Context& ctx, uint32_t id, const GeometryBufferInfo& info) {
-			if (geometries.find(id) == geometries.end()) {
-				geometries[id] = GeometryBuffer(ctx, info);
+		GeometryManager() {}
+
+		GeometryManager(const Context& ctx) : arena(ctx) {}
+
+		// Returns false, leaving the existing geometry in place, if id is taken, and rejects
+		// vertex formats the passes cannot draw.
+		bool addGeometry(const Context& ctx, uint32_t id, const GeometryBufferInfo& info) {
+			if (!info.format.valid()) {
+				log_error("geometry ", id, " has an invalid vertex format ", info.format.key());
+				return false;
 			}
-			else {
-				log_error("Geometry id is exist : ", id);
+			if (geometries.find(id) == geometries.end()) {
+				geometries[id] = GeometryBuffer(ctx, info, &arena);
+				version++;
+				return true;
 			}
+			log_error("Geometry id is exist : ", id);
+			return false;
 		}
 
 		void draw(vk::CommandBuffer& cmd)
@@ -71,19 +179,35 @@ namespace vg
 			{
 				auto& l = g.second;
 
-				VkDeviceSize offset = { 0 };
-				cmd->bindVertexBuffer(0, l.vertexBuffer->get(), offset);
-				cmd->bindIndexBuffer(l.indexBuffer->get(), 0, l.indexType);
+				l.bind(cmd);
 				cmd->drawIndexd(l.count, 1);
 			}
 		}
 
-		void draw(std::function<void(uint32_t,const GeometryBuffer&)> callback) 
+		void setVirtualTexture(uint32_t id, int32_t slot) {
+			auto it = geometries.find(id);
+			if (it == geometries.end()) {
+				log_error("Geometry id is not exist : ", id);
+			}
+			else if (it->second.virtualTexture != slot) {
+				it->second.virtualTexture = slot;
+				version++;
+			}
+		}
+
+		template<typename F> void draw(F&& callback) 
 		{
 			for (auto& g : geometries)
 			{
 				callback(g.first, g.second);
 			}
 		}
+
+		size_t size() const { return geometries.size(); }
+
+		const VertexArena& getArena() const { return arena; }
+
+		// Bumped whenever the set of geometries changes.
+		uint64_t getVersion() const { return version; }
 	};
 }
\ No newline at end of file
@@ -1,27 +1,57 @@
 #pragma once
 
+#include "vertexFormat.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+#include <cstddef>
+#include <cstdint>
 #include <unordered_map>
+#include <vector>
 
 namespace vg
 {
-	enum VertexType
-	{
-		none = 0x00,
-		position = 0x01,
-		normal = 0x02,
-		texcoord = 0x04,
-		PNT = position | normal | texcoord
-	};
-
 	enum class IndexType
 	{
 		u16,
 		u32
 	};
 
+	// Two half floats, e.g. from glm::packHalf2x16, for VertexTraits.
+	struct half2
+	{
+		uint16_t x = 0;
+		uint16_t y = 0;
+	};
+
+	// Attribute format of a vertex struct member by its type; integer vectors are read
+	// normalized, so a u16vec4 position is quantized to the bounds and an i16vec2 normal
+	// is octahedral.
+	template<typename T> struct AttributeTraits;
+	template<> struct AttributeTraits<glm::vec2> { static constexpr AttributeFormat format = AttributeFormat::Float2; };
+	template<> struct AttributeTraits<glm::vec3> { static constexpr AttributeFormat format = AttributeFormat::Float3; };
+	template<> struct AttributeTraits<glm::vec4> { static constexpr AttributeFormat format = AttributeFormat::Float4; };
+	template<> struct AttributeTraits<half2> { static constexpr AttributeFormat format = AttributeFormat::Half2; };
+	template<> struct AttributeTraits<glm::u16vec2> { static constexpr AttributeFormat format = AttributeFormat::Unorm16x2; };
+	template<> struct AttributeTraits<glm::u16vec4> { static constexpr AttributeFormat format = AttributeFormat::Unorm16x4; };
+	template<> struct AttributeTraits<glm::i16vec2> { static constexpr AttributeFormat format = AttributeFormat::Snorm16x2; };
+	template<> struct AttributeTraits<glm::i8vec2> { static constexpr AttributeFormat format = AttributeFormat::Snorm8x2; };
+
+// Format and offset of a member of the vertex struct V, for VertexTraits<V>::format.
+#define VG_VERTEX_ATTRIBUTE(V, member) ::vg::VertexAttribute{ ::vg::AttributeTraits<decltype(V::member)>::format, static_cast<uint32_t>(offsetof(V, member)) }
+
+	// Axis aligned box and a bounding sphere around the positions of a geometry.
+	struct GeometryBounds
+	{
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
+		glm::vec3 center = glm::vec3(0.0f);
+		float radius = 0.0f;
+	};
+
 	struct GeometryBufferInfo
 	{
-		VertexType flags;
+		// the vertex layout; format.flags() tells which attributes there are
+		VertexFormat format;
 		IndexType indexType;
 
 		void* vertex = nullptr;
@@ -29,11 +59,28 @@ namespace vg
 		uint32_t vertexSize = 0;
 		uint32_t indexSize = 0;
 
+		// Computed from float positions when not given; importMesh always sets them.
+		GeometryBounds bounds;
+		bool hasBounds = false;
+
 		void vertexData(uint32_t size, void* data, VertexType flag = VertexType::position)
 		{
 			vertex = data;
 			vertexSize = size;
-			flags = flag;
+			format = vertexFormat(flag);
+		}
+
+		// Layout from VertexTraits<V>, checked at compile time.
+		template<typename V> void vertexData(const std::vector<V>& data)
+		{
+			vertexData(static_cast<uint32_t>(data.size() * sizeof(V)), const_cast<V*>(data.data()), vertexFormatOf<V>());
+		}
+
+		void vertexData(uint32_t size, void* data, const VertexFormat& layout)
+		{
+			vertex = data;
+			vertexSize = size;
+			format = layout;
 		}
 
 		void indexData(uint32_t size, void* data, IndexType type = IndexType::u16) {
@@ -0,0 +1,304 @@
+#pragma once
+
+#include "context.h"
+#include <core/jobs.h>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace vg
+{
+	// Fixed function state and shader features of one pipeline permutation. Feature bit i is
+	// passed to both stages as `layout(constant_id = i) const bool`, so a single compiled
+	// program covers every combination and each draw only pays for the features it uses.
+	struct PipelineKey
+	{
+		uint32_t program = 0;
+		uint32_t layout = 0;
+		VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+		VkCullModeFlags cullMode = VK_CULL_MODE_NONE;
+		bool blend = false;
+		bool depthTest = true;
+		bool depthWrite = true;
+		uint32_t features = 0;
+
+		static constexpr uint32_t maxFeatures = 12;
+		static constexpr uint32_t maxLayouts = 16;
+
+		// features(12) | program(4) | layout(4) | polygon(2) | cull(2) | blend | depthTest | depthWrite
+		uint32_t pack() const {
+			return ((features & 0xfff) << 15) |
+				((program & 0xf) << 11) |
+				((layout & 0xf) << 7) |
+				((uint32_t(polygonMode) & 0x3) << 5) |
+				((uint32_t(cullMode) & 0x3) << 3) |
+				(uint32_t(blend) << 2) |
+				(uint32_t(depthTest) << 1) |
+				uint32_t(depthWrite);
+		}
+	};
+
+	// Lazily built, deduplicated pipelines of one render state. Programs are compiled to
+	// SPIR-V once, and pipelines are created the first time their key is asked for, both on
+	// job workers so the render thread never waits on the driver. A variant is identified by
+	// a dense index that fits SortKey's pipeline field; find() returns nullptr until its
+	// pipeline has arrived, and version() changes whenever one does.
+	//
+	// With Device_T::graphicsPipelineLibrary, variants are linked from four libraries, each
+	// shared by every variant that agrees on its part of the key. The fast link is published
+	// first and replaced by a link time optimized one once that is built.
+	class PipelineVariants
+	{
+		struct Program
+		{
+			std::string vertSource;
+			std::string fragSource;
+			std::vector<uint32_t> vert;
+			std::vector<uint32_t> frag;
+		};
+
+		struct Variant
+		{
+			PipelineKey key;
+			// written by the worker, moved into pipeline on the render thread
+			vk::Pipeline built;
+			vk::Pipeline optimized;
+			vk::Pipeline pipeline;
+		};
+
+		// Built once by the first worker that needs it; others wait in call_once.
+		struct Library
+		{
+			std::once_flag once;
+			vk::Pipeline pipeline;
+		};
+
+		// Jobs and pinned tasks keep this alive, so the owner can move or go away while
+		// pipelines are still compiling. Deques keep element addresses stable while workers
+		// fill them in.
+		struct State
+		{
+			JobSystem* jobs = nullptr;
+			const vk::Device* device = nullptr;
+			VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+			VkRenderPass renderPass = VK_NULL_HANDLE;
+			VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+			std::deque<Program> programs;
+			std::deque<VertexFormat> layouts;
+			std::deque<Variant> variants;
+			std::unordered_map<uint32_t, uint32_t> lookup;
+
+			std::mutex librariesLock;
+			std::unordered_map<uint64_t, std::unique_ptr<Library>> libraries;
+
+			JobGroup compiles;
+			JobGroup builds;
+			uint32_t pending = 0;
+			uint64_t version = 0;
+		};
+
+		std::shared_ptr<State> state;
+	public:
+		static constexpr uint32_t maxVariants = 0x1000;
+
+		PipelineVariants() {}
+
+		PipelineVariants(const Context& ctx, const vk::PipelineLayout& pipelineLayout, const vk::RenderPass& renderPass, VkSampleCountFlagBits samples)
+			: state(std::make_shared<State>()) {
+			state->jobs = &ctx->getJobs();
+			state->device = &ctx->getDevice();
+			state->pipelineLayout = pipelineLayout->get();
+			state->renderPass = renderPass->get();
+			state->samples = samples;
+		}
+
+		PipelineVariants(PipelineVariants&&) = default;
+		PipelineVariants& operator=(PipelineVariants&&) = default;
+
+		~PipelineVariants() {
+			if (state) {
+				state->jobs->wait(state->builds);
+				state->jobs->wait(state->compiles);
+			}
+		}
+
+		// Starts compiling right away; variants using it are built once every program added so far is done.
+		uint32_t addProgram(const std::string& vert, const std::string& frag) {
+			state->programs.push_back({ vert, frag });
+			Program* program = &state->programs.back();
+			state->jobs->run(state->compiles, [program] {
+				program->vert = vk::compileGLSL(VK_SHADER_STAGE_VERTEX_BIT, program->vertSource);
+				program->frag = vk::compileGLSL(VK_SHADER_STAGE_FRAGMENT_BIT, program->fragSource);
+			});
+			return static_cast<uint32_t>(state->programs.size() - 1);
+		}
+
+		// VertexFormat{} leaves out vertex input altogether.
+		uint32_t addLayout(const VertexFormat& layout) {
+			state->layouts.push_back(layout);
+			return static_cast<uint32_t>(state->layouts.size() - 1);
+		}
+
+		// Index of the variant for key, queueing its pipeline on first use.
+		uint32_t variant(const Context& ctx, const PipelineKey& key) {
+			uint32_t packed = key.pack();
+			auto it = state->lookup.find(packed);
+			if (it != state->lookup.end()) {
+				return it->second;
+			}
+
+			if (state->variants.size() >= maxVariants || key.program >= state->programs.size() || key.layout >= state->layouts.size()) {
+				log_error("invalid pipeline variant ", packed);
+				return maxVariants;
+			}
+
+			state->variants.push_back({ key });
+			uint32_t index = static_cast<uint32_t>(state->variants.size() - 1);
+			state->lookup.emplace(packed, index);
+			state->pending++;
+			// queueing allocates, but nothing recorded so far is affected
+			ctx->restartSteadyState();
+
+			// workers only follow pointers taken here, the deques may grow meanwhile
+			std::shared_ptr<State> shared = state;
+			Variant* target = &state->variants.back();
+			const Program* program = &state->programs[key.program];
+			const VertexFormat* layout = &state->layouts[key.layout];
+			state->jobs->run(state->builds, [shared, target, program, layout, index] {
+				bool library = (*shared->device)->graphicsPipelineLibrary();
+				Libraries libraries = {};
+				if (library) {
+					libraries = linkLibraries(*shared, *program, *layout, target->key);
+					target->built = link(*shared, libraries, false);
+				}
+				else {
+					target->built = build(*shared, *program, *layout, target->key);
+				}
+				shared->jobs->pin([shared, index] {
+					auto& v = shared->variants[index];
+					v.pipeline = std::move(v.built);
+					shared->pending--;
+					shared->version++;
+				});
+
+				// pinned tasks run in order, so the optimized link always lands second
+				if (library) {
+					shared->jobs->run(shared->builds, [shared, target, libraries, index] {
+						target->optimized = link(*shared, libraries, true);
+						shared->jobs->pin([shared, index] {
+							// the fast link is retired once the frames using it are done
+							auto& v = shared->variants[index];
+							v.pipeline = std::move(v.optimized);
+							shared->version++;
+						});
+					});
+				}
+			}, state->compiles);
+			return index;
+		}
+
+		// nullptr while the pipeline is still being built
+		const vk::Pipeline* find(uint32_t index) const {
+			if (index >= state->variants.size() || !state->variants[index].pipeline) {
+				return nullptr;
+			}
+			return &state->variants[index].pipeline;
+		}
+
+		uint32_t size() const { return static_cast<uint32_t>(state->variants.size()); }
+		uint32_t pending() const { return state->pending; }
+		uint64_t version() const { return state->version; }
+	private:
+		// All of the state of key, for create or createLibrary.
+		static void configure(vk::PipelineMaker& pm, const State& state, const Program& program, const VertexFormat& layout, const PipelineKey& key) {
+			pm.defaultDynamic();
+			pm.shaderSPIRV(VK_SHADER_STAGE_VERTEX_BIT, program.vert);
+			pm.shaderSPIRV(VK_SHADER_STAGE_FRAGMENT_BIT, program.frag);
+			for (uint32_t i = 0; i < PipelineKey::maxFeatures; i++) {
+				VkBool32 enabled = (key.features >> i) & 1;
+				pm.specialization(VK_SHADER_STAGE_VERTEX_BIT, i, enabled);
+				pm.specialization(VK_SHADER_STAGE_FRAGMENT_BIT, i, enabled);
+			}
+
+			// an empty layout is for programs that pull their vertices from storage buffers
+			if (layout.position.present()) {
+				pm.vertexFormat(layout);
+			}
+			pm.blendBegin(key.blend);
+			pm.polygonMode(key.polygonMode);
+			pm.cullMode(key.cullMode);
+			pm.depthTestEnable(key.depthTest);
+			pm.depthWriteEnable(key.depthWrite);
+			pm.rasterizationSamples(state.samples);
+		}
+
+		static vk::Pipeline build(const State& state, const Program& program, const VertexFormat& layout, const PipelineKey& key) {
+			vk::PipelineMaker pm(*state.device);
+			configure(pm, state, program, layout, key);
+			return pm.create(state.pipelineLayout, state.renderPass);
+		}
+
+		using Libraries = std::array<VkPipeline, 4>;
+
+		// The four libraries of key, built where missing. Each is keyed by the fields that
+		// reach its part, the rest left at their defaults.
+		static Libraries linkLibraries(State& state, const Program& program, const VertexFormat& layout, const PipelineKey& key) {
+			const VkGraphicsPipelineLibraryFlagsEXT parts[] = {
+				VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+				VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+				VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+				VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT
+			};
+			Libraries libraries = {};
+			for (uint32_t i = 0; i < 4; i++) {
+				PipelineKey part;
+				switch (i)
+				{
+				case 0:
+					part.layout = key.layout;
+					break;
+				case 1:
+					part.program = key.program;
+					part.features = key.features;
+					part.polygonMode = key.polygonMode;
+					part.cullMode = key.cullMode;
+					break;
+				case 2:
+					part.program = key.program;
+					part.features = key.features;
+					part.depthTest = key.depthTest;
+					part.depthWrite = key.depthWrite;
+					break;
+				default:
+					part.blend = key.blend;
+					break;
+				}
+
+				Library* library = nullptr;
+				{
+					std::lock_guard<std::mutex> guard(state.librariesLock);
+					auto& slot = state.libraries[(uint64_t(i) << 32) | part.pack()];
+					if (!slot) {
+						slot = std::make_unique<Library>();
+					}
+					library = slot.get();
+				}
+				std::call_once(library->once, [&] {
+					vk::PipelineMaker pm(*state.device);
+					configure(pm, state, program, layout, key);
+					library->pipeline = pm.createLibrary(parts[i], state.pipelineLayout, state.renderPass);
+				});
+				libraries[i] = library->pipeline->get();
+			}
+			return libraries;
+		}
+
+		static vk::Pipeline link(const State& state, const Libraries& libraries, bool optimize) {
+			vk::PipelineMaker pm(*state.device);
+			pm.defaultDynamic();
+			return pm.link(libraries, state.pipelineLayout, state.renderPass, optimize);
+		}
+	};
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <core/arena.h>
+#include <chrono>
+#include <utility>
+
+namespace vg
+{
+	// Draw sort key, most significant field first:
+	//   pass(4) | pipeline(12) | material(12) | geometry arena(12) | depth(24)
+	// Sorting ascending groups draws by pass, then minimizes pipeline, descriptor and
+	// vertex buffer changes, and finally orders draws front-to-back inside a group.
+	struct SortKey
+	{
+		static constexpr uint64_t pack(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t arena, uint32_t depth) {
+			return (uint64_t(pass & 0xf) << 60) |
+				(uint64_t(pipeline & 0xfff) << 48) |
+				(uint64_t(material & 0xfff) << 36) |
+				(uint64_t(arena & 0xfff) << 24) |
+				uint64_t(depth & 0xffffff);
+		}
+
+		static constexpr uint32_t pass(uint64_t key) { return uint32_t(key >> 60) & 0xf; }
+		static constexpr uint32_t pipeline(uint64_t key) { return uint32_t(key >> 48) & 0xfff; }
+		static constexpr uint32_t material(uint64_t key) { return uint32_t(key >> 36) & 0xfff; }
+		static constexpr uint32_t arena(uint64_t key) { return uint32_t(key >> 24) & 0xfff; }
+
+		// The bit pattern of a non-negative float grows with its value, so the top 24 bits
+		// are a monotonic depth bucket without knowing the near/far planes.
+		static uint32_t depthBucket(float viewDepth) {
+			if (!(viewDepth > 0.0f)) return 0;
+			uint32_t bits;
+			std::memcpy(&bits, &viewDepth, sizeof(bits));
+			return bits >> 8;
+		}
+	};
+
+	struct SortEntry
+	{
+		uint64_t key;
+		uint32_t index;
+	};
+
+	// LSD radix sort over 8-bit digits. Digits that are identical for every key are
+	// skipped. Returns whichever of the two buffers holds the sorted result.
+	inline SortEntry* radixSort(SortEntry* data, SortEntry* scratch, size_t count, uint32_t* passes = nullptr)
+	{
+		uint32_t histogram[8][256] = {};
+		for (size_t i = 0; i < count; i++) {
+			uint64_t key = data[i].key;
+			for (uint32_t d = 0; d < 8; d++) {
+				histogram[d][(key >> (d * 8)) & 0xff]++;
+			}
+		}
+
+		uint32_t executed = 0;
+		SortEntry* src = data;
+		SortEntry* dst = scratch;
+		for (uint32_t d = 0; d < 8; d++) {
+			uint32_t* h = histogram[d];
+			if (count == 0 || h[(src[0].key >> (d * 8)) & 0xff] == count) {
+				continue;
+			}
+
+			uint32_t offset = 0;
+			for (uint32_t b = 0; b < 256; b++) {
+				uint32_t c = h[b];
+				h[b] = offset;
+				offset += c;
+			}
+
+			for (size_t i = 0; i < count; i++) {
+				dst[h[(src[i].key >> (d * 8)) & 0xff]++] = src[i];
+			}
+			std::swap(src, dst);
+			executed++;
+		}
+
+		if (passes) *passes = executed;
+		return src;
+	}
+
+	struct RenderQueueStats
+	{
+		uint32_t draws = 0;
+		uint32_t sortPasses = 0;
+		float sortMicroseconds = 0.0f;
+	};
+
+	// Per-frame list of draws living in the frame arena. T must be trivially copyable.
+	template<typename T> class RenderQueue
+	{
+		SortEntry* entries = nullptr;
+		SortEntry* scratch = nullptr;
+		SortEntry* sorted = nullptr;
+		T* items = nullptr;
+		size_t count = 0;
+		size_t capacity = 0;
+	public:
+		RenderQueue(FrameArena& arena, size_t capacity) : capacity(capacity) {
+			entries = arena.alloc<SortEntry>(capacity);
+			scratch = arena.alloc<SortEntry>(capacity);
+			items = arena.alloc<T>(capacity);
+			sorted = entries;
+		}
+
+		void push(uint64_t key, const T& item) {
+			assert(count < capacity);
+			entries[count] = { key, static_cast<uint32_t>(count) };
+			items[count] = item;
+			count++;
+		}
+
+		void sort(RenderQueueStats& stats) {
+			auto start = std::chrono::high_resolution_clock::now();
+			sorted = radixSort(entries, scratch, count, &stats.sortPasses);
+			auto elapsed = std::chrono::high_resolution_clock::now() - start;
+			stats.sortMicroseconds = std::chrono::duration<float, std::micro>(elapsed).count();
+			stats.draws = static_cast<uint32_t>(count);
+		}
+
+		template<typename F> void each(F&& callback) const {
+			for (size_t i = 0; i < count; i++) {
+				callback(sorted[i].key, items[sorted[i].index]);
+			}
+		}
+
+		size_t size() const { return count; }
+	};
+}
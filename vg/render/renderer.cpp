@@ -1,14 +1,21 @@
 #include "renderer.h"
 
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #include "context.h"
+#include <core/hash.h>
 #include <core/log.h>
+#include <core/mpscQueue.h>
+#include <core/snapshot.h>
 #include <glm/ext.hpp>
 
 #include "state/renderState.h"
 
 #include "geometryBuffer.h"
+#include "textureManager.h"
 
 namespace vg
 {
@@ -25,6 +32,10 @@ namespace vg
 
 		vk::DescriptorSet set;
 
+		// Bumped when the matrices change; the buffer is only uploaded for new versions.
+		uint64_t version = 0;
+		uint64_t uploadedVersion = ~0ull;
+
 		CameraMatrix() {}
 
 		CameraMatrix(const Context& ctx) {
@@ -42,16 +53,75 @@ namespace vg
 		}
 
 		void update(glm::mat4 p, glm::mat4 v) {
-			data.projection = p;
-			data.projection[1][1] *= -1;
-			data.view = v;
+			p[1][1] *= -1;
+			if (p != data.projection || v != data.view) {
+				data.projection = p;
+				data.view = v;
+				version++;
+			}
 		}
 
 		void update() {
-			buffer->uploadLocal(&data);
+			if (uploadedVersion != version) {
+				buffer->uploadLocal(&data);
+				uploadedVersion = version;
+			}
+		}
+	};
+
+
+	// Secondary command buffer that is re-recorded only when the key of its inputs changes.
+	struct CachedCommands
+	{
+		vk::CommandBuffer cmd;
+		uint64_t key = 0;
+		uint64_t version = 0;
+
+		template<typename F> bool record(const Context& ctx, uint64_t inputs, F&& callback) {
+			if (version != 0 && key == inputs) {
+				return false;
+			}
+			key = inputs;
+			version++;
+
+			auto extent = ctx->getExtent();
+			// executed from every swapchain image's primary, which is only valid with simultaneous use
+			cmd->beginSecondary(ctx->getRenderPass(), 0, VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT);
+			cmd->viewport(0, 0, extent.width, extent.height);
+			cmd->scissor(0, 0, extent.width, extent.height);
+			callback(cmd);
+			cmd->end();
+			return true;
 		}
 	};
 
+	// Scene change posted by any thread and applied by the render thread between frames.
+	struct SceneCommand
+	{
+		enum class Type
+		{
+			None,
+			AddGeometry,
+			AddTexture,
+			AddVirtualTexture,
+			BindVirtualTexture,
+			Camera,
+			Select,
+			Resize
+		}type = Type::None;
+
+		uint32_t id = 0;
+		GeometryBufferInfo info;
+		std::vector<uint8_t> vertices;
+		std::vector<uint8_t> indices;
+		// triangle ranges of the parts when the geometry is a static batch
+		std::vector<StaticBatchPart> parts;
+		TextureData texture;
+		std::unique_ptr<TileSource> source;
+		uint32_t virtualTexture = 0;
+		Camera camera = Camera::Perspactive(45.0f);
+		glm::uvec2 point = {};
+	};
 
 	class RendererImpl
 	{
@@ -60,6 +130,16 @@ namespace vg
 		vk::Fence drawFence;
 		vk::Semaphore acquireSemaphore;
 		vk::Semaphore drawSemaphore;
+		uint64_t inFlightFrame = 0;
+
+		// image whose timestamps the frame in flight writes, ~0u when it is not timed
+		uint32_t timedImage = ~0u;
+
+		// Window resize events are coalesced: the swapchain is recreated once the events
+		// have stopped for resizeDebounce, or earlier if presentation reports out of date.
+		std::atomic<bool> resizePending{ false };
+		std::chrono::steady_clock::time_point resizeRequested;
+		std::chrono::milliseconds resizeDebounce = std::chrono::milliseconds(50);
 
 		struct
 		{
@@ -70,25 +150,268 @@ namespace vg
 		}stat;
 		
 		GeometryManager geometries;
-	public:
+		// parts of static batches by geometry id, to map picks back to them
+		std::unordered_map<uint32_t, std::vector<StaticBatchPart>> batches;
+		TextureManager textures;
+		VirtualTextureManager virtualTextures;
+
+		// Grid, geometry and ImGui are recorded into their own secondaries, which the
+		// per-image primaries execute. Unchanged frames resubmit the previous recording.
+		struct
+		{
+			CachedCommands grid;
+			CachedCommands geometry;
+			CachedCommands imgui;
+		}layers;
+		std::vector<uint64_t> primaryKeys;
+
 		CameraMatrix matrix;
+		Camera camera = Camera::Perspactive(45.0f);
+		bool hasCamera = false;
 
 		bool prepared = false;
+
+		RenderStats stats;
+
+		// Everything above is owned by the render thread once it runs. Other threads talk to
+		// it through the command queue and the snapshot buffers only.
+		MpscQueue<SceneCommand> commands;
+		SnapshotBuffer<ImguiDrawSnapshot> uiFrames;
+		SnapshotBuffer<RenderStats> publishedStats;
+
+		std::thread thread;
+		std::atomic<bool> running{ false };
+		std::atomic<bool> woken{ false };
+		std::atomic<bool> sleeping{ false };
+		std::mutex wakeMutex;
+		std::condition_variable wakeCondition;
+
+		// size of the render target, for the setup record of a trace
+		std::atomic<uint32_t> width{ 0 };
+		std::atomic<uint32_t> height{ 0 };
+
+		// finish() tickets: requested by any thread, completed by the render thread after
+		// the frame that follows the commands posted before them.
+		std::atomic<uint64_t> finishRequested{ 0 };
+		uint64_t finishCompleted = 0;
+		std::mutex finishMutex;
+		std::condition_variable finishCondition;
+
+		// mesh imports on the job workers, which post their geometry when done
+		JobGroup imports;
 	public:
-		RendererImpl(const void* windowHandle) {
-			ctx = createContext(windowHandle);
+		RendererImpl(Context context) {
+			ctx = std::move(context);
+			storeExtent();
 			drawFence = ctx->getDevice()->createFence();
 			acquireSemaphore = ctx->getDevice()->createSemaphore();
 			drawSemaphore = ctx->getDevice()->createSemaphore();
 			
 			matrix = CameraMatrix(ctx);
+			virtualTextures = VirtualTextureManager(ctx, matrix.setLayout);
 
 			stat.imgui = ImguiRenderState(ctx);
 			stat.grid = GridRenderState(ctx,matrix.setLayout);
-			stat.geometry = GeometryRenderState(ctx, matrix.setLayout);
+			geometries = GeometryManager(ctx);
+			stat.geometry = GeometryRenderState(ctx, matrix.setLayout, virtualTextures.getSetLayout(), geometries.getArena().getSetLayout());
 			stat.pick = PickRenderState(ctx, matrix.setLayout);
 
+			layers.grid.cmd = ctx->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+			layers.geometry.cmd = ctx->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+			layers.imgui.cmd = ctx->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
 			prepared = true;
+
+			// tasks that need the Vulkan context run on the render thread
+			ctx->getJobs().setPinnedWakeup([this] { wake(); });
+
+			running = true;
+			thread = std::thread([this] { run(); });
+		}
+
+		~RendererImpl() {
+			waitImports();
+			stop();
+		}
+
+		void stop() {
+			if (running.exchange(false)) {
+				wake();
+				thread.join();
+
+				// jobs still in flight would wake a thread that is gone through members that
+				// are destroyed before the managers waiting on them; the tile loads pinned
+				// results pointing at virtualTextures, so they are placed while it exists
+				ctx->getJobs().setPinnedWakeup(nullptr);
+				virtualTextures.waitLoads();
+				ctx->getJobs().runPinned();
+			}
+			completeFinish(~0ull);
+		}
+
+		// Called from any thread.
+		void post(SceneCommand&& command) {
+			if (command.type == SceneCommand::Type::Resize) {
+				// visible to needsRedraw() before the render thread gets to the command
+				resizePending = true;
+			}
+			commands.push(std::move(command));
+			wake();
+		}
+
+		// Called from the UI thread after ImGui::Render().
+		void publishFrame(TraceWriter* trace) {
+			auto& frame = uiFrames.write();
+			frame.capture(ImGui::GetDrawData());
+			if (trace) {
+				TraceBuffer payload;
+				frame.save(payload);
+				trace->write(TraceCall::Draw, payload);
+			}
+			uiFrames.publish();
+			wake();
+		}
+
+		// Recorded draw data in place of ImGui's.
+		bool publishFrame(TraceCursor& in) {
+			if (!uiFrames.write().load(in)) {
+				return false;
+			}
+			uiFrames.publish();
+			wake();
+			return true;
+		}
+
+		VkExtent2D getExtent() const {
+			return { width, height };
+		}
+
+		bool needsRedraw() const {
+			return resizePending;
+		}
+
+		// Called from any thread; task runs on a job worker.
+		void import(std::function<void()> task) {
+			ctx->getJobs().run(imports, std::move(task));
+		}
+
+		void waitImports() {
+			ctx->getJobs().wait(imports);
+		}
+
+		void finish() {
+			waitImports();
+			uint64_t ticket = ++finishRequested;
+			wake();
+			std::unique_lock<std::mutex> lock(finishMutex);
+			finishCondition.wait(lock, [&] { return finishCompleted >= ticket; });
+		}
+
+		RenderStats getStats() {
+			publishedStats.acquire();
+			return publishedStats.read();
+		}
+	private:
+		void wake() {
+			woken = true;
+			if (sleeping) {
+				std::lock_guard<std::mutex> lock(wakeMutex);
+				wakeCondition.notify_one();
+			}
+		}
+
+		void wait() {
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			sleeping = true;
+			auto ready = [this] { return woken.exchange(false) || !running; };
+			if (resizePending) {
+				wakeCondition.wait_for(lock, resizeDebounce, ready);
+			}
+			else {
+				wakeCondition.wait(lock, ready);
+			}
+			sleeping = false;
+		}
+
+		void run() {
+			while (running) {
+				// read before the commands, so every command posted ahead of these tickets is applied below
+				uint64_t finishing = finishRequested;
+				bool changed = ctx->getJobs().runPinned() > 0;
+				changed |= applyCommands();
+				changed |= applyPendingResize();
+				changed |= uiFrames.acquire();
+				// feedback in flight is read back by the next frame
+				changed |= virtualTextures.needsFrame();
+				changed |= finishing != finishCompleted;
+				if (!changed) {
+					wait();
+					continue;
+				}
+				if (prepared) {
+					draw();
+				}
+				completeFinish(finishing);
+			}
+			ctx->getDevice()->waitIdle();
+		}
+
+		void completeFinish(uint64_t ticket) {
+			std::lock_guard<std::mutex> lock(finishMutex);
+			if (ticket > finishCompleted) {
+				finishCompleted = ticket;
+				finishCondition.notify_all();
+			}
+		}
+
+		bool applyCommands() {
+			bool applied = false;
+			SceneCommand command;
+			while (commands.pop(command)) {
+				switch (command.type)
+				{
+				case SceneCommand::Type::AddGeometry:
+					command.info.vertex = command.vertices.data();
+					command.info.index = command.indices.data();
+					ctx->invalidateFrame();
+					// a rejected duplicate id keeps the part table of the geometry it collided with
+					if (geometries.addGeometry(ctx, command.id, command.info) && !command.parts.empty()) {
+						batches[command.id] = std::move(command.parts);
+					}
+					break;
+				case SceneCommand::Type::AddTexture:
+					textures.addTexture(ctx, command.id, command.texture);
+					break;
+				case SceneCommand::Type::AddVirtualTexture:
+					ctx->invalidateFrame();
+					virtualTextures.addTexture(command.id, std::move(command.source));
+					break;
+				case SceneCommand::Type::BindVirtualTexture:
+					bindVirtualTexture(command.id, command.virtualTexture);
+					break;
+				case SceneCommand::Type::Camera:
+					camera = command.camera;
+					hasCamera = true;
+					updateCamera();
+					break;
+				case SceneCommand::Type::Select:
+					select(command.point);
+					break;
+				case SceneCommand::Type::Resize:
+					requestResize();
+					break;
+				default:
+					break;
+				}
+				applied = true;
+			}
+			return applied;
+		}
+
+		void updateCamera() {
+			if (hasCamera) {
+				matrix.update(camera.getProjectionMatrix(getAspect()), camera.getViewMatrix());
+			}
 		}
 
 		void resize(bool force = false) {
@@ -96,51 +419,169 @@ namespace vg
 				return;
 			}
 			prepared = false;
+			resizePending = false;
+			ctx->invalidateFrame();
 
-			ctx->getDevice()->waitIdle();
-
+			// old framebuffers and attachments go through the device's deletion queue,
+			// so the frame still in flight keeps them alive without a device-wide idle
 			if (ctx->resize()) {
 				prepared = true;
+				storeExtent();
+				updateCamera();
 			}
 		}
 
+		void storeExtent() {
+			auto extent = ctx->getExtent();
+			width = extent.width;
+			height = extent.height;
+		}
+
+		void requestResize() {
+			resizePending = true;
+			resizeRequested = std::chrono::steady_clock::now();
+		}
+
+		bool applyPendingResize() {
+			if (resizePending && std::chrono::steady_clock::now() - resizeRequested >= resizeDebounce) {
+				resize(true);
+				return true;
+			}
+			return false;
+		}
+
+		void bindVirtualTexture(uint32_t geometry, uint32_t texture) {
+			int32_t slot = virtualTextures.slot(texture);
+			if (slot < 0) {
+				log_error("Virtual texture id is not exist : ", texture);
+				return;
+			}
+			ctx->invalidateFrame();
+			geometries.setVirtualTexture(geometry, slot);
+		}
+
 		void select(glm::uvec2 point) {
+			ctx->invalidateFrame();
+			ctx->getUploader().flush();
 			auto sel = stat.pick.select(ctx, matrix.set, geometries,point);
+			// highlighting works on what was drawn, the stats name the part of a batch
 			stat.geometry.setSelect(sel);
+
+			stats.selectedObject = sel.ObjectID;
+			stats.selectedPrimitive = sel.PrimID;
+			auto batch = sel.ObjectID ? batches.find(sel.ObjectID - 1) : batches.end();
+			if (batch != batches.end() && sel.PrimID) {
+				auto part = findBatchPart(batch->second, sel.PrimID - 1);
+				stats.selectedObject = part ? part->id + 1 : 0;
+				stats.selectedPrimitive = part ? sel.PrimID - part->firstTriangle : 0;
+			}
 		}
 
 		void buildCommandBuffer(uint32_t index)
 		{
 			matrix.update();
 
-			auto& cmd = ctx->getCommandBuffer(index);
-			cmd->begin();
-			auto extent = ctx->getExtent();
+			const auto& ui = uiFrames.read();
+			uint64_t resources = ctx->getResourceVersion();
+			uint64_t imguiVersion = stat.imgui.prepare(ctx, ui);
+			uint32_t recorded = 0;
+
+			recorded += layers.grid.record(ctx, resources, [&](vk::CommandBuffer& cmd) {
+				stat.grid.draw(ctx, cmd, matrix.set);
+			});
+
+			uint64_t geometryKey = hashCombine(resources, geometries.getVersion());
+			geometryKey = hashCombine(geometryKey, matrix.version);
+			geometryKey = hashCombine(geometryKey, stat.geometry.getSelectVersion());
+			geometryKey = hashCombine(geometryKey, stat.geometry.getPipelineVersion());
+			recorded += layers.geometry.record(ctx, geometryKey, [&](vk::CommandBuffer& cmd) {
+				stat.geometry.draw(ctx, cmd, matrix.set, geometries, virtualTextures, matrix.data.view);
+			});
+
+			recorded += layers.imgui.record(ctx, hashCombine(resources, imguiVersion), [&](vk::CommandBuffer& cmd) {
+				stat.imgui.draw(ctx, cmd, ui);
+			});
+			uint64_t primaryKey = hashCombine(resources, layers.grid.version);
+			primaryKey = hashCombine(primaryKey, layers.geometry.version);
+			primaryKey = hashCombine(primaryKey, layers.imgui.version);
+			if (primaryKeys.size() <= index) {
+				primaryKeys.resize(index + 1, 0);
+			}
 
-			VkRect2D area = { {},extent };
-			std::array<VkClearValue, 3> clearValue = { VkClearColorValue{0.0f},VkClearColorValue{0.0f},{1.0f,0} };
-			cmd->beginRenderPass(ctx->getRenderPass(),ctx->getFrameBuffer(index), area, clearValue);
+			if (primaryKeys[index] != primaryKey) {
+				primaryKeys[index] = primaryKey;
+				recorded++;
 
-			cmd->viewport(0, 0, extent.width, extent.height);
-			cmd->scissor(0, 0, extent.width, extent.height);
+				auto& cmd = ctx->getCommandBuffer(index);
+				cmd->begin(0);
+				auto extent = ctx->getExtent();
 
-			stat.grid.draw(ctx, cmd, matrix.set);
+				// each image owns its query pair, so a resubmitted primary resets only its own
+				auto& timestamps = ctx->getTimestamps();
+				if (isTimed(index)) {
+					cmd->resetQueryPool(timestamps, index * 2, 2);
+					cmd->writeTimestamp(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamps, index * 2);
+				}
 
-			stat.geometry.draw(ctx, cmd, matrix.set,geometries);
+				VkRect2D area = { {},extent };
+				std::array<VkClearValue, 3> clearValue = { VkClearColorValue{0.0f},VkClearColorValue{0.0f},{1.0f,0} };
+				cmd->beginRenderPass(ctx->getRenderPass(), ctx->getFrameBuffer(index), area, clearValue, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-			cmd->viewport(0, 0, extent.width, extent.height);
-			stat.imgui.draw(ctx, cmd);
-			
+				std::array<VkCommandBuffer, 3> secondaries = { layers.grid.cmd->get(), layers.geometry.cmd->get(), layers.imgui.cmd->get() };
+				cmd->executeCommands(secondaries);
 
-			cmd->endRenderPass();
-			cmd->end();
+				cmd->endRenderPass();
+				if (isTimed(index)) {
+					cmd->writeTimestamp(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamps, index * 2 + 1);
+				}
+				cmd->end();
+			}
+
+			CommandStats counters = layers.grid.cmd->stats();
+			counters += layers.geometry.cmd->stats();
+			counters += layers.imgui.cmd->stats();
+			stats.draws = counters.draws;
+			stats.triangles = counters.triangles;
+			stats.instances = counters.instances;
+			stats.pipelineBinds = counters.pipelineBinds;
+			stats.descriptorBinds = counters.descriptorBinds;
+			stats.vertexBufferBinds = counters.vertexBufferBinds;
+			stats.indexBufferBinds = counters.indexBufferBinds;
+			stats.pushConstantBytes = counters.pushConstantBytes;
+			stats.skipped = counters.skipped;
+			stats.recordedCommandBuffers = recorded;
+
+			auto& streaming = virtualTextures.getStats();
+			stats.residentPages = streaming.residentPages;
+			stats.pageCount = streaming.pages;
+			stats.pageRequests = streaming.requests;
+			stats.tileLoads = streaming.loading;
+			stats.tileUploads = streaming.uploads;
+
+			auto& queue = stat.geometry.getStats();
+			stats.sortedDraws = queue.draws;
+			stats.sortPasses = queue.sortPasses;
+			stats.sortMicroseconds = queue.sortMicroseconds;
+			stats.pendingPipelines = stat.geometry.getPendingPipelines();
 
 			//stat.pick.select(ctx, matrix.set, geometries, glm::uvec2());
 		}
 
 		void draw()
 		{
+			auto waitStart = std::chrono::high_resolution_clock::now();
 			ctx->getDevice()->waitForFences(drawFence->get());
+			auto frameStart = std::chrono::high_resolution_clock::now();
+			stats.fenceMilliseconds = std::chrono::duration<float, std::milli>(frameStart - waitStart).count();
+			ctx->getDevice()->completeFrame(inFlightFrame);
+			readGpuTime();
+			ctx->beginFrame();
+			virtualTextures.update(ctx);
+
+			if (ctx->isHeadless()) {
+				drawOffscreen(frameStart);
+				return;
+			}
 
 			uint32_t imageIndex = 0;
 			VkResult result;
@@ -163,7 +604,16 @@ namespace vg
 			
 			auto& cmd = ctx->getCommandBuffer(imageIndex);
 
+			// uploads go first on the same queue, so this frame already sees them
+			ctx->getUploader().flush();
+
+			uint64_t feedbackKey = hashCombine(ctx->getResourceVersion(), geometries.getVersion());
+			feedbackKey = hashCombine(feedbackKey, matrix.version);
+			virtualTextures.submitFeedback(ctx, matrix.set, geometries, feedbackKey);
+
 			ctx->getGraphicsQueue()->submit(cmd->get(), acquireSemaphore->get(), drawSemaphore->get(), drawFence->get(),VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+			inFlightFrame = ctx->getDevice()->submitFrame();
+			timedImage = isTimed(imageIndex) ? imageIndex : ~0u;
 
 			result = ctx->getGraphicsQueue()->present(ctx->getSwapchain()->get(), &imageIndex, drawSemaphore->get());
 			if (result == VK_ERROR_OUT_OF_DATE_KHR) {
@@ -176,6 +626,50 @@ namespace vg
 			else {
 				VK_CHECK_RESULT(result);
 			}
+
+			endFrame(frameStart);
+		}
+
+		// Same frame without acquire and present: the offscreen images are used in turn.
+		void drawOffscreen(std::chrono::high_resolution_clock::time_point frameStart)
+		{
+			uint32_t imageIndex = static_cast<uint32_t>(inFlightFrame % ctx->getImageCount());
+			buildCommandBuffer(imageIndex);
+
+			auto& cmd = ctx->getCommandBuffer(imageIndex);
+			ctx->getUploader().flush();
+
+			uint64_t feedbackKey = hashCombine(ctx->getResourceVersion(), geometries.getVersion());
+			feedbackKey = hashCombine(feedbackKey, matrix.version);
+			virtualTextures.submitFeedback(ctx, matrix.set, geometries, feedbackKey);
+
+			ctx->getGraphicsQueue()->submit(cmd->get(), nullptr, nullptr, drawFence->get());
+			inFlightFrame = ctx->getDevice()->submitFrame();
+			timedImage = isTimed(imageIndex) ? imageIndex : ~0u;
+
+			endFrame(frameStart);
+		}
+
+		void endFrame(std::chrono::high_resolution_clock::time_point frameStart)
+		{
+			ctx->endFrame();
+			stats.frameMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count();
+			publishedStats.write() = stats;
+			publishedStats.publish();
+		}
+
+		bool isTimed(uint32_t imageIndex)
+		{
+			return ctx->getTimestamps() && imageIndex < Context_T::maxTimedImages;
+		}
+
+		// The draw fence has been waited on, so the previous frame's timestamps are final.
+		void readGpuTime()
+		{
+			uint64_t ticks[2];
+			if (timedImage != ~0u && ctx->getTimestamps()->results(timedImage * 2, 2, ticks)) {
+				stats.gpuMilliseconds = static_cast<float>(double(ticks[1] - ticks[0]) * ctx->getTimestampPeriod() * 1e-6);
+			}
 		}
 
 		float getAspect()
@@ -189,41 +683,288 @@ namespace vg
 			}
 		}
 
-		void addGeometry(uint32_t id, const GeometryBufferInfo& info)
-		{
-			geometries.addGeometry(ctx, id, info);
-		}
 	};
 
+	Renderer::~Renderer()
+	{
+		shutdown();
+	}
+
 	void Renderer::setup(const void* windowHandle)
 	{
-		impl = new RendererImpl(windowHandle);
+		impl = new RendererImpl(createContext(windowHandle));
+		recordSetup();
+	}
+
+	void Renderer::setupHeadless(uint32_t width, uint32_t height)
+	{
+		impl = new RendererImpl(createHeadlessContext(width, height));
+		recordSetup();
+	}
+
+	void Renderer::shutdown()
+	{
+		if (impl) {
+			impl->waitImports();
+		}
+		if (impl && trace) {
+			trace->write(TraceCall::Shutdown);
+			trace->flush();
+		}
+		delete impl;
+		impl = nullptr;
 	}
 
 	void Renderer::draw()
 	{
-		if (impl->prepared) {
-			impl->draw();
+		impl->publishFrame(trace.get());
+	}
+
+	bool Renderer::needsRedraw() const
+	{
+		return impl->needsRedraw();
+	}
+
+	void Renderer::finish()
+	{
+		if (impl) {
+			impl->finish();
 		}
 	}
 
 	void Renderer::resize()
 	{
-		impl->resize(true);
+		if (trace) {
+			trace->write(TraceCall::Resize);
+		}
+		SceneCommand command;
+		command.type = SceneCommand::Type::Resize;
+		impl->post(std::move(command));
 	}
 
 	void Renderer::bindCamera(const Camera& camera)
 	{
-		impl->matrix.update(camera.getProjectionMatrix(impl->getAspect()), camera.getViewMatrix());
+		if (trace) {
+			trace->write(TraceCall::BindCamera, &camera, sizeof(camera));
+		}
+		SceneCommand command;
+		command.type = SceneCommand::Type::Camera;
+		command.camera = camera;
+		impl->post(std::move(command));
 	}
 
 	void Renderer::addGeometry(uint32_t id, const GeometryBufferInfo& info)
 	{
-		impl->addGeometry(id, info);
+		postGeometry(id, info, trace.get());
+	}
+
+	void Renderer::importGeometry(uint32_t id, const GeometryBufferInfo& info, const MeshImportOptions& options)
+	{
+		auto vertex = static_cast<const uint8_t*>(info.vertex);
+		auto index = static_cast<const uint8_t*>(info.index);
+		std::vector<uint8_t> vertices(vertex, vertex + info.vertexSize);
+		std::vector<uint8_t> indices(index, index + info.indexSize);
+		impl->import([this, id, info, options, vertices = std::move(vertices), indices = std::move(indices), writer = trace]() mutable {
+			auto source = info;
+			source.vertex = vertices.data();
+			source.index = indices.data();
+			auto mesh = importMesh(source, options);
+			if (options.optimize) {
+				log_debug("geometry ", id, " ACMR ", mesh.stats.acmrBefore, " -> ", mesh.stats.acmrAfter, ", ", mesh.stats.vertexBytes, " vertex bytes");
+			}
+			// recorded processed, so a replay does not depend on the import options
+			postGeometry(id, mesh.info(), writer.get());
+		});
+	}
+
+	void Renderer::addStaticBatch(uint32_t id, const StaticBatch& batch)
+	{
+		postGeometry(id, batch.mesh.info(), trace.get(), batch.parts);
+	}
+
+	void Renderer::postGeometry(uint32_t id, const GeometryBufferInfo& info, TraceWriter* writer, const std::vector<StaticBatchPart>& parts)
+	{
+		// the caller's buffers may be gone by the time the render thread uploads them
+		SceneCommand command;
+		command.type = SceneCommand::Type::AddGeometry;
+		command.id = id;
+		command.info = info;
+		command.vertices.assign(static_cast<const uint8_t*>(info.vertex), static_cast<const uint8_t*>(info.vertex) + info.vertexSize);
+		command.indices.assign(static_cast<const uint8_t*>(info.index), static_cast<const uint8_t*>(info.index) + info.indexSize);
+		command.parts = parts;
+		if (writer) {
+			TraceBuffer payload;
+			payload.put(id);
+			payload.put(info.format);
+			payload.put(info.indexType);
+			payload.put(info.hasBounds);
+			payload.put(info.bounds);
+			payload.array(command.vertices);
+			payload.array(command.indices);
+			payload.array(command.parts);
+			writer->write(TraceCall::AddGeometry, payload);
+		}
+		impl->post(std::move(command));
+	}
+
+	void Renderer::addTexture(uint32_t id, TextureData texture)
+	{
+		if (trace) {
+			TraceBuffer payload;
+			payload.put(id);
+			payload.put(texture.format);
+			payload.put(texture.width);
+			payload.put(texture.height);
+			payload.array(texture.levels);
+			payload.array(texture.data);
+			trace->write(TraceCall::AddTexture, payload);
+		}
+		SceneCommand command;
+		command.type = SceneCommand::Type::AddTexture;
+		command.id = id;
+		command.texture = std::move(texture);
+		impl->post(std::move(command));
+	}
+
+	void Renderer::addVirtualTexture(uint32_t id, std::unique_ptr<TileSource> source)
+	{
+		SceneCommand command;
+		command.type = SceneCommand::Type::AddVirtualTexture;
+		command.id = id;
+		command.source = std::move(source);
+		impl->post(std::move(command));
+	}
+
+	void Renderer::bindVirtualTexture(uint32_t id, uint32_t texture)
+	{
+		if (trace) {
+			TraceBuffer payload;
+			payload.put(id);
+			payload.put(texture);
+			trace->write(TraceCall::BindVirtualTexture, payload);
+		}
+		SceneCommand command;
+		command.type = SceneCommand::Type::BindVirtualTexture;
+		command.id = id;
+		command.virtualTexture = texture;
+		impl->post(std::move(command));
+	}
+
+	RenderStats Renderer::getStats() const
+	{
+		return impl->getStats();
 	}
 
 	void Renderer::click(glm::uvec2 point)
 	{
-		impl->select(point);
+		if (trace) {
+			trace->write(TraceCall::Click, &point, sizeof(point));
+		}
+		SceneCommand command;
+		command.type = SceneCommand::Type::Select;
+		command.point = point;
+		impl->post(std::move(command));
+	}
+
+	void Renderer::setTrace(std::shared_ptr<TraceWriter> writer)
+	{
+		trace = std::move(writer);
+		// a trace started after setup still begins with the target size
+		if (impl) {
+			recordSetup();
+		}
+	}
+
+	void Renderer::recordSetup()
+	{
+		if (trace) {
+			auto extent = impl->getExtent();
+			TraceBuffer payload;
+			payload.put(extent.width);
+			payload.put(extent.height);
+			trace->write(TraceCall::Setup, payload);
+		}
+	}
+
+	uint64_t Renderer::replay(TraceReader& reader, TraceTiming timing, const std::function<void(const TraceRecord&)>& other)
+	{
+		auto start = std::chrono::steady_clock::now();
+		uint64_t frames = 0;
+		TraceRecord record;
+		while (reader.next(record)) {
+			if (timing == TraceTiming::Recorded) {
+				std::this_thread::sleep_until(start + std::chrono::nanoseconds(record.time));
+			}
+
+			TraceCursor in(record.payload);
+			SceneCommand command;
+			bool valid = true;
+			switch (record.call)
+			{
+			case TraceCall::Setup:
+			{
+				uint32_t width = 0, height = 0;
+				valid = in.get(width) && in.get(height);
+				if (valid && !impl) {
+					setupHeadless(std::max(width, 1u), std::max(height, 1u));
+				}
+				break;
+			}
+			case TraceCall::Shutdown:
+				// left to the caller, which may still want the stats
+				break;
+			case TraceCall::AddGeometry:
+				// the payload vectors move straight into the command
+				command.type = SceneCommand::Type::AddGeometry;
+				valid = in.get(command.id) && in.get(command.info.format) && in.get(command.info.indexType) &&
+					in.get(command.info.hasBounds) && in.get(command.info.bounds) && in.array(command.vertices) && in.array(command.indices) && in.array(command.parts);
+				command.info.vertexSize = static_cast<uint32_t>(command.vertices.size());
+				command.info.indexSize = static_cast<uint32_t>(command.indices.size());
+				break;
+			case TraceCall::AddTexture:
+				command.type = SceneCommand::Type::AddTexture;
+				valid = in.get(command.id) && in.get(command.texture.format) && in.get(command.texture.width) && in.get(command.texture.height) &&
+					in.array(command.texture.levels) && in.array(command.texture.data);
+				break;
+			case TraceCall::BindVirtualTexture:
+				command.type = SceneCommand::Type::BindVirtualTexture;
+				valid = in.get(command.id) && in.get(command.virtualTexture);
+				break;
+			case TraceCall::BindCamera:
+				command.type = SceneCommand::Type::Camera;
+				valid = in.get(command.camera);
+				break;
+			case TraceCall::Click:
+				command.type = SceneCommand::Type::Select;
+				valid = in.get(command.point);
+				break;
+			case TraceCall::Resize:
+				command.type = SceneCommand::Type::Resize;
+				break;
+			case TraceCall::Draw:
+				if (impl) {
+					valid = impl->publishFrame(in);
+					if (valid && timing == TraceTiming::AsFastAsPossible) {
+						// unconsumed draw data would be dropped, so every recorded frame is drawn
+						impl->finish();
+					}
+					frames += valid;
+				}
+				break;
+			default:
+				if (other) {
+					other(record);
+				}
+				break;
+			}
+
+			if (!valid) {
+				log_warning("skipped a malformed trace record ", static_cast<uint32_t>(record.call));
+			}
+			else if (command.type != SceneCommand::Type::None && impl) {
+				impl->post(std::move(command));
+			}
+		}
+		return frames;
 	}
 }
\ No newline at end of file
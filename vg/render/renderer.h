@@ -2,25 +2,131 @@
 
 #include "geometryInfo.h"
 #include <core/camera.h>
+#include <util/mesh.h>
+#include <util/virtualTexture.h>
+#include <util/trace.h>
+#include <functional>
+#include <memory>
 
 namespace vg
 {
+	// Statistics of the last recorded frame.
+	struct RenderStats
+	{
+		// CPU time of the frame, from after the wait for the previous one to present
+		float frameMilliseconds = 0.0f;
+		// Spent waiting for the GPU to finish the previous frame before this one started.
+		float fenceMilliseconds = 0.0f;
+
+		// Main pass of the latest frame the GPU has finished, usually the one before; stays 0
+		// when the graphics queue has no timestamps.
+		float gpuMilliseconds = 0.0f;
+
+		uint32_t draws = 0;
+		uint64_t triangles = 0;
+		uint32_t instances = 0;
+		uint32_t pipelineBinds = 0;
+		uint32_t descriptorBinds = 0;
+		uint32_t vertexBufferBinds = 0;
+		uint32_t indexBufferBinds = 0;
+		uint32_t pushConstantBytes = 0;
+		uint32_t skipped = 0;
+
+		// Command buffers recorded this frame, 0 when the previous recording was resubmitted.
+		uint32_t recordedCommandBuffers = 0;
+
+		// Virtual texture page cache: pages in use, missing tiles seen by the last feedback,
+		// tiles being read and tiles uploaded this frame.
+		uint32_t residentPages = 0;
+		uint32_t pageCount = 0;
+		uint32_t pageRequests = 0;
+		uint32_t tileLoads = 0;
+		uint32_t tileUploads = 0;
+
+		uint32_t sortedDraws = 0;
+		uint32_t sortPasses = 0;
+		float sortMicroseconds = 0.0f;
+
+		// Pipeline variants still being built; their draws use a fallback meanwhile.
+		uint32_t pendingPipelines = 0;
+
+		// What the last click hit: geometry id + 1 and triangle + 1, 0 for nothing. A click on
+		// a static batch reports the part's id and its own triangle.
+		uint32_t selectedObject = 0;
+		uint32_t selectedPrimitive = 0;
+	};
+
+	// Front end of the render thread. All calls return without waiting for the GPU; scene
+	// changes are queued and applied by the render thread between frames. addGeometry,
+	// importGeometry, addStaticBatch, addTexture, addVirtualTexture, bindVirtualTexture, bindCamera, click and
+	// resize may be called from any thread, draw and getStats from the thread that runs ImGui.
 	class Renderer
 	{
 	public:
+		~Renderer();
+
 		void setup(const void* windowHandle);
 
+		// Renders into offscreen images of the given size instead of a window, for
+		// benchmarks and tests. Nothing is presented and resize does nothing.
+		void setupHeadless(uint32_t width, uint32_t height);
+
+		// Stops the render thread and releases the device; must run before the window is destroyed.
+		void shutdown();
+
+		// Hands the current ImGui draw data to the render thread.
 		void draw();
 
+		// True while the renderer has work that needs further frames, e.g. a debounced resize.
+		bool needsRedraw() const;
+
+		// Blocks until everything posted so far has been applied and a frame has been
+		// submitted with it; getStats then returns that frame's numbers.
+		void finish();
+
 		void resize();
 
 		void addGeometry(uint32_t id, const GeometryBufferInfo& info);
 
+		// Like addGeometry, but welds, cleans up and computes normals and bounds of the
+		// mesh on a job worker first; see importMesh. The data is copied before returning.
+		void importGeometry(uint32_t id, const GeometryBufferInfo& info, const MeshImportOptions& options = {});
+
+		// One batch of buildStaticBatches as geometry id; the ids of its parts are reported by
+		// picking, so they should not collide with other geometries.
+		void addStaticBatch(uint32_t id, const StaticBatch& batch);
+
+		// Takes the texture by value; move in data loaded with loadTexture to avoid a copy.
+		void addTexture(uint32_t id, TextureData texture);
+
+		// Texture streamed tile by tile through a fixed size page cache, for images too large
+		// to keep resident. Width and height must be powers of two of at least 128.
+		void addVirtualTexture(uint32_t id, std::unique_ptr<TileSource> source);
+
+		// Shades geometry id with virtual texture `texture`, using its texcoords.
+		void bindVirtualTexture(uint32_t id, uint32_t texture);
+
 		void bindCamera(const Camera& camera);
 
 		void click(glm::uvec2 point);
+
+		RenderStats getStats() const;
+
+		// Records every public call with its payload into trace from now on; nullptr stops.
+		// Share the writer with Entry::setTrace to have the input events in the same file.
+		// Virtual textures read their own storage and are not recorded.
+		void setTrace(std::shared_ptr<TraceWriter> trace);
+
+		// Re-issues a recorded session on a renderer that is not set up yet; the recorded
+		// setup creates a headless target of the window's size. Records the renderer does
+		// not handle, such as input events, go to `other`. Returns the frames drawn.
+		uint64_t replay(TraceReader& reader, TraceTiming timing, const std::function<void(const TraceRecord&)>& other = nullptr);
 	private:
+		void recordSetup();
+		void postGeometry(uint32_t id, const GeometryBufferInfo& info, TraceWriter* writer, const std::vector<StaticBatchPart>& parts = {});
+
 		class RendererImpl* impl = nullptr;
+		std::shared_ptr<TraceWriter> trace;
 	};
 
 }
\ No newline at end of file
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "../context.h"
+#include "../geometryBuffer.h"
+#include "virtualTextureShader.h"
+#include "geometryShader.h"
+#include <cmath>
+
+namespace vg
+{
+	// Renders the scene at a fraction of the window size and writes, for every pixel, the
+	// virtual texture tile it needs (TileId layout, 0xffffffff where nothing is textured).
+	class FeedbackRenderState
+	{
+		VkFormat colorFormat = VK_FORMAT_R32_UINT;
+
+		vk::PipelineLayout layout;
+		vk::RenderPass renderPass;
+
+		// one pipeline per vertex layout, by GeometryBuffer::layoutKey
+		std::vector<uint32_t> vert;
+		std::vector<uint32_t> frag;
+		std::unordered_map<uint64_t, vk::Pipeline> pipelines;
+
+		vk::Image color;
+		vk::Image depth;
+		vk::FrameBuffer frameBuffer;
+
+		VkExtent2D curExtent = {};
+	public:
+		static constexpr uint32_t scale = 8;
+
+		FeedbackRenderState() {}
+
+		FeedbackRenderState(const Context& ctx, const vk::DescriptorSetLayout& cameraSetLayout, const vk::DescriptorSetLayout& textureSetLayout) {
+			setupRenderPass(ctx);
+			vk::PipelineLayoutMaker plm;
+			plm.setLayout(cameraSetLayout);
+			plm.setLayout(textureSetLayout);
+			plm.pushConstant(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, 48);
+			layout = plm.create(ctx->getDevice());
+			setupShaders();
+		}
+
+		VkExtent2D extent(const Context& ctx) const {
+			auto full = ctx->getExtent();
+			return { std::max(full.width / scale, 1u), std::max(full.height / scale, 1u) };
+		}
+
+		// Records the pass and copies the result tightly packed into readback. textureSet(slot)
+		// returns the descriptor set of a virtual texture slot.
+		template<typename F> void draw(const Context& ctx, vk::CommandBuffer& cmd, vk::DescriptorSet& cameraSet, GeometryManager& geometries, F&& textureSet, vk::Buffer& readback) {
+			auto area = extent(ctx);
+			if (curExtent.width != area.width || curExtent.height != area.height) {
+				resize(ctx, area);
+			}
+
+			std::array<VkClearValue, 2> clearValue = {};
+			clearValue[0].color.uint32[0] = 0xffffffff;
+			clearValue[1].depthStencil = { 1.0f, 0 };
+			cmd->beginRenderPass(renderPass, frameBuffer, { {}, area }, clearValue);
+
+			cmd->viewport(0, 0, area.width, area.height);
+			cmd->scissor(0, 0, area.width, area.height);
+			uint32_t setOffset = { 0 };
+			cmd->bindDescriptorSet(layout, 0, cameraSet->get(), setOffset);
+
+			struct
+			{
+				uint32_t slot;
+				float lodBias;
+				uint32_t padding[2];
+				glm::vec4 positionOffset;
+				glm::vec4 positionScale;
+			}pc = {};
+			// derivatives are scale times larger than in the full size pass
+			pc.lodBias = -std::log2(static_cast<float>(scale));
+
+			// untextured geometry still occludes; the texture set of any slot satisfies the layout
+			VkDescriptorSet bound = textureSet(0)->get();
+			geometries.draw([&](uint32_t id, const GeometryBuffer& g) {
+				if (g.virtualTexture >= 0) {
+					bound = textureSet(g.virtualTexture)->get();
+					pc.slot = static_cast<uint32_t>(g.virtualTexture);
+				}
+				else {
+					pc.slot = 0xffffffff;
+				}
+				pc.positionOffset = g.positionOffset;
+				pc.positionScale = g.positionScale;
+				cmd->bindPipeline(pipelineFor(ctx, g));
+				cmd->bindDescriptorSet(layout, 1, bound);
+				cmd->pushContants(layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, pc);
+
+				g.bind(cmd);
+				cmd->drawIndexd(g.count, 1);
+			});
+
+			cmd->endRenderPass();
+
+			VkImageMemoryBarrier toTransfer = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+			toTransfer.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			toTransfer.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			toTransfer.image = color->get();
+			toTransfer.subresourceRange = color->getSubresourceRange();
+			cmd->pipelineBarrier(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, {}, {}, toTransfer);
+
+			VkBufferImageCopy region = {};
+			region.imageSubresource = color->getSubresourceLayers(0);
+			region.imageExtent = { area.width, area.height, 1 };
+			cmd->copyImageToBuffer(color->get(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback->get(), region);
+
+			VkMemoryBarrier toHost = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+			toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			cmd->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, toHost, {}, {});
+		}
+
+	private:
+		void setupRenderPass(const Context& ctx)
+		{
+			// cleared every time, so the layout it was left in does not matter
+			vk::RenderpassMaker rm;
+			rm.attachmentBegin(colorFormat, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+			rm.attachmentLoadOp(VK_ATTACHMENT_LOAD_OP_CLEAR);
+			rm.attachmentStoreOp(VK_ATTACHMENT_STORE_OP_STORE);
+
+			rm.attachmentBegin(VK_FORMAT_D24_UNORM_S8_UINT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+			rm.attachmentLoadOp(VK_ATTACHMENT_LOAD_OP_CLEAR);
+			rm.attachmentStoreOp(VK_ATTACHMENT_STORE_OP_DONT_CARE);
+
+			rm.subpassBegin();
+			rm.subpassColorAttachment(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 0);
+			rm.subpassDepthStencilAttachment(VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
+			renderPass = rm.create(ctx->getDevice());
+		}
+
+		void setupShaders() {
+			const std::string pushConstant =
+				"layout(push_constant) uniform PushConstant {\n"
+				"	uint slot;\n"
+				"	float lodBias;\n"
+				"	vec4 positionOffset;\n"
+				"	vec4 positionScale;\n"
+				"} pc;\n";
+
+			const std::string vert = std::string(
+				"#version 450\n") +
+				geometryPositionShader +
+				geometryAttributeShader +
+				geometryPositionDecode +
+				geometryNormalDecode +
+				"layout(set=0,binding=0) uniform CameraMatrix {\n"
+				"	mat4 projection;\n"
+				"	mat4 view;\n"
+				"} matrix;\n" +
+				pushConstant +
+
+				"layout(location=0)out vec2 v_texcoord;\n"
+				"void main(){\n"
+				"	gl_Position = matrix.projection * matrix.view * vec4(decodePosition(pc.positionOffset, pc.positionScale),1.0);\n"
+				"	v_texcoord = texcoord;\n"
+				"}";
+
+			const std::string frag = std::string(
+				"#version 450\n") +
+				virtualTextureShader +
+				pushConstant +
+
+				"layout(location=0)in vec2 v_texcoord;\n"
+				"layout(location=0)out uint feedback;\n"
+				"void main(){\n"
+				"	uint level = uint(vtLevel(v_texcoord, pc.lodBias));\n"
+				"	uvec2 tile = vtTile(v_texcoord, level);\n"
+				"	feedback = pc.slot == 0xffffffffu ? 0xffffffffu : (pc.slot << 28) | (level << 24) | (tile.y << 12) | tile.x;\n"
+				"}";
+
+			this->vert = vk::compileGLSL(VK_SHADER_STAGE_VERTEX_BIT, vert);
+			this->frag = vk::compileGLSL(VK_SHADER_STAGE_FRAGMENT_BIT, frag);
+		}
+
+		// Created when a layout is first drawn, which stalls that one frame.
+		const vk::Pipeline& pipelineFor(const Context& ctx, const GeometryBuffer& g) {
+			auto& pipeline = pipelines[g.layoutKey];
+			if (!pipeline) {
+				ctx->restartSteadyState();
+				auto pm = vk::PipelineMaker(ctx->getDevice()).defaultBlend(VK_FALSE).defaultDynamic();
+				pm.shaderSPIRV(VK_SHADER_STAGE_VERTEX_BIT, vert);
+				pm.shaderSPIRV(VK_SHADER_STAGE_FRAGMENT_BIT, frag);
+				g.vertexInput(pm);
+				pm.depthTestEnable(VK_TRUE);
+				pm.depthWriteEnable(VK_TRUE);
+				pipeline = pm.create(layout, renderPass);
+			}
+			return pipeline;
+		}
+
+		void resize(const Context& ctx, const VkExtent2D& extent) {
+			color = ctx->getDevice()->createColorAttachment(extent.width, extent.height, VK_SAMPLE_COUNT_1_BIT, colorFormat);
+			depth = ctx->getDevice()->createDepthStencilAttachment(extent.width, extent.height);
+
+			std::array<VkImageView, 2> attachments = { color->view(),depth->view() };
+			frameBuffer = ctx->getDevice()->createFrameBuffer(renderPass, extent.width, extent.height, attachments);
+
+			curExtent = extent;
+		}
+	};
+
+}
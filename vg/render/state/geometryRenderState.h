@@ -2,6 +2,10 @@
 
 #include "../context.h"
 #include "../geometryBuffer.h"
+#include "../renderQueue.h"
+#include "../virtualTextureManager.h"
+#include "../pipelineVariants.h"
+#include "geometryShader.h"
 
 namespace vg
 {
@@ -9,89 +13,284 @@ namespace vg
 	class GeometryRenderState
 	{
 		vk::PipelineLayout layout;
+		PipelineVariants variants;
 
+		enum Feature : uint32_t
+		{
+			Highlight = 1 << 0,
+			OctahedralNormals = 1 << 1
+		};
+
+		// the pulled programs fetch their vertices from the VertexArena and serve every layout
 		struct
 		{
-			vk::Pipeline line;
-			vk::Pipeline fill;
-		}pipeline;
-		
+			uint32_t flat = 0;
+			uint32_t textured = 0;
+			uint32_t pulledFlat = 0;
+			uint32_t pulledTextured = 0;
+		}program;
+
+		// layout without vertex input and the generic fill variant of pulled geometries
+		uint32_t pulledLayout = 0;
+		uint32_t pulledFallback = PipelineVariants::maxVariants;
+
+		// Pipeline layout of every vertex layout seen so far by GeometryBuffer::layoutKey, with
+		// the generic fill variant its draws use while the one they need is built; only for
+		// geometries that did not fit the arena.
+		struct Layout
+		{
+			uint32_t index = 0;
+			uint32_t fallback = PipelineVariants::maxVariants;
+		};
+		std::unordered_map<uint64_t, Layout> layouts;
 
 		SelectInfo selectInfo = {};
+		uint64_t selectVersion = 0;
+		RenderQueueStats stats;
 	public:
 		GeometryRenderState() {}
 
-		GeometryRenderState(const Context& ctx, vk::DescriptorSetLayout& cameraSetLayout)
+		GeometryRenderState(const Context& ctx, vk::DescriptorSetLayout& cameraSetLayout, const vk::DescriptorSetLayout& textureSetLayout, const vk::DescriptorSetLayout& vertexSetLayout)
 		{
 			auto plm = vk::PipelineLayoutMaker();
 			plm.setLayout(cameraSetLayout);
-			plm.pushConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0, 16);
+			plm.setLayout(textureSetLayout);
+			plm.setLayout(vertexSetLayout);
+			plm.pushConstant(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, 64);
 			layout = plm.create(ctx->getDevice());
 
-			setupPipeline(ctx);
+			variants = PipelineVariants(ctx, layout, ctx->getRenderPass(), ctx->getSampleCount());
+			setupPrograms();
+
+			// the generic fallbacks are queued first so they are the first ones ready, the
+			// pulled one serves most geometries
+			pulledLayout = variants.addLayout(VertexFormat{});
+			auto key = fillKey(pulledLayout);
+			key.program = program.pulledFlat;
+			pulledFallback = variants.variant(ctx, key);
+
+			GeometryBufferInfo info;
+			info.format = vertexFormat(VertexType::PNT);
+			info.hasBounds = true;
+			GeometryBuffer common;
+			common.describe(info);
+			layoutFor(ctx, common);
 		}
 
-		void setupPipeline(const Context& ctx)
+		void setupPrograms()
 		{
-			const std::string vert =
-				"#version 450\n"
-				"layout(location=0)in vec3 position;\n"
-				"layout(location=1)in vec3 normal;\n"
-				"layout(location=2)in vec2 texcoord;\n"
+			const std::string pushConstant =
+				"layout(push_constant) uniform PushConstant {\n"
+				"	uint objectIndex;\n"
+				"	uint primitive;\n"
+				"	uint color;\n"
+				"	uint padding;\n"
+				"	vec4 positionOffset;\n"
+				"	vec4 positionScale;\n"
+				"	uvec4 vertexLayout;\n"
+				"} pc;\n"
+				"layout(constant_id=0) const bool highlight = false;\n"
+				"layout(constant_id=1) const bool octahedralNormals = false;\n";
+
+			// the packed color is unpacked once per vertex instead of once per fragment
+			const std::string body = std::string(
+				geometryPositionDecode) +
+				geometryNormalDecode +
 				"layout(set=0,binding=0) uniform CameraMatrix {\n"
 				"	mat4 projection;\n"
 				"	mat4 view;\n"
-				"} matrix;\n"
-
+				"} matrix;\n" +
+				pushConstant +
 				"layout(location=0)out vec3 v_normal;\n"
+				"layout(location=1)out vec2 v_texcoord;\n"
+				"layout(location=2)flat out vec4 v_color;\n"
+				"void fetchVertex();\n"
+				"void main(){\n"
+				"	fetchVertex();\n"
+				"	gl_Position = matrix.projection * matrix.view * vec4(decodePosition(pc.positionOffset, pc.positionScale),1.0);\n"
+				"	v_normal = decodeNormal(octahedralNormals);\n"
+				"	v_texcoord = texcoord;\n"
+				"	v_color = unpackUnorm4x8(pc.color);\n"
+				"}\n";
+
+			const std::string vert = std::string(
+				"#version 450\n") +
+				geometryPositionShader +
+				geometryAttributeShader +
+				body +
+				"void fetchVertex(){}\n";
+
+			const std::string pulled = std::string(
+				"#version 450\n") +
+				geometryPullShader +
+				body +
+				"void fetchVertex(){ pullVertex(pc.vertexLayout); }\n";
+
+			// only the selected object's variant compiles the primitive comparison in
+			const std::string flat =
+				"#version 450\n" +
+				pushConstant +
+				"layout(location=0)in vec3 v_normal;\n"
+				"layout(location=2)flat in vec4 v_color;\n"
+				"layout(location=0)out vec4 color;\n"
 				"void main(){\n"
-				"	gl_Position = matrix.projection * matrix.view * vec4(position,1.0);\n"
-				"	v_normal = normal;\n"
+				"	color = v_color;\n"
+				"	if(highlight && pc.primitive == gl_PrimitiveID + 1) color = mix(color, vec4(1.0,0.0,0.0,1.0),0.5);\n"
 				"}";
 
-			const std::string frag =
-				"#version 450\n"
+			const std::string textured = std::string(
+				"#version 450\n") +
+				virtualTextureShader +
+				pushConstant +
 				"layout(location=0)in vec3 v_normal;\n"
+				"layout(location=1)in vec2 v_texcoord;\n"
 				"layout(location=0)out vec4 color;\n"
-				"layout(push_constant) uniform PushConstant {\n"
-				"	uint objectIndex;\n"
-				"	uint primitive;\n"
-				"	uint color;\n"
-				"	uint padding;\n"
-				"} pc;\n"
 				"void main(){\n"
-				"	float r = float((0x000000ff & pc.color) >> 0) / 255.0f;\n"
-				"	float g = float((0x0000ff00 & pc.color) >> 8) / 255.0f;\n"
-				"	float b = float((0x00ff0000 & pc.color) >> 16) / 255.0f;\n"
-				"	float a = float((0xff000000 & pc.color) >> 24) / 255.0f;\n"
-				"	color = vec4(r,g,b,a);\n"
-				"	if(pc.primitive == gl_PrimitiveID + 1) color = mix(color, vec4(1.0,0.0,0.0,1.0),0.5);\n"
+				"	float level = vtLevel(v_texcoord, 0.0);\n"
+				"	color = vtSample(v_texcoord, level);\n"
+				"	if(highlight && pc.primitive == gl_PrimitiveID + 1) color = mix(color, vec4(1.0,0.0,0.0,1.0),0.5);\n"
 				"}";
 
-			auto pm = vk::PipelineMaker(ctx->getDevice()).defaultBlend(VK_FALSE).defaultDynamic();
-			pm.shaderGLSL(VK_SHADER_STAGE_VERTEX_BIT, vert);
-			pm.shaderGLSL(VK_SHADER_STAGE_FRAGMENT_BIT, frag);
-			pm.vertexBinding(0,32);
-			pm.vertexAttribute(0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0);
-			pm.vertexAttribute(1, 0, VK_FORMAT_R32G32B32_SFLOAT, 12);
-			pm.vertexAttribute(2, 0, VK_FORMAT_R32G32_SFLOAT, 24);
-			pm.depthTestEnable(VK_TRUE);
-			pm.depthWriteEnable(VK_TRUE);
-			pm.rasterizationSamples(ctx->getSampleCount());
-			pipeline.fill = pm.create(layout, ctx->getRenderPass());
-
-			pm.polygonMode(VK_POLYGON_MODE_LINE);
-			pipeline.line = pm.create(layout, ctx->getRenderPass());
+			program.flat = variants.addProgram(vert, flat);
+			program.textured = variants.addProgram(vert, textured);
+			program.pulledFlat = variants.addProgram(pulled, flat);
+			program.pulledTextured = variants.addProgram(pulled, textured);
+		}
+
+		PipelineKey fillKey(uint32_t vertexLayout) const {
+			PipelineKey key;
+			key.program = program.flat;
+			key.layout = vertexLayout;
+			return key;
+		}
+
+		// nullptr for an invalid format, or once PipelineKey::maxLayouts different layouts are
+		// in use, counting pulledLayout
+		const Layout* layoutFor(const Context& ctx, const GeometryBuffer& g) {
+			if (!g.format.valid()) {
+				return nullptr;
+			}
+			auto it = layouts.find(g.layoutKey);
+			if (it == layouts.end()) {
+				Layout entry;
+				if (layouts.size() + 1 < PipelineKey::maxLayouts) {
+					entry.index = variants.addLayout(g.format);
+					auto key = fillKey(entry.index);
+					key.features = g.octahedralNormals ? OctahedralNormals : 0;
+					entry.fallback = variants.variant(ctx, key);
+				}
+				else {
+					log_error("too many vertex layouts, geometries using ", g.layoutKey, " are not drawn");
+				}
+				it = layouts.emplace(g.layoutKey, entry).first;
+			}
+			return it->second.fallback != PipelineVariants::maxVariants ? &it->second : nullptr;
 		}
 
 		void setSelect(const SelectInfo& sel) {
+			if (sel.ObjectID != selectInfo.ObjectID || sel.PrimID != selectInfo.PrimID) {
+				selectVersion++;
+			}
 			selectInfo = sel;
 		}
+
+		uint64_t getSelectVersion() const { return selectVersion; }
+
+		// changes when a pipeline finished building, so the recorded draws can use it
+		uint64_t getPipelineVersion() const { return variants.version(); }
+		uint32_t getPendingPipelines() const { return variants.pending(); }
 		
-		void draw(const Context& ctx, vk::CommandBuffer& cmd, vk::DescriptorSet& cameraSet,GeometryManager& geometries)
+		const RenderQueueStats& getStats() const { return stats; }
+
+		void draw(const Context& ctx, vk::CommandBuffer& cmd, vk::DescriptorSet& cameraSet,GeometryManager& geometries, VirtualTextureManager& textures, const glm::mat4& view)
 		{
-			uint32_t setOffset = { 0 };
-			cmd->bindDescriptorSet(layout, 0, cameraSet->get(), setOffset);
+			enum Pass { Opaque, Wireframe };
+
+			struct Item
+			{
+				uint32_t id;
+				const GeometryBuffer* geometry;
+				glm::u8vec4 color;
+			};
+
+			// A variant still being built falls back to the same key without highlighting, opaque
+			// draws then to the generic fill pipeline of their layout; wireframes are left out
+			// until ready.
+			auto resolve = [&](PipelineKey key, uint32_t fallback) -> uint32_t {
+				uint32_t index = variants.variant(ctx, key);
+				if (variants.find(index)) {
+					return index;
+				}
+				if (key.features & Highlight) {
+					key.features &= ~Highlight;
+					index = variants.variant(ctx, key);
+					if (variants.find(index)) {
+						return index;
+					}
+				}
+				return fallback != PipelineVariants::maxVariants && variants.find(fallback) ? fallback : PipelineVariants::maxVariants;
+			};
+
+			PipelineKey fill = fillKey(0);
+			PipelineKey line = fill;
+			line.polygonMode = VK_POLYGON_MODE_LINE;
+
+			PipelineKey textured = fill;
+			textured.program = program.textured;
+
+			// the arena field is 1 for geometries pulled from the VertexArena, 0 for those with
+			// buffers of their own; the pipeline field is the variant index, the material field
+			// the virtual texture slot + 1
+			auto queue = RenderQueue<Item>(ctx->getFrameArena(), geometries.size() * 2);
+			geometries.draw([&](uint32_t id, const GeometryBuffer& g) {
+				uint32_t arena = 0;
+				uint32_t fallback = pulledFallback;
+				if (g.pulled) {
+					arena = 1;
+					fill.program = program.pulledFlat;
+					textured.program = program.pulledTextured;
+					fill.layout = textured.layout = pulledLayout;
+				}
+				else {
+					auto vertexLayout = layoutFor(ctx, g);
+					if (!vertexLayout) {
+						return;
+					}
+					fallback = vertexLayout->fallback;
+					fill.program = program.flat;
+					textured.program = program.textured;
+					fill.layout = textured.layout = vertexLayout->index;
+				}
+				line.program = fill.program;
+				line.layout = fill.layout;
+
+				auto depth = SortKey::depthBucket(-(view * glm::vec4(g.bounds.center, 1.0f)).z);
+				uint32_t features = (selectInfo.ObjectID == id + 1 ? Highlight : 0) | (g.octahedralNormals ? OctahedralNormals : 0);
+				uint32_t index = PipelineVariants::maxVariants;
+				if (g.virtualTexture >= 0) {
+					textured.features = features;
+					index = resolve(textured, PipelineVariants::maxVariants);
+				}
+				if (index != PipelineVariants::maxVariants) {
+					queue.push(SortKey::pack(Opaque, index, g.virtualTexture + 1, arena, depth), { id, &g, glm::u8vec4(255,255,255,255) });
+				}
+				else {
+					fill.features = features;
+					index = resolve(fill, fallback);
+					if (index != PipelineVariants::maxVariants) {
+						queue.push(SortKey::pack(Opaque, index, 0, arena, depth), { id, &g, glm::u8vec4(128,128,128,255) });
+					}
+				}
+
+				line.features = features;
+				index = resolve(line, PipelineVariants::maxVariants);
+				if (index != PipelineVariants::maxVariants) {
+					queue.push(SortKey::pack(Wireframe, index, 0, arena, depth), { id, &g, glm::u8vec4(64, 64, 64, 255) });
+				}
+				});
+
+			stats = {};
+			queue.sort(stats);
 
 			struct
 			{
@@ -99,30 +298,40 @@ namespace vg
 				uint32_t PirmID;
 				glm::u8vec4 color;
 				uint32_t padding;
+				glm::vec4 positionOffset;
+				glm::vec4 positionScale;
+				glm::uvec4 vertexLayout;
 			}pc;
 
-			auto doDraw = [&](const glm::u8vec4& color) {
-				geometries.draw([&](uint32_t id, const GeometryBuffer & g) {
-					if (selectInfo.ObjectID == id + 1) {
-						pc = { selectInfo.ObjectID,selectInfo.PrimID,color,0 };
-						cmd->pushContants(layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, pc);
-					}
-					else {
-						pc = { 0,0,color,0 };
-						cmd->pushContants(layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, pc);
-					}
+			uint32_t setOffset = { 0 };
+			cmd->bindDescriptorSet(layout, 0, cameraSet->get(), setOffset);
+			cmd->bindDescriptorSet(layout, 2, geometries.getArena().getSet()->get());
 
-					VkDeviceSize offset = { 0 };
-					cmd->bindVertexBuffer(0, g.vertexBuffer->get(), offset);
-					cmd->bindIndexBuffer(g.indexBuffer->get(), 0, g.indexType);
-					cmd->drawIndexd(g.count, 1);
-					});
-			};
+			// redundant binds between consecutive draws are dropped by the command buffer
+			queue.each([&](uint64_t key, const Item& item) {
+				cmd->bindPipeline(*variants.find(SortKey::pipeline(key)));
+				if (SortKey::material(key)) {
+					cmd->bindDescriptorSet(layout, 1, textures.getSet(SortKey::material(key) - 1)->get());
+				}
+
+				auto& g = *item.geometry;
+				if (selectInfo.ObjectID == item.id + 1) {
+					pc = { selectInfo.ObjectID,selectInfo.PrimID,item.color,0,g.positionOffset,g.positionScale,g.pullLayout };
+				}
+				else {
+					pc = { 0,0,item.color,0,g.positionOffset,g.positionScale,g.pullLayout };
+				}
+				cmd->pushContants(layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, pc);
 
-			cmd->bindPipeline(pipeline.fill);
-			doDraw(glm::u8vec4(128,128,128,255));
-			cmd->bindPipeline(pipeline.line);
-			doDraw(glm::u8vec4(64, 64, 64, 255));
+				// pulled vertices are addressed by pc.vertexLayout, only the indices are bound
+				if (SortKey::arena(key)) {
+					g.bindIndices(cmd);
+				}
+				else {
+					g.bind(cmd);
+				}
+				cmd->drawIndexd(g.count, 1);
+				});
 		}
 	};
 
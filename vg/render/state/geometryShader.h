@@ -0,0 +1,74 @@
+#pragma once
+
+namespace vg
+{
+	// Vertex inputs of every shader that draws a GeometryBuffer. Attributes are read as vec4
+	// so one program takes any encoding. Position-only passes declare just
+	// geometryPositionShader and build their pipelines with PipelineMaker::vertexPositions.
+	inline constexpr const char* geometryPositionShader =
+		"layout(location=0)in vec4 position;\n";
+
+	inline constexpr const char* geometryAttributeShader =
+		"layout(location=1)in vec4 normal;\n"
+		"layout(location=2)in vec2 texcoord;\n";
+
+	// Instead of the inputs above: position, normal and texcoord fetched by pullVertex from
+	// the VertexArena storage buffer at set 2, in the layout of GeometryBuffer::pullLayout.
+	// Missing components are filled in as vertex input does, absent attributes read the
+	// position, so the shaders after it are the same for both paths.
+	inline constexpr const char* geometryPullShader =
+		"layout(std430,set=2,binding=0) readonly buffer VertexArena {\n"
+		"	uint words[];\n"
+		"} arena;\n"
+		"vec4 position;\n"
+		"vec4 normal;\n"
+		"vec2 texcoord;\n"
+
+		// 4 bytes at any byte offset, attributes of 2 byte components may straddle words
+		"uint arenaLoad(uint at){\n"
+		"	uint shift = (at & 3u) * 8u;\n"
+		"	uint value = arena.words[at >> 2] >> shift;\n"
+		"	if(shift != 0u) value |= arena.words[(at >> 2) + 1u] << (32u - shift);\n"
+		"	return value;\n"
+		"}\n"
+
+		// packed as VertexFormat::pack: format(4) | offset(8), formats in AttributeFormat order
+		"vec4 fetchAttribute(uint base, uint packed){\n"
+		"	uint at = base + ((packed >> 4) & 0xffu);\n"
+		"	switch(packed & 0xfu){\n"
+		"	case 1u: return vec4(uintBitsToFloat(arenaLoad(at)), uintBitsToFloat(arenaLoad(at + 4u)), 0.0, 1.0);\n"
+		"	case 2u: return vec4(uintBitsToFloat(arenaLoad(at)), uintBitsToFloat(arenaLoad(at + 4u)), uintBitsToFloat(arenaLoad(at + 8u)), 1.0);\n"
+		"	case 3u: return vec4(uintBitsToFloat(arenaLoad(at)), uintBitsToFloat(arenaLoad(at + 4u)), uintBitsToFloat(arenaLoad(at + 8u)), uintBitsToFloat(arenaLoad(at + 12u)));\n"
+		"	case 4u: return vec4(unpackHalf2x16(arenaLoad(at)), 0.0, 1.0);\n"
+		"	case 5u: return vec4(unpackUnorm2x16(arenaLoad(at)), 0.0, 1.0);\n"
+		"	case 6u: return vec4(unpackUnorm2x16(arenaLoad(at)), unpackUnorm2x16(arenaLoad(at + 4u)));\n"
+		"	case 7u: return vec4(unpackSnorm2x16(arenaLoad(at)), 0.0, 1.0);\n"
+		"	case 8u: return vec4(unpackSnorm4x8(arenaLoad(at)).xy, 0.0, 1.0);\n"
+		"	}\n"
+		"	return vec4(0.0, 0.0, 0.0, 1.0);\n"
+		"}\n"
+
+		"void pullVertex(uvec4 vertexLayout){\n"
+		"	uint index = uint(gl_VertexIndex);\n"
+		"	uint attributes = vertexLayout.y + index * ((vertexLayout.z >> 8) & 0xffu);\n"
+		"	position = fetchAttribute(vertexLayout.x + index * (vertexLayout.z & 0xffu), vertexLayout.z >> 16);\n"
+		"	normal = (vertexLayout.w & 0xfu) != 0u ? fetchAttribute(attributes, vertexLayout.w & 0xfffu) : position;\n"
+		"	texcoord = (vertexLayout.w & 0xf000u) != 0u ? fetchAttribute(attributes, vertexLayout.w >> 12).xy : position.xy;\n"
+		"}\n";
+
+	// After either of the above: decodePosition undoes the quantization with the geometry's
+	// positionOffset and positionScale, decodeNormal unfolds octahedral normals.
+	inline constexpr const char* geometryPositionDecode =
+		"vec3 decodePosition(vec4 offset, vec4 scale){\n"
+		"	return offset.xyz + position.xyz * scale.xyz;\n"
+		"}\n";
+
+	inline constexpr const char* geometryNormalDecode =
+		"vec3 decodeNormal(bool octahedral){\n"
+		"	if(!octahedral) return normal.xyz;\n"
+		"	vec3 n = vec3(normal.xy, 1.0 - abs(normal.x) - abs(normal.y));\n"
+		"	float t = max(-n.z, 0.0);\n"
+		"	n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));\n"
+		"	return normalize(n);\n"
+		"}\n";
+}
@@ -1,10 +1,94 @@
 #pragma once
 
 #include "../context.h"
+#include <core/hash.h>
+#include <util/trace.h>
 #include <imgui/imgui.h>
 
 namespace vg
 {
+	// Copy of ImGui's draw data that the render thread can consume while the UI thread
+	// already builds the next frame. The vectors keep their capacity between frames.
+	struct ImguiDrawSnapshot
+	{
+		struct Command
+		{
+			ImVec4 clipRect;
+			ImTextureID textureId;
+			uint32_t elemCount;
+		};
+
+		struct List
+		{
+			uint32_t vertexCount;
+			uint32_t commandCount;
+		};
+
+		ImVec2 displayPos = {};
+		ImVec2 displaySize = {};
+		ImVec2 framebufferScale = {};
+
+		std::vector<ImDrawVert> vertices;
+		std::vector<ImDrawIdx> indices;
+		std::vector<Command> commands;
+		std::vector<List> lists;
+
+		void capture(const ImDrawData* data)
+		{
+			vertices.clear();
+			indices.clear();
+			commands.clear();
+			lists.clear();
+			if (!data) {
+				displaySize = {};
+				return;
+			}
+
+			displayPos = data->DisplayPos;
+			displaySize = data->DisplaySize;
+			framebufferScale = data->FramebufferScale;
+			for (int n = 0; n < data->CmdListsCount; n++)
+			{
+				const ImDrawList* cmd_list = data->CmdLists[n];
+				vertices.insert(vertices.end(), cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Data + cmd_list->VtxBuffer.Size);
+
+				// user callbacks refer to UI thread state and can not run on the render thread,
+				// their index ranges are dropped from the list
+				uint32_t commandCount = 0;
+				uint32_t idx_offset = 0;
+				for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++)
+				{
+					const ImDrawCmd& pcmd = cmd_list->CmdBuffer[cmd_i];
+					if (!pcmd.UserCallback) {
+						indices.insert(indices.end(), cmd_list->IdxBuffer.Data + idx_offset, cmd_list->IdxBuffer.Data + idx_offset + pcmd.ElemCount);
+						commands.push_back({ pcmd.ClipRect, pcmd.TextureId, pcmd.ElemCount });
+						commandCount++;
+					}
+					idx_offset += pcmd.ElemCount;
+				}
+				lists.push_back({ static_cast<uint32_t>(cmd_list->VtxBuffer.Size), commandCount });
+			}
+		}
+
+		// Texture ids are stored as they are; the renderer only ever binds the font atlas.
+		void save(TraceBuffer& out) const
+		{
+			out.put(displayPos);
+			out.put(displaySize);
+			out.put(framebufferScale);
+			out.array(vertices);
+			out.array(indices);
+			out.array(commands);
+			out.array(lists);
+		}
+
+		bool load(TraceCursor& in)
+		{
+			return in.get(displayPos) && in.get(displaySize) && in.get(framebufferScale) &&
+				in.array(vertices) && in.array(indices) && in.array(commands) && in.array(lists);
+		}
+	};
+
 	class ImguiRenderState
 	{
 		vk::Sampler sampler;
@@ -18,6 +102,9 @@ namespace vg
 
 		vk::Buffer vertexBuffer;
 		vk::Buffer indexBuffer;
+
+		uint64_t drawHash = 0;
+		uint64_t drawVersion = 0;
 	public:
 		ImguiRenderState() {}
 
@@ -37,7 +124,7 @@ namespace vg
 				size_t upload_size = width * height * 4 * sizeof(char);
 
 				tex = ctx->getDevice()->createTexture2D(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
-				tex->upload(ctx->getCommandPool(), ctx->getGraphicsQueue(), pixels);
+				ctx->getUploader().image(tex, pixels, upload_size);
 				io.Fonts->TexID = (ImTextureID)(intptr_t)&tex;
 			}
 			
@@ -130,102 +217,109 @@ namespace vg
 			}
 		}
 
-		void createOrResizeBuffer(const Context& ctx,ImDrawData* data)
+		void createOrResizeBuffer(const Context& ctx, const ImguiDrawSnapshot& data)
 		{
 			// Create the Vertex and Index buffers:
-			uint32_t vertex_size = data->TotalVtxCount * sizeof(ImDrawVert);
-			uint32_t index_size = data->TotalIdxCount * sizeof(ImDrawIdx);
+			uint32_t vertex_size = static_cast<uint32_t>(data.vertices.size() * sizeof(ImDrawVert));
+			uint32_t index_size = static_cast<uint32_t>(data.indices.size() * sizeof(ImDrawIdx));
 			if (!vertexBuffer || vertexBuffer->size() < vertex_size)
 			{
 				vertexBuffer = ctx->getDevice()->createVertexBuffer(vertex_size, VK_TRUE);
+				ctx->invalidateFrame();
 			}
 			if (!indexBuffer || indexBuffer->size() < index_size)
 			{
 				indexBuffer = ctx->getDevice()->createIndexBuffer(index_size, VK_TRUE);
+				ctx->invalidateFrame();
 			}
 
 			// Upload Vertex and index Data:
-			{
-				uint32_t vertexOffset = 0;
-				uint32_t indexOffset = 0;
-				
-				auto vp = (char*)vertexBuffer->map();
-				auto ip = (char*)indexBuffer->map();
-				for (int n = 0; n < data->CmdListsCount; n++)
-				{
-					const ImDrawList* cmd_list = data->CmdLists[n];
-					uint32_t vs = cmd_list->VtxBuffer.Size * sizeof(ImDrawVert);
-					uint32_t is = cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx);
+			memcpy(vertexBuffer->map(), data.vertices.data(), vertex_size);
+			memcpy(indexBuffer->map(), data.indices.data(), index_size);
+			vertexBuffer->unmap();
+			indexBuffer->unmap();
+			vertexBuffer->flush();
+			indexBuffer->flush();
+		}
 
-					memcpy(vp + vertexOffset, cmd_list->VtxBuffer.Data, vs);
-					memcpy(ip + indexOffset, cmd_list->IdxBuffer.Data, is);
+		// Uploads the draw data if it differs from the last upload and returns a version
+		// that changes exactly when the recorded ImGui commands would change.
+		uint64_t prepare(const Context& ctx, const ImguiDrawSnapshot& data)
+		{
+			uint64_t hash = hashValue(data.displayPos);
+			hash = hashValue(data.displaySize, hash);
+			hash = hashValue(data.framebufferScale, hash);
+			hash = hashBytes(data.vertices.data(), data.vertices.size() * sizeof(ImDrawVert), hash);
+			hash = hashBytes(data.indices.data(), data.indices.size() * sizeof(ImDrawIdx), hash);
+			for (auto& list : data.lists) {
+				hash = hashValue(list.vertexCount, hash);
+				hash = hashValue(list.commandCount, hash);
+			}
+			for (auto& pcmd : data.commands) {
+				hash = hashValue(pcmd.elemCount, hash);
+				hash = hashValue(pcmd.clipRect, hash);
+				hash = hashValue(pcmd.textureId, hash);
+			}
 
-					vertexOffset += vs;
-					indexOffset += is;
+			if (hash != drawHash) {
+				drawHash = hash;
+				drawVersion++;
+				if (!data.vertices.empty()) {
+					createOrResizeBuffer(ctx, data);
 				}
-				vertexBuffer->unmap();
-				indexBuffer->unmap();
-				vertexBuffer->flush();
-				indexBuffer->flush();
 			}
+			return drawVersion;
 		}
 
-		void draw(const Context& ctx, vk::CommandBuffer& cmd)
+		void draw(const Context& ctx, vk::CommandBuffer& cmd, const ImguiDrawSnapshot& data)
 		{
-			auto data = ImGui::GetDrawData();
-			int width = (int)(data->DisplaySize.x * data->FramebufferScale.x);
-			int height = (int)(data->DisplaySize.y * data->FramebufferScale.y);
+			int width = (int)(data.displaySize.x * data.framebufferScale.x);
+			int height = (int)(data.displaySize.y * data.framebufferScale.y);
 
-			if (width >0 && height > 0 && data->TotalVtxCount > 0) {
-				createOrResizeBuffer(ctx,data);
+			if (width >0 && height > 0 && !data.vertices.empty()) {
 				cmd->bindPipeline(pipeline);
 
-				std::vector<VkDeviceSize> offsets = { 0 };
-				cmd->bindVertexBuffer(0, vertexBuffer->get(), offsets);
+				VkDeviceSize offset = { 0 };
+				cmd->bindVertexBuffer(0, vertexBuffer->get(), offset);
 				cmd->bindIndexBuffer(indexBuffer->get(), 0);
 				cmd->bindDescriptorSet(layout, 0, descriptorSet->get());
 
-				std::vector<float> pushData(4);
-				pushData[0] = 2.0f / data->DisplaySize.x;
-				pushData[1] = 2.0f / data->DisplaySize.y;
-				pushData[2] = -1.0f - data->DisplayPos.x * pushData[0];
-				pushData[3] = -1.0f - data->DisplayPos.y * pushData[1];
-				cmd->pushContants(layout, VK_SHADER_STAGE_VERTEX_BIT, 0, static_cast<uint32_t>(sizeof(float) * 4), pushData.data());
+				float pushData[4];
+				pushData[0] = 2.0f / data.displaySize.x;
+				pushData[1] = 2.0f / data.displaySize.y;
+				pushData[2] = -1.0f - data.displayPos.x * pushData[0];
+				pushData[3] = -1.0f - data.displayPos.y * pushData[1];
+				cmd->pushContants(layout, VK_SHADER_STAGE_VERTEX_BIT, 0, static_cast<uint32_t>(sizeof(pushData)), pushData);
 
 				// Will project scissor/clipping rectangles into framebuffer space
-				ImVec2 clip_off = data->DisplayPos;         // (0,0) unless using multi-viewports
-				ImVec2 clip_scale = data->FramebufferScale; // (1,1) unless using retina display which are often (2,2)
+				ImVec2 clip_off = data.displayPos;         // (0,0) unless using multi-viewports
+				ImVec2 clip_scale = data.framebufferScale; // (1,1) unless using retina display which are often (2,2)
 
-				int vtx_offset = 0;
-				int idx_offset = 0;
-				for (int n = 0; n < data->CmdListsCount; n++)
+				uint32_t vtx_offset = 0;
+				uint32_t idx_offset = 0;
+				uint32_t cmd_offset = 0;
+				for (auto& list : data.lists)
 				{
-					const ImDrawList* cmd_list = data->CmdLists[n];
-					for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++)
+					for (uint32_t cmd_i = 0; cmd_i < list.commandCount; cmd_i++)
 					{
-						const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[cmd_i];
-						if (pcmd->UserCallback)
-						{
-							pcmd->UserCallback(cmd_list, pcmd);
-						}
-						else
+						const auto& pcmd = data.commands[cmd_offset + cmd_i];
+
+						// Project scissor/clipping rectangles into framebuffer space
+						ImVec4 clip_rect;
+						clip_rect.x = (pcmd.clipRect.x - clip_off.x) * clip_scale.x;
+						clip_rect.y = (pcmd.clipRect.y - clip_off.y) * clip_scale.y;
+						clip_rect.z = (pcmd.clipRect.z - clip_off.x) * clip_scale.x;
+						clip_rect.w = (pcmd.clipRect.w - clip_off.y) * clip_scale.y;
+
+						if (clip_rect.x < width && clip_rect.y < height && clip_rect.z >= 0.0f && clip_rect.w >= 0.0f)
 						{
-							// Project scissor/clipping rectangles into framebuffer space
-							ImVec4 clip_rect;
-							clip_rect.x = (pcmd->ClipRect.x - clip_off.x) * clip_scale.x;
-							clip_rect.y = (pcmd->ClipRect.y - clip_off.y) * clip_scale.y;
-							clip_rect.z = (pcmd->ClipRect.z - clip_off.x) * clip_scale.x;
-							clip_rect.w = (pcmd->ClipRect.w - clip_off.y) * clip_scale.y;
-
-							if (clip_rect.x < width && clip_rect.y < height && clip_rect.z >= 0.0f && clip_rect.w >= 0.0f)
-							{
-								cmd->scissor(clip_rect.x, clip_rect.y, clip_rect.z - clip_rect.x, clip_rect.w - clip_rect.y);
-								cmd->drawIndexd(pcmd->ElemCount, 1, idx_offset, vtx_offset);
-							}
+							cmd->scissor(clip_rect.x, clip_rect.y, clip_rect.z - clip_rect.x, clip_rect.w - clip_rect.y);
+							cmd->drawIndexd(pcmd.elemCount, 1, idx_offset, vtx_offset);
 						}
-						idx_offset += pcmd->ElemCount;
+						idx_offset += pcmd.elemCount;
 					}
-					vtx_offset += cmd_list->VtxBuffer.Size;
+					cmd_offset += list.commandCount;
+					vtx_offset += list.vertexCount;
 				}
 			}
 		}
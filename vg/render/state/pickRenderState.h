@@ -1,5 +1,6 @@
 #pragma once
 
+#include "geometryShader.h"
 
 namespace vg
 {
@@ -8,9 +9,13 @@ namespace vg
 		VkFormat colorFormat = VK_FORMAT_R32G32_UINT;
 
 		vk::PipelineLayout layout;
-		vk::Pipeline pipeline;
 		vk::RenderPass renderPass;
 
+		// one position-only pipeline per VertexFormat::positionKey
+		std::vector<uint32_t> vert;
+		std::vector<uint32_t> frag;
+		std::unordered_map<uint64_t, vk::Pipeline> pipelines;
+
 		vk::Image color;
 		vk::Image depth;
 		vk::Image copy;
@@ -26,9 +31,9 @@ namespace vg
 			setupRenderPass(ctx);
 			vk::PipelineLayoutMaker plm;
 			plm.setLayout(cameraSetLayout);
-			plm.pushConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t));
+			plm.pushConstant(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, 48);
 			layout = plm.create(ctx->getDevice());
-			setupPipeline(ctx);
+			setupShaders();
 
 			cmd = ctx->getCommandPool()->createCommandBuffer();
 		}
@@ -52,18 +57,25 @@ namespace vg
 			cmd->viewport(0, 0, extent.width, extent.height);
 			cmd->scissor(0, 0, extent.width, extent.height);
 
-			cmd->bindPipeline(pipeline);
 			uint32_t setOffset = { 0 };
 			cmd->bindDescriptorSet(layout, 0, cameraSet->get(), setOffset);
 
-			geometries.draw([&](uint32_t id,const GeometryBuffer& g) {
-				uint32_t pc[1] = { id+1 };
+			struct
+			{
+				uint32_t objectIndex;
+				uint32_t padding[3];
+				glm::vec4 positionOffset;
+				glm::vec4 positionScale;
+			}pc = {};
 
-				cmd->pushContants(layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, pc);
+			geometries.draw([&](uint32_t id,const GeometryBuffer& g) {
+				cmd->bindPipeline(pipelineFor(ctx, g));
+				pc.objectIndex = id + 1;
+				pc.positionOffset = g.positionOffset;
+				pc.positionScale = g.positionScale;
+				cmd->pushContants(layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, pc);
 
-				VkDeviceSize offset = { 0 };
-				cmd->bindVertexBuffer(0, g.vertexBuffer->get(), offset);
-				cmd->bindIndexBuffer(g.indexBuffer->get(), 0, g.indexType);
+				g.bindPositions(cmd);
 				cmd->drawIndexd(g.count, 1);
 			});
 
@@ -111,42 +123,54 @@ namespace vg
 			renderPass = rm.create(ctx->getDevice());
 		}
 
-		void setupPipeline(const Context& ctx) {
-			const std::string vert =
-				"#version 450\n"
-				"layout(location=0)in vec3 position;\n"
-				"layout(location=1)in vec3 normal;\n"
-				"layout(location=2)in vec2 texcoord;\n"
+		void setupShaders() {
+			const std::string pushConstant =
+				"layout(push_constant) uniform PushConstant {\n"
+				"	uint objectIndex;\n"
+				"	vec4 positionOffset;\n"
+				"	vec4 positionScale;\n"
+				"} pc;\n";
+
+			const std::string vert = std::string(
+				"#version 450\n") +
+				geometryPositionShader +
+				geometryPositionDecode +
 				"layout(set=0,binding=0) uniform CameraMatrix {\n"
 				"	mat4 projection;\n"
 				"	mat4 view;\n"
-				"} matrix;\n"
+				"} matrix;\n" +
+				pushConstant +
 
 				"void main(){\n"
-				"	gl_Position = matrix.projection * matrix.view * vec4(position,1.0);\n"
+				"	gl_Position = matrix.projection * matrix.view * vec4(decodePosition(pc.positionOffset, pc.positionScale),1.0);\n"
 				"}";
 
 			const std::string frag =
-				"#version 450\n"
-				"layout(push_constant) uniform PushConstant {\n"
-				"	uint objectIndex;\n"
-				"} pc;\n"
+				"#version 450\n" +
+				pushConstant +
 
 				"layout(location=0)out uvec2 color;\n"
 				"void main(){\n"
 				"	color = uvec2(pc.objectIndex, gl_PrimitiveID + 1);\n"
 				"}";
 
-			auto pm = vk::PipelineMaker(ctx->getDevice()).defaultBlend(VK_FALSE).defaultDynamic();
-			pm.shaderGLSL(VK_SHADER_STAGE_VERTEX_BIT, vert);
-			pm.shaderGLSL(VK_SHADER_STAGE_FRAGMENT_BIT, frag);
-			pm.vertexBinding(0, 32);
-			pm.vertexAttribute(0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0);
-			pm.vertexAttribute(1, 0, VK_FORMAT_R32G32B32_SFLOAT, 12);
-			pm.vertexAttribute(2, 0, VK_FORMAT_R32G32_SFLOAT, 24);
-			pm.depthTestEnable(VK_TRUE);
-			pm.depthWriteEnable(VK_TRUE);
-			pipeline = pm.create(layout, renderPass);
+			this->vert = vk::compileGLSL(VK_SHADER_STAGE_VERTEX_BIT, vert);
+			this->frag = vk::compileGLSL(VK_SHADER_STAGE_FRAGMENT_BIT, frag);
+		}
+
+		// Created when a layout is first drawn; picking waits for the GPU anyway.
+		const vk::Pipeline& pipelineFor(const Context& ctx, const GeometryBuffer& g) {
+			auto& pipeline = pipelines[g.format.positionKey()];
+			if (!pipeline) {
+				auto pm = vk::PipelineMaker(ctx->getDevice()).defaultBlend(VK_FALSE).defaultDynamic();
+				pm.shaderSPIRV(VK_SHADER_STAGE_VERTEX_BIT, vert);
+				pm.shaderSPIRV(VK_SHADER_STAGE_FRAGMENT_BIT, frag);
+				pm.vertexPositions(g.format);
+				pm.depthTestEnable(VK_TRUE);
+				pm.depthWriteEnable(VK_TRUE);
+				pipeline = pm.create(layout, renderPass);
+			}
+			return pipeline;
 		}
 
 		void resize(const Context& ctx, const VkExtent2D& extent) {
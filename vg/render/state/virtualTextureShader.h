@@ -0,0 +1,46 @@
+#pragma once
+
+namespace vg
+{
+	// Declarations shared by every shader that samples a virtual texture through set 1.
+	// Levels are chosen with the same rule everywhere, so the feedback pass requests exactly
+	// the tiles the shading pass will look up.
+	inline constexpr const char* virtualTextureShader =
+		"layout(set=1,binding=0) uniform sampler2D vtPhysical;\n"
+		"layout(set=1,binding=1) uniform usampler2D vtIndirection;\n"
+		"layout(set=1,binding=2) uniform VirtualTexture {\n"
+		"	uvec2 size;\n"
+		"	uvec2 tiles;\n"
+		"	float tileSize;\n"
+		"	float border;\n"
+		"	float pages;\n"
+		"	float maxLevel;\n"
+		"} vt;\n"
+
+		"float vtLevel(vec2 uv, float bias){\n"
+		"	vec2 texel = uv * vec2(vt.size);\n"
+		"	vec2 dx = dFdx(texel);\n"
+		"	vec2 dy = dFdy(texel);\n"
+		"	float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + bias;\n"
+		"	return clamp(floor(lod), 0.0, vt.maxLevel);\n"
+		"}\n"
+
+		"vec2 vtTexel(vec2 uv, uint level){\n"
+		"	return clamp(uv, 0.0, 1.0) * vec2(max(vt.size >> level, uvec2(1)));\n"
+		"}\n"
+
+		"uvec2 vtTile(vec2 uv, uint level){\n"
+		"	uvec2 tiles = max(vt.tiles >> level, uvec2(1));\n"
+		"	return min(uvec2(vtTexel(uv, level) / vt.tileSize), tiles - 1u);\n"
+		"}\n"
+
+		// the indirection entry holds the page of the finest resident level covering the tile
+		"vec4 vtSample(vec2 uv, float level){\n"
+		"	uvec4 entry = texelFetch(vtIndirection, ivec2(vtTile(uv, uint(level))), int(level));\n"
+		"	if(entry.w == 0u) return vec4(0.5, 0.5, 0.5, 1.0);\n"
+		"	vec2 local = clamp(vtTexel(uv, entry.z) - vec2(vtTile(uv, entry.z)) * vt.tileSize, 0.0, vt.tileSize);\n"
+		"	float pageSize = vt.tileSize + 2.0 * vt.border;\n"
+		"	vec2 texel = vec2(entry.xy) * pageSize + vt.border + local;\n"
+		"	return textureLod(vtPhysical, texel / (vt.pages * pageSize), 0.0);\n"
+		"}\n";
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "renderer.h"
+#include <imgui/imgui.h>
+
+namespace vg
+{
+	// Small overlay with the counters of the last frame. Call between ImGui::NewFrame and ImGui::Render.
+	inline void showStatsHud(const RenderStats& stats, bool* open = nullptr)
+	{
+		static float frameTimes[120] = {};
+		static int frameIndex = 0;
+		frameTimes[frameIndex] = stats.frameMilliseconds;
+		frameIndex = (frameIndex + 1) % IM_ARRAYSIZE(frameTimes);
+
+		ImGui::SetNextWindowPos(ImVec2(10, 30), ImGuiCond_FirstUseEver);
+		ImGui::SetNextWindowBgAlpha(0.35f);
+		if (!ImGui::Begin("Render stats", open, ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoFocusOnAppearing)) {
+			ImGui::End();
+			return;
+		}
+
+		ImGui::Text("Frame (CPU)      %.3f ms", stats.frameMilliseconds);
+		ImGui::PlotLines("##frame", frameTimes, IM_ARRAYSIZE(frameTimes), frameIndex, nullptr, 0.0f, FLT_MAX, ImVec2(0, 40));
+		ImGui::Text("GPU wait         %.3f ms", stats.fenceMilliseconds);
+		ImGui::Separator();
+		ImGui::Text("Draws            %u", stats.draws);
+		ImGui::Text("Triangles        %llu", static_cast<unsigned long long>(stats.triangles));
+		ImGui::Text("Instances        %u", stats.instances);
+		ImGui::Text("Pipeline binds   %u", stats.pipelineBinds);
+		ImGui::Text("Descriptor binds %u", stats.descriptorBinds);
+		ImGui::Text("Vertex binds     %u", stats.vertexBufferBinds);
+		ImGui::Text("Index binds      %u", stats.indexBufferBinds);
+		ImGui::Text("Push constants   %u B", stats.pushConstantBytes);
+		ImGui::Text("Skipped calls    %u", stats.skipped);
+		ImGui::Text("Recorded buffers %u", stats.recordedCommandBuffers);
+		if (stats.pageCount > 0) {
+			ImGui::Separator();
+			ImGui::Text("Resident pages   %u / %u", stats.residentPages, stats.pageCount);
+			ImGui::Text("Tile requests    %u", stats.pageRequests);
+			ImGui::Text("Tile loads       %u", stats.tileLoads);
+			ImGui::Text("Tile uploads     %u", stats.tileUploads);
+		}
+		ImGui::Separator();
+		ImGui::Text("Sorted draws     %u", stats.sortedDraws);
+		ImGui::Text("Sort             %.1f us (%u passes)", stats.sortMicroseconds, stats.sortPasses);
+		ImGui::End();
+	}
+}
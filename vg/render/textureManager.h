@@ -0,0 +1,104 @@
+#pragma once
+#include "context.h"
+#include <util/texture.h>
+#include <core/log.h>
+#include <unordered_map>
+
+namespace vg
+{
+	inline VkFormat toVkFormat(TextureFormat format)
+	{
+		switch (format)
+		{
+		case TextureFormat::RGBA8: return VK_FORMAT_R8G8B8A8_UNORM;
+		case TextureFormat::RGBA8_SRGB: return VK_FORMAT_R8G8B8A8_SRGB;
+		case TextureFormat::BC1: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+		case TextureFormat::BC1_SRGB: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+		case TextureFormat::BC3: return VK_FORMAT_BC3_UNORM_BLOCK;
+		case TextureFormat::BC3_SRGB: return VK_FORMAT_BC3_SRGB_BLOCK;
+		case TextureFormat::BC5: return VK_FORMAT_BC5_UNORM_BLOCK;
+		case TextureFormat::BC7: return VK_FORMAT_BC7_UNORM_BLOCK;
+		case TextureFormat::BC7_SRGB: return VK_FORMAT_BC7_SRGB_BLOCK;
+		default: return VK_FORMAT_UNDEFINED;
+		}
+	}
+
+	struct Texture
+	{
+		vk::Image image;
+		TextureFormat format = TextureFormat::Undefined;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t mipLevels = 0;
+
+		Texture() {}
+
+		// Block-compressed data the device can not sample is decoded to RGBA8 first. Levels
+		// missing from the file are generated on the GPU when the format supports linear blits.
+		Texture(const Context& ctx, const TextureData& data) {
+			auto& device = ctx->getDevice();
+
+			const TextureData* source = &data;
+			TextureData decoded;
+			if (isCompressed(data.format) && !device->supportsFormat(toVkFormat(data.format), VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+				decoded = decompress(data);
+				source = &decoded;
+			}
+
+			format = source->format;
+			width = source->width;
+			height = source->height;
+
+			VkFormat vkFormat = toVkFormat(format);
+			uint32_t levels = static_cast<uint32_t>(source->levels.size());
+			mipLevels = levels;
+			VkFormatFeatureFlags blit = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+			if (!isCompressed(format) && levels < mipChainLength(width, height) && device->supportsFormat(vkFormat, blit)) {
+				mipLevels = mipChainLength(width, height);
+			}
+
+			image = device->createTexture2D(width, height, mipLevels, vkFormat);
+
+			std::vector<VkBufferImageCopy> regions(levels);
+			for (uint32_t i = 0; i < levels; i++) {
+				auto& level = source->levels[i];
+				auto& region = regions[i];
+				region = {};
+				region.bufferOffset = level.offset;
+				region.imageSubresource = image->getSubresourceLayers(i);
+				region.imageExtent = { level.width, level.height, 1 };
+			}
+			ctx->getUploader().image(image, source->data.data(), source->data.size(), regions);
+		}
+	};
+
+	class TextureManager
+	{
+		std::unordered_map<uint32_t, Texture> textures;
+		uint64_t version = 0;
+
+	public:
+		void addTexture(const Context& ctx, uint32_t id, const TextureData& data) {
+			if (data.format == TextureFormat::Undefined || data.levels.empty()) {
+				log_error("Texture has no data : ", id);
+			}
+			else if (textures.find(id) == textures.end()) {
+				textures[id] = Texture(ctx, data);
+				version++;
+			}
+			else {
+				log_error("Texture id is exist : ", id);
+			}
+		}
+
+		const Texture* get(uint32_t id) const {
+			auto it = textures.find(id);
+			return it == textures.end() ? nullptr : &it->second;
+		}
+
+		size_t size() const { return textures.size(); }
+
+		// Bumped whenever the set of textures changes.
+		uint64_t getVersion() const { return version; }
+	};
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "vk/vkt.h"
+
+namespace vg
+{
+	// Collects staging copies into one command buffer that flush() submits ahead of the next
+	// frame on the same queue. Staging chunks and command buffers are stamped with the frame
+	// they were submitted with and reused once the device reports that frame complete, so
+	// uploads never wait for the GPU.
+	class Uploader
+	{
+		struct Chunk
+		{
+			vk::Buffer buffer;
+			uint8_t* data = nullptr;
+			VkDeviceSize offset = 0;
+			uint64_t frame = 0;
+			bool open = false;
+		};
+
+		struct Batch
+		{
+			vk::CommandBuffer cmd;
+			uint64_t frame = 0;
+		};
+
+		const vk::Device_T* device = nullptr;
+		vk::CommandPool* pool = nullptr;
+		vk::Queue* queue = nullptr;
+
+		std::vector<Chunk> chunks;
+		std::vector<Batch> batches;
+		Batch* recording = nullptr;
+		std::vector<VkBufferImageCopy> copies;
+
+		VkDeviceSize chunkSize = 4 << 20;
+	public:
+		Uploader() {}
+		Uploader(const vk::Device_T* device, vk::CommandPool& pool, vk::Queue& queue) : device(device), pool(&pool), queue(&queue) {}
+
+		void buffer(const vk::Buffer& dst, const void* data, VkDeviceSize size, VkDeviceSize dstOffset = 0) {
+			VkBuffer src;
+			VkDeviceSize offset;
+			std::memcpy(stage(size, 4, src, offset), data, size);
+
+			VkBufferCopy region = { offset, dstOffset, size };
+			commandBuffer()->copyBuffer(src, dst->get(), region);
+		}
+
+		// Uploads levels [0, regions.size()) of dst. Region buffer offsets are relative to data.
+		// Missing levels are generated with blits when the image has more.
+		void image(const vk::Image& dst, const void* data, VkDeviceSize size, vk::ArrayProxy<const VkBufferImageCopy> regions) {
+			auto& cmd = copy(dst, data, size, regions);
+			if (dst->mipLevels() > regions.size()) {
+				dst->generateMipmaps(cmd, regions.size());
+			}
+			else {
+				dst->setLayout(cmd, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			}
+		}
+
+		// Single level image, tightly packed.
+		void image(const vk::Image& dst, const void* data, VkDeviceSize size) {
+			VkBufferImageCopy region = {};
+			region.imageSubresource = dst->getSubresourceLayers(0);
+			region.imageExtent = dst->extent();
+			image(dst, data, size, region);
+		}
+
+		// Overwrites parts of an image that is already in use; other texels and levels keep
+		// their contents and no mips are generated.
+		void update(const vk::Image& dst, const void* data, VkDeviceSize size, vk::ArrayProxy<const VkBufferImageCopy> regions) {
+			auto& cmd = copy(dst, data, size, regions);
+			dst->setLayout(cmd, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		}
+
+		// Submits everything recorded since the last flush. Work recorded later in the frame
+		// can use the uploaded resources; no-op when nothing was recorded.
+		void flush() {
+			if (!recording) {
+				return;
+			}
+
+			// make transfer writes visible to every later read, whatever submission it is in
+			VkMemoryBarrier barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			recording->cmd->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, barrier, {}, {});
+			recording->cmd->end();
+			(*queue)->submit(recording->cmd);
+
+			uint64_t frame = device->pendingFrame();
+			recording->frame = frame;
+			recording = nullptr;
+			for (auto& chunk : chunks) {
+				if (chunk.open) {
+					chunk.buffer->unmap();
+					chunk.buffer->flush();
+					chunk.frame = frame;
+					chunk.open = false;
+				}
+			}
+		}
+
+		bool pending() const { return recording != nullptr; }
+	private:
+		bool available(uint64_t frame) const {
+			return frame <= device->completedFrame();
+		}
+
+		vk::CommandBuffer& copy(const vk::Image& dst, const void* data, VkDeviceSize size, vk::ArrayProxy<const VkBufferImageCopy> regions) {
+			VkBuffer src;
+			VkDeviceSize offset;
+			// 16 covers the block size of every format we upload
+			std::memcpy(stage(size, 16, src, offset), data, size);
+
+			auto& cmd = commandBuffer();
+			copies.assign(regions.begin(), regions.end());
+			for (auto& copy : copies) {
+				copy.bufferOffset += offset;
+			}
+			dst->setLayout(cmd, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+			cmd->copyBufferToImage(src, dst->get(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copies);
+			return cmd;
+		}
+
+		vk::CommandBuffer& commandBuffer() {
+			if (recording) {
+				return recording->cmd;
+			}
+			for (auto& batch : batches) {
+				if (available(batch.frame)) {
+					recording = &batch;
+					break;
+				}
+			}
+			if (!recording) {
+				// nothing points into batches while not recording, so it may grow
+				batches.push_back({ (*pool)->createCommandBuffer(), 0 });
+				recording = &batches.back();
+			}
+			recording->cmd->begin();
+			return recording->cmd;
+		}
+
+		void* stage(VkDeviceSize size, VkDeviceSize align, VkBuffer& buffer, VkDeviceSize& offset) {
+			Chunk* target = nullptr;
+			for (auto& chunk : chunks) {
+				VkDeviceSize aligned = (chunk.offset + align - 1) & ~(align - 1);
+				if (chunk.open && aligned + size <= chunk.buffer->size()) {
+					chunk.offset = aligned;
+					target = &chunk;
+					break;
+				}
+			}
+			for (size_t i = 0; !target && i < chunks.size(); i++) {
+				auto& chunk = chunks[i];
+				if (!chunk.open && available(chunk.frame) && size <= chunk.buffer->size()) {
+					target = &chunk;
+				}
+			}
+			if (!target) {
+				chunks.push_back({ device->create<vk::Buffer_T>(std::max(size, chunkSize), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, vk::MemoryUsage::CPU_ONLY) });
+				target = &chunks.back();
+			}
+			if (!target->open) {
+				target->open = true;
+				target->offset = 0;
+				target->data = static_cast<uint8_t*>(target->buffer->map());
+			}
+
+			buffer = target->buffer->get();
+			offset = target->offset;
+			target->offset += size;
+			return target->data + offset;
+		}
+	};
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "context.h"
+
+namespace vg
+{
+	// One large buffer the vertices of many geometries are placed in, bound both as vertex
+	// buffer and as storage buffer (set layout binding 0) so shaders can pull the vertices
+	// of any layout by byte offset. Geometries are never removed, so placement only bumps.
+	class VertexArena
+	{
+		vk::Buffer buffer;
+		vk::DescriptorSetLayout setLayout;
+		vk::DescriptorSet set;
+		VkDeviceSize capacity = 0;
+		VkDeviceSize used = 0;
+	public:
+		// within the 128 MiB of storage buffer range every device supports
+		static constexpr VkDeviceSize defaultCapacity = VkDeviceSize(64) << 20;
+		// every placement starts at a multiple of this, so 4 byte loads never straddle
+		static constexpr VkDeviceSize alignment = 16;
+		// allocated past capacity: arenaLoad reads whole words, and the word after the one
+		// holding the last 2 byte attribute of the last vertex, up to 4 bytes past the data
+		static constexpr VkDeviceSize tailPadding = 4;
+
+		VertexArena() {}
+
+		VertexArena(const Context& ctx, VkDeviceSize size = defaultCapacity) : capacity(size) {
+			buffer = ctx->getDevice()->createStorageBuffer(capacity + tailPadding, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+
+			vk::DescriptorSetLayoutMaker dlm;
+			dlm.binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT);
+			setLayout = dlm.create(ctx->getDevice());
+
+			set = ctx->getDescriptorPool()->createDescriptorSet(setLayout->get());
+			auto updater = vk::DescriptorSetUpdater();
+			updater.beginDescriptorSet(set);
+			updater.beginBuffers(0, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+			updater.buffer(buffer, 0, capacity + tailPadding);
+			updater.update(ctx->getDevice());
+		}
+
+		// Uploads size bytes and returns where they start; false when the arena is full.
+		bool place(const Context& ctx, const void* data, VkDeviceSize size, VkDeviceSize& offset) {
+			VkDeviceSize start = (used + alignment - 1) / alignment * alignment;
+			if (!buffer || !size || start + size > capacity) {
+				return false;
+			}
+			ctx->getUploader().buffer(buffer, data, size, start);
+			used = start + size;
+			offset = start;
+			return true;
+		}
+
+		const vk::Buffer& getBuffer() const { return buffer; }
+		const vk::DescriptorSetLayout& getSetLayout() const { return setLayout; }
+		const vk::DescriptorSet& getSet() const { return set; }
+		VkDeviceSize getUsed() const { return used; }
+		VkDeviceSize getCapacity() const { return capacity; }
+	};
+}
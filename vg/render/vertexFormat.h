@@ -0,0 +1,236 @@
+#pragma once
+
+#include <cstdint>
+
+namespace vg
+{
+	enum VertexType
+	{
+		none = 0x00,
+		position = 0x01,
+		normal = 0x02,
+		texcoord = 0x04,
+		PNT = position | normal | texcoord
+	};
+
+	enum class PositionEncoding : uint8_t
+	{
+		Float,
+		// 4x unorm16 spanning the bounds, which must be given with the data
+		Unorm16
+	};
+
+	enum class NormalEncoding : uint8_t
+	{
+		Float,
+		// octahedral map in 2x snorm16 or 2x snorm8
+		Oct16,
+		Oct8
+	};
+
+	enum class TexcoordEncoding : uint8_t
+	{
+		Float,
+		Half,
+		// for texcoords within [0, 1]
+		Unorm16
+	};
+
+	// Storage of each vertex attribute; they follow each other in the order position,
+	// normal, texcoord, each aligned to its component size. importMesh writes the quantized
+	// forms, the vertex shaders decode them.
+	struct VertexEncoding
+	{
+		PositionEncoding position = PositionEncoding::Float;
+		NormalEncoding normal = NormalEncoding::Float;
+		TexcoordEncoding texcoord = TexcoordEncoding::Float;
+		// Positions go in a tightly packed stream ahead of the other attributes, so
+		// position-only passes such as picking fetch 12 bytes per vertex instead of 32.
+		bool separatePositions = false;
+
+		constexpr bool isFloat() const {
+			return position == PositionEncoding::Float && normal == NormalEncoding::Float && texcoord == TexcoordEncoding::Float;
+		}
+
+		// 16 bytes per vertex with all three attributes instead of 32
+		static constexpr VertexEncoding compact() {
+			return { PositionEncoding::Unorm16, NormalEncoding::Oct16, TexcoordEncoding::Half };
+		}
+	};
+
+	// What the vertex shaders read an attribute as; the integer ones are normalized.
+	enum class AttributeFormat : uint8_t
+	{
+		None,
+		Float2,
+		Float3,
+		Float4,
+		Half2,
+		Unorm16x2,
+		Unorm16x4,
+		Snorm16x2,
+		Snorm8x2
+	};
+
+	constexpr uint32_t componentSize(AttributeFormat format) {
+		switch (format)
+		{
+		case AttributeFormat::Float2:
+		case AttributeFormat::Float3:
+		case AttributeFormat::Float4: return 4;
+		case AttributeFormat::Snorm8x2: return 1;
+		case AttributeFormat::None: return 0;
+		default: return 2;
+		}
+	}
+
+	constexpr uint32_t componentCount(AttributeFormat format) {
+		switch (format)
+		{
+		case AttributeFormat::Float3: return 3;
+		case AttributeFormat::Float4:
+		case AttributeFormat::Unorm16x4: return 4;
+		case AttributeFormat::None: return 0;
+		default: return 2;
+		}
+	}
+
+	struct VertexAttribute
+	{
+		AttributeFormat format = AttributeFormat::None;
+		uint32_t offset = 0;
+
+		constexpr bool present() const { return format != AttributeFormat::None; }
+		constexpr uint32_t size() const { return componentSize(format) * componentCount(format); }
+	};
+
+	// Where position, normal and texcoord are in the vertices of one interleaved binding and
+	// how each is stored. Built at compile time from a vertex struct (see VertexTraits) or
+	// from flags and a VertexEncoding; geometries with equal keys share pipelines.
+	//
+	// With a positionStride the positions are a stream of their own (binding 0), followed in
+	// the same buffer by the other attributes (binding 1) with stride; position.offset is
+	// then within the position stream.
+	struct VertexFormat
+	{
+		uint32_t stride = 0;
+		VertexAttribute position;
+		VertexAttribute normal;
+		VertexAttribute texcoord;
+		uint32_t positionStride = 0;
+
+		constexpr VertexType flags() const {
+			return static_cast<VertexType>((position.present() ? VertexType::position : 0) |
+				(normal.present() ? VertexType::normal : 0) |
+				(texcoord.present() ? VertexType::texcoord : 0));
+		}
+
+		constexpr bool separatePositions() const { return positionStride != 0; }
+
+		// bytes per vertex over both streams
+		constexpr uint32_t vertexSize() const { return stride + positionStride; }
+
+		constexpr uint32_t vertexCount(uint32_t dataSize) const { return vertexSize() ? dataSize / vertexSize() : 0; }
+
+		// where the attribute stream starts in dataSize bytes of vertices
+		constexpr uint32_t attributeOffset(uint32_t dataSize) const { return vertexCount(dataSize) * positionStride; }
+
+		// stride of the binding positions are read from
+		constexpr uint32_t positionBindingStride() const { return separatePositions() ? positionStride : stride; }
+
+		// Positions are needed, everything fits its stream and starts at a multiple of its
+		// component size, and strides stay below 256 so they fit the key.
+		constexpr bool valid() const {
+			return position.present() && positionBindingStride() > 0 && stride < 256 && positionStride < 256 &&
+				fits(position, positionBindingStride()) && fits(normal, stride) && fits(texcoord, stride) &&
+				(position.format == AttributeFormat::Float3 || position.format == AttributeFormat::Float4 || position.format == AttributeFormat::Unorm16x4) &&
+				(!normal.present() || normal.format == AttributeFormat::Float3 || octahedralNormals());
+		}
+
+		constexpr bool isFloat() const {
+			return isFloat(position) && isFloat(normal) && isFloat(texcoord);
+		}
+
+		constexpr bool quantizedPosition() const { return position.format == AttributeFormat::Unorm16x4; }
+
+		constexpr bool octahedralNormals() const {
+			return normal.format == AttributeFormat::Snorm16x2 || normal.format == AttributeFormat::Snorm8x2;
+		}
+
+		// format(4) | offset(8), also how pulling shaders are told where an attribute is
+		static constexpr uint32_t pack(const VertexAttribute& a) {
+			return uint32_t(a.format) | ((a.offset & 0xff) << 4);
+		}
+
+		// stride(8) | position, normal, texcoord as pack(12) | positionStride(8)
+		constexpr uint64_t key() const {
+			return uint64_t(stride & 0xff) |
+				(uint64_t(pack(position)) << 8) |
+				(uint64_t(pack(normal)) << 20) |
+				(uint64_t(pack(texcoord)) << 32) |
+				(uint64_t(positionStride & 0xff) << 44);
+		}
+
+		// Equal for formats a position-only pipeline reads the same way.
+		constexpr uint64_t positionKey() const {
+			return pack(position) | (uint64_t(positionBindingStride() & 0xff) << 12);
+		}
+
+		constexpr bool operator==(const VertexFormat& other) const { return key() == other.key(); }
+		constexpr bool operator!=(const VertexFormat& other) const { return key() != other.key(); }
+	private:
+		static constexpr bool fits(const VertexAttribute& a, uint32_t streamStride) {
+			return !a.present() || (a.offset + a.size() <= streamStride && a.offset % componentSize(a.format) == 0);
+		}
+
+		static constexpr bool isFloat(const VertexAttribute& a) {
+			return !a.present() || componentSize(a.format) == 4;
+		}
+	};
+
+	// The attributes of flags one after the other in encoding, each aligned to its component
+	// size, with the position in a stream of its own when the encoding asks for it.
+	constexpr VertexFormat vertexFormat(VertexType flags, VertexEncoding encoding = {}) {
+		VertexFormat format;
+		uint32_t offset = 0;
+		uint32_t alignment = 1;
+		auto place = [&](VertexAttribute& attribute, AttributeFormat storage) {
+			uint32_t size = componentSize(storage);
+			offset = (offset + size - 1) / size * size;
+			alignment = alignment > size ? alignment : size;
+			attribute = { storage, offset };
+			offset += attribute.size();
+		};
+
+		if (flags & VertexType::position) {
+			place(format.position, encoding.position == PositionEncoding::Unorm16 ? AttributeFormat::Unorm16x4 : AttributeFormat::Float3);
+			if (encoding.separatePositions) {
+				// a stream of its own, the other attributes start over at 0
+				format.positionStride = offset;
+				offset = 0;
+				alignment = 1;
+			}
+		}
+		if (flags & VertexType::normal) {
+			place(format.normal, encoding.normal == NormalEncoding::Oct16 ? AttributeFormat::Snorm16x2 :
+				encoding.normal == NormalEncoding::Oct8 ? AttributeFormat::Snorm8x2 : AttributeFormat::Float3);
+		}
+		if (flags & VertexType::texcoord) {
+			place(format.texcoord, encoding.texcoord == TexcoordEncoding::Half ? AttributeFormat::Half2 :
+				encoding.texcoord == TexcoordEncoding::Unorm16 ? AttributeFormat::Unorm16x2 : AttributeFormat::Float2);
+		}
+		format.stride = (offset + alignment - 1) / alignment * alignment;
+		return format;
+	}
+
+	// Describes the vertex struct V as `static constexpr VertexFormat format`, usually built
+	// with VG_VERTEX_ATTRIBUTE so offsets and formats follow the struct definition.
+	template<typename V> struct VertexTraits;
+
+	template<typename V> constexpr VertexFormat vertexFormatOf() {
+		constexpr VertexFormat format = VertexTraits<V>::format;
+		static_assert(format.stride == sizeof(V), "vertex format stride must be the size of the vertex");
+		static_assert(format.valid(), "vertex format needs a position, aligned attributes and offsets below 256");
+		return format;
+	}
+}
@@ -0,0 +1,430 @@
+#pragma once
+#include "context.h"
+#include "geometryBuffer.h"
+#include "state/feedbackRenderState.h"
+#include <util/virtualTexture.h>
+#include <core/log.h>
+#include <unordered_set>
+
+namespace vg
+{
+	struct VirtualTextureStats
+	{
+		uint32_t residentPages = 0;
+		uint32_t pages = 0;
+		uint32_t requests = 0;
+		uint32_t loading = 0;
+		uint32_t uploads = 0;
+	};
+
+	// Streams the tiles of virtual textures into one physical page cache of fixed size, so
+	// resident memory does not depend on how large the textures are:
+	//   1. the feedback pass writes the tile every pixel needs into a small readback buffer
+	//   2. a frame later, when the GPU is done with it, the ids are deduplicated, pages in
+	//      use are touched and missing tiles are queued, coarse levels first
+	//   3. worker threads read the tiles from their TileSource
+	//   4. back on the render thread, each tile takes the least recently used page and the
+	//      indirection texture is patched to point at it
+	// Nothing waits on the GPU; until a tile arrives the shader samples its nearest resident
+	// ancestor.
+	class VirtualTextureManager
+	{
+	public:
+		static constexpr uint32_t tileSize = 128;
+		static constexpr uint32_t border = 1;
+		static constexpr uint32_t pageSize = tileSize + border * 2;
+		// 32 x 32 pages of 130 x 130 RGBA8 texels, 69 MB
+		static constexpr uint32_t pagesPerSide = 32;
+		static constexpr uint32_t maxLoads = 32;
+	private:
+		// std140 layout of the VirtualTexture block in virtualTextureShader
+		struct Params
+		{
+			uint32_t size[2];
+			uint32_t tiles[2];
+			float tileSize;
+			float border;
+			float pages;
+			float maxLevel;
+		};
+
+		static_assert(sizeof(PageTable::Entry) == 4, "page table entries are uploaded as RGBA8 texels");
+
+		struct Texture
+		{
+			uint32_t id = 0;
+			std::unique_ptr<TileSource> source;
+			PageTable table;
+			vk::Image indirection;
+			vk::Buffer params;
+			vk::DescriptorSet set;
+		};
+
+		struct Readback
+		{
+			vk::Buffer buffer;
+			vk::CommandBuffer cmd;
+			VkExtent2D extent = {};
+			uint64_t frame = 0;
+			bool pending = false;
+		};
+
+		Context_T* context = nullptr;
+		std::unique_ptr<JobGroup> loads;
+
+		vk::DescriptorSetLayout setLayout;
+		vk::Sampler physicalSampler;
+		vk::Sampler indirectionSampler;
+		vk::Image physical;
+		PageCache cache;
+		std::vector<Texture> textures;
+
+		FeedbackRenderState feedback;
+		std::array<Readback, 2> readbacks;
+		uint64_t feedbackKey = 0;
+		uint64_t generation = 0;
+
+		// missing tiles of the last feedback, loaded from nextRequest on
+		std::vector<uint32_t> requests;
+		size_t nextRequest = 0;
+		std::unordered_set<uint32_t> loading;
+		uint32_t uploads = 0;
+
+		std::vector<uint8_t> scratch;
+		std::vector<VkBufferImageCopy> regions;
+		VirtualTextureStats stats;
+	public:
+		VirtualTextureManager() {}
+
+		VirtualTextureManager(const Context& ctx, const vk::DescriptorSetLayout& cameraSetLayout) : context(ctx.get()), loads(std::make_unique<JobGroup>()) {
+			vk::DescriptorSetLayoutMaker dlm;
+			dlm.binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT);
+			dlm.binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT);
+			dlm.binding(2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT);
+			setLayout = dlm.create(ctx->getDevice());
+
+			vk::SamplerMaker sm;
+			sm.magFilter(VK_FILTER_LINEAR).minFilter(VK_FILTER_LINEAR);
+			sm.addressModeU(VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE).addressModeV(VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+			physicalSampler = sm.create(ctx->getDevice());
+			indirectionSampler = vk::SamplerMaker().create(ctx->getDevice());
+
+			feedback = FeedbackRenderState(ctx, cameraSetLayout, setLayout);
+			for (auto& readback : readbacks) {
+				readback.cmd = ctx->createCommandBuffer();
+			}
+		}
+
+		VirtualTextureManager(VirtualTextureManager&&) = default;
+		VirtualTextureManager& operator=(VirtualTextureManager&&) = default;
+
+		~VirtualTextureManager() {
+			waitLoads();
+		}
+
+		// Waits for the tile reads on the job workers; their results are pinned, not placed yet.
+		void waitLoads() {
+			if (loads) {
+				context->getJobs().wait(*loads);
+			}
+		}
+
+		const vk::DescriptorSetLayout& getSetLayout() const { return setLayout; }
+
+		// Slot of texture id as used by GeometryBuffer::virtualTexture, -1 if unknown.
+		int32_t slot(uint32_t id) const {
+			for (size_t i = 0; i < textures.size(); i++) {
+				if (textures[i].id == id) {
+					return static_cast<int32_t>(i);
+				}
+			}
+			return -1;
+		}
+
+		vk::DescriptorSet& getSet(int32_t slot) { return textures[slot].set; }
+
+		size_t size() const { return textures.size(); }
+
+		// Width and height must be powers of two, at least one tile each.
+		bool addTexture(uint32_t id, std::unique_ptr<TileSource> source) {
+			if (slot(id) >= 0) {
+				log_error("Virtual texture id is exist : ", id);
+				return false;
+			}
+			if (textures.size() >= TileId::maxTextures) {
+				log_error("Too many virtual textures : ", id);
+				return false;
+			}
+
+			uint32_t width = source->width();
+			uint32_t height = source->height();
+			auto valid = [](uint32_t size) { return size >= tileSize && size / tileSize <= TileId::maxTiles && (size & (size - 1)) == 0; };
+			if (!valid(width) || !valid(height)) {
+				log_error("Virtual texture size is not supported : ", id, " ", width, "x", height);
+				return false;
+			}
+
+			auto& device = context->getDevice();
+			if (!physical) {
+				// colour space of the first texture decides the cache format
+				uint32_t side = pagesPerSide * pageSize;
+				physical = device->createTexture2D(side, side, 1, source->srgb() ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM);
+				cache = PageCache(pagesPerSide * pagesPerSide);
+			}
+			else if (source->srgb() != (physical->format() == VK_FORMAT_R8G8B8A8_SRGB)) {
+				log_warning("Virtual texture colour space differs from the page cache : ", id);
+			}
+
+			Texture texture;
+			texture.id = id;
+			texture.source = std::move(source);
+			texture.table = PageTable(width / tileSize, height / tileSize);
+			uint32_t levels = texture.table.levelCount();
+			texture.indirection = device->createTexture2D(texture.table.width(0), texture.table.height(0), levels, VK_FORMAT_R8G8B8A8_UINT);
+
+			Params params = { { width, height }, { texture.table.width(0), texture.table.height(0) },
+				float(tileSize), float(border), float(pagesPerSide), float(levels - 1) };
+			texture.params = device->createUniformBuffer(sizeof(Params), true);
+			texture.params->uploadLocal(&params);
+
+			texture.set = context->getDescriptorPool()->createDescriptorSet(setLayout->get());
+			auto updater = vk::DescriptorSetUpdater();
+			updater.beginDescriptorSet(texture.set);
+			updater.beginImages(0, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+			updater.image(physicalSampler, physical->view(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			updater.beginImages(1, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+			updater.image(indirectionSampler, texture.indirection->view(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			updater.beginBuffers(2, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+			updater.buffer(texture.params, 0, sizeof(Params));
+			updater.update(device);
+
+			textures.push_back(std::move(texture));
+			uint32_t slot = static_cast<uint32_t>(textures.size() - 1);
+
+			// the coarsest level is a single tile that stays resident, so every lookup finds a page
+			std::vector<uint8_t> texels(size_t(pageSize) * pageSize * 4);
+			uint32_t root = TileId::pack(slot, levels - 1, 0, 0);
+			bool loaded = textures[slot].source->readTile(levels - 1, 0, 0, tileSize, border, texels.data());
+			int32_t page = place(root, loaded, texels);
+			if (page >= 0) {
+				cache.pin(page);
+			}
+			uploadPageTables();
+			return true;
+		}
+
+		// Reads back finished feedback, queues loads for the missing tiles and uploads the
+		// indirection rows that changed. Call once per frame before the uploads are flushed.
+		void update(const Context& ctx) {
+			stats.uploads = uploads;
+			uploads = 0;
+			if (textures.empty()) {
+				return;
+			}
+
+			uint64_t completed = ctx->getDevice()->completedFrame();
+			for (auto& readback : readbacks) {
+				if (readback.pending && readback.frame <= completed) {
+					readFeedback(ctx, readback);
+					readback.pending = false;
+				}
+			}
+
+			schedule();
+			uploadPageTables();
+
+			stats.residentPages = cache.residentCount();
+			stats.pages = cache.size();
+			stats.requests = static_cast<uint32_t>(requests.size());
+			stats.loading = static_cast<uint32_t>(loading.size());
+		}
+
+		// Submits a feedback pass when key, which describes the view and the scene, changed
+		// since the last one. Goes to the graphics queue ahead of the frame.
+		void submitFeedback(const Context& ctx, vk::DescriptorSet& cameraSet, GeometryManager& geometries, uint64_t key) {
+			if (textures.empty() || key == feedbackKey) {
+				return;
+			}
+
+			Readback* target = nullptr;
+			for (auto& readback : readbacks) {
+				if (!readback.pending) {
+					target = &readback;
+					break;
+				}
+			}
+			if (!target) {
+				// both still in flight; needsFrame() keeps frames coming until one is free
+				return;
+			}
+
+			auto extent = feedback.extent(ctx);
+			VkDeviceSize size = VkDeviceSize(extent.width) * extent.height * sizeof(uint32_t);
+			if (!target->buffer || target->buffer->size() < size) {
+				target->buffer = ctx->getDevice()->create<vk::Buffer_T>(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, vk::MemoryUsage::GPU_TO_CPU);
+			}
+
+			auto& cmd = target->cmd;
+			cmd->begin();
+			feedback.draw(ctx, cmd, cameraSet, geometries, [this](int32_t slot) -> vk::DescriptorSet& { return textures[slot].set; }, target->buffer);
+			cmd->end();
+			ctx->getGraphicsQueue()->submit(cmd);
+
+			target->extent = extent;
+			target->frame = ctx->getDevice()->pendingFrame();
+			target->pending = true;
+			feedbackKey = key;
+		}
+
+		// True while feedback is in flight and has to be read back by a later frame.
+		bool needsFrame() const {
+			for (auto& readback : readbacks) {
+				if (readback.pending) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		const VirtualTextureStats& getStats() const { return stats; }
+	private:
+		void readFeedback(const Context& ctx, Readback& readback) {
+			size_t count = size_t(readback.extent.width) * readback.extent.height;
+			auto ids = static_cast<const uint32_t*>(readback.buffer->map());
+			readback.buffer->invalidate();
+
+			// neighbouring pixels mostly want the same tile; drop those runs before sorting
+			auto unique = ctx->getFrameArena().alloc<uint32_t>(count);
+			size_t n = 0;
+			uint32_t last = TileId::none;
+			for (size_t i = 0; i < count; i++) {
+				if (ids[i] != last && ids[i] != TileId::none) {
+					unique[n++] = ids[i];
+				}
+				last = ids[i];
+			}
+			readback.buffer->unmap();
+			std::sort(unique, unique + n);
+			n = std::unique(unique, unique + n) - unique;
+
+			generation++;
+			requests.clear();
+			nextRequest = 0;
+			for (size_t i = 0; i < n; i++) {
+				uint32_t id = unique[i];
+				uint32_t slot = TileId::texture(id);
+				uint32_t level = TileId::level(id);
+				uint32_t x = TileId::x(id);
+				uint32_t y = TileId::y(id);
+				if (slot >= textures.size()) {
+					continue;
+				}
+				auto& table = textures[slot].table;
+				if (level >= table.levelCount() || x >= table.width(level) || y >= table.height(level)) {
+					continue;
+				}
+
+				// keep whatever page the pixel samples now, the tile itself or a fallback
+				auto& entry = table.entry(level, x, y);
+				if (entry.valid) {
+					cache.touch(entry.pageY * pagesPerSide + entry.pageX, generation);
+				}
+				if (entry.level != level) {
+					requests.push_back(id);
+				}
+			}
+
+			// coarse tiles first: they cover more pixels and are the fallback of finer ones
+			std::sort(requests.begin(), requests.end(), [](uint32_t a, uint32_t b) {
+				return TileId::level(a) != TileId::level(b) ? TileId::level(a) > TileId::level(b) : a < b;
+			});
+		}
+
+		void schedule() {
+			auto& jobs = context->getJobs();
+			while (nextRequest < requests.size() && loading.size() < maxLoads) {
+				uint32_t id = requests[nextRequest++];
+				auto& table = textures[TileId::texture(id)].table;
+				if (table.resident(TileId::level(id), TileId::x(id), TileId::y(id)) || loading.count(id)) {
+					continue;
+				}
+
+				loading.insert(id);
+				context->restartSteadyState();
+				const TileSource* source = textures[TileId::texture(id)].source.get();
+				jobs.run(*loads, [this, id, source] {
+					std::vector<uint8_t> texels(size_t(pageSize) * pageSize * 4);
+					bool loaded = source->readTile(TileId::level(id), TileId::x(id), TileId::y(id), tileSize, border, texels.data());
+					context->getJobs().pin([this, id, loaded, texels = std::move(texels)] {
+						loading.erase(id);
+						place(id, loaded, texels);
+					});
+				});
+			}
+		}
+
+		// Gives a loaded tile a page, evicting the least recently used one. Returns the page
+		// or -1 when the tile is dropped.
+		int32_t place(uint32_t id, bool loaded, const std::vector<uint8_t>& texels) {
+			auto& table = textures[TileId::texture(id)].table;
+			uint32_t level = TileId::level(id);
+			uint32_t x = TileId::x(id);
+			uint32_t y = TileId::y(id);
+			if (!loaded || table.resident(level, x, y)) {
+				return -1;
+			}
+
+			uint32_t evicted = TileId::none;
+			int32_t page = cache.allocate(id, generation, evicted);
+			if (page < 0) {
+				// every page is in view: the cache is too small for this view
+				return -1;
+			}
+			if (evicted != TileId::none) {
+				textures[TileId::texture(evicted)].table.unmap(TileId::level(evicted), TileId::x(evicted), TileId::y(evicted));
+			}
+
+			uint32_t pageX = page % pagesPerSide;
+			uint32_t pageY = page / pagesPerSide;
+			VkBufferImageCopy region = {};
+			region.imageSubresource = physical->getSubresourceLayers(0);
+			region.imageOffset = { int32_t(pageX * pageSize), int32_t(pageY * pageSize), 0 };
+			region.imageExtent = { pageSize, pageSize, 1 };
+			context->getUploader().update(physical, texels.data(), texels.size(), region);
+
+			table.map(level, x, y, pageX, pageY);
+			uploads++;
+			return page;
+		}
+
+		void uploadPageTables() {
+			for (auto& texture : textures) {
+				auto& table = texture.table;
+				scratch.clear();
+				regions.clear();
+				for (uint32_t level = 0; level < table.levelCount(); level++) {
+					auto& rows = table.dirtyRows(level);
+					if (rows.empty()) {
+						continue;
+					}
+
+					uint32_t width = table.width(level);
+					auto begin = reinterpret_cast<const uint8_t*>(table.data(level) + size_t(rows.begin) * width);
+					auto end = reinterpret_cast<const uint8_t*>(table.data(level) + size_t(rows.end) * width);
+
+					VkBufferImageCopy region = {};
+					region.bufferOffset = scratch.size();
+					region.imageSubresource = texture.indirection->getSubresourceLayers(level);
+					region.imageOffset = { 0, int32_t(rows.begin), 0 };
+					region.imageExtent = { width, rows.end - rows.begin, 1 };
+					regions.push_back(region);
+					scratch.insert(scratch.end(), begin, end);
+				}
+				if (!regions.empty()) {
+					context->getUploader().update(texture.indirection, scratch.data(), scratch.size(), regions);
+					table.clearDirty();
+				}
+			}
+		}
+	};
+}
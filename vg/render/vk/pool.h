@@ -0,0 +1,184 @@
+#pragma once
+
+#include <core/log.h>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <mutex>
+#include <memory>
+#include <utility>
+
+namespace vg::vk
+{
+	// Generational reference to a pooled object. It never keeps the object alive and goes
+	// stale once the object is destroyed, even if the slot has been reused since.
+	struct PoolHandle
+	{
+		uint32_t index = ~0u;
+		uint32_t generation = 0;
+
+		bool valid() const { return index != ~0u; }
+		bool operator==(const PoolHandle& o) const { return index == o.index && generation == o.generation; }
+		bool operator!=(const PoolHandle& o) const { return !(*this == o); }
+	};
+
+	// Typed object pool. Objects live in fixed size blocks of slots, so creating thousands of
+	// buffers or descriptor sets costs a block allocation every blockSize objects instead of
+	// one heap allocation each, and walking them stays within a few contiguous blocks.
+	// Blocks come from malloc and are never moved, so pointers stay valid until destroy().
+	template<typename T> class Pool
+	{
+		static constexpr uint32_t blockSize = 64;
+		static constexpr uint32_t none = ~0u;
+
+		struct Slot
+		{
+			alignas(T) unsigned char storage[sizeof(T)];
+			uint32_t index;
+			uint32_t generation;
+			uint32_t nextFree;
+			bool alive;
+		};
+
+		Slot** blocks = nullptr;
+		uint32_t blockCount = 0;
+		uint32_t freeList = none;
+		uint32_t count = 0;
+		mutable std::mutex lock;
+
+		Slot& slot(uint32_t index) const { return blocks[index / blockSize][index % blockSize]; }
+
+		static Slot* slotOf(const T* object) {
+			return reinterpret_cast<Slot*>(const_cast<T*>(object));
+		}
+
+		void grow() {
+			auto grown = static_cast<Slot**>(std::realloc(blocks, sizeof(Slot*) * (blockCount + 1)));
+			auto block = static_cast<Slot*>(std::malloc(sizeof(Slot) * blockSize));
+			if (!grown || !block) {
+				throw std::bad_alloc();
+			}
+			blocks = grown;
+			blocks[blockCount] = block;
+
+			// chain the new slots in order so objects fill a block front to back
+			uint32_t base = blockCount * blockSize;
+			for (uint32_t i = 0; i < blockSize; i++) {
+				Slot& s = block[i];
+				s.index = base + i;
+				s.generation = 0;
+				s.alive = false;
+				s.nextFree = i + 1 < blockSize ? base + i + 1 : freeList;
+			}
+			freeList = base;
+			blockCount++;
+		}
+	public:
+		Pool() {}
+		~Pool() {
+			if (count) {
+				log_warning("pool destroyed with ", count, " live objects");
+			}
+			for (uint32_t i = 0; i < blockCount; i++) {
+				std::free(blocks[i]);
+			}
+			std::free(blocks);
+		}
+
+		Pool(const Pool&) = delete;
+		Pool& operator=(const Pool&) = delete;
+
+		template<typename... Args> T* create(Args&&... args) {
+			Slot* s;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (freeList == none) {
+					grow();
+				}
+				s = &slot(freeList);
+				freeList = s->nextFree;
+				count++;
+			}
+
+			// constructors may create other pooled objects, so they run outside the lock
+			try {
+				new (s->storage) T(std::forward<Args>(args)...);
+			}
+			catch (...) {
+				release(s);
+				throw;
+			}
+			std::lock_guard<std::mutex> guard(lock);
+			s->alive = true;
+			return reinterpret_cast<T*>(s->storage);
+		}
+
+		void destroy(T* object) {
+			if (!object) {
+				return;
+			}
+			Slot* s = slotOf(object);
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				s->alive = false;
+			}
+			object->~T();
+			release(s);
+		}
+
+		PoolHandle handle(const T* object) const {
+			if (!object) {
+				return {};
+			}
+			const Slot* s = slotOf(object);
+			return { s->index, s->generation };
+		}
+
+		// nullptr once the object behind the handle is gone
+		T* get(PoolHandle handle) const {
+			std::lock_guard<std::mutex> guard(lock);
+			if (handle.index >= blockCount * blockSize) {
+				return nullptr;
+			}
+			Slot& s = slot(handle.index);
+			return s.alive && s.generation == handle.generation ? reinterpret_cast<T*>(s.storage) : nullptr;
+		}
+
+		// Visits live objects in storage order. Must not create or destroy objects of this type.
+		template<typename F> void forEach(F&& f) const {
+			std::lock_guard<std::mutex> guard(lock);
+			for (uint32_t b = 0; b < blockCount; b++) {
+				for (uint32_t i = 0; i < blockSize; i++) {
+					Slot& s = blocks[b][i];
+					if (s.alive) {
+						f(*reinterpret_cast<T*>(s.storage));
+					}
+				}
+			}
+		}
+
+		uint32_t size() const { return count; }
+		uint32_t capacity() const { return blockCount * blockSize; }
+	private:
+		void release(Slot* s) {
+			std::lock_guard<std::mutex> guard(lock);
+			s->generation++;
+			s->nextFree = freeList;
+			freeList = s->index;
+			count--;
+		}
+	};
+
+	template<typename T> class PoolDeleter
+	{
+	public:
+		PoolDeleter() {}
+		PoolDeleter(Pool<T>* pool) : pool_(pool) {}
+		void operator()(T* object) const { pool_->destroy(object); }
+	private:
+		Pool<T>* pool_ = nullptr;
+	};
+
+	// Owning pointer into a pool; moves and resets like any unique_ptr.
+	template<typename T> using Pooled = std::unique_ptr<T, PoolDeleter<T>>;
+}
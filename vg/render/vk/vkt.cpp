@@ -21,27 +21,176 @@ namespace vg::vk
 		return std::make_unique<Surface_T>(this, surface_);
 	}
 
-	Device_T::Device_T(VkPhysicalDevice physicalDevice, VkDevice device) : physicalDevice_(physicalDevice), Handle_T(device)
+	Device_T::Device_T(VkPhysicalDevice physicalDevice, VkDevice device, std::vector<std::string> extensions) : physicalDevice_(physicalDevice), extensions_(std::move(extensions)), Handle_T(device), pools_(std::make_unique<Pools>())
 	{
 		VmaAllocatorCreateInfo allocatorInfo = {};
 		allocatorInfo.physicalDevice = physicalDevice;
 		allocatorInfo.device = device;
 
 		VK_CHECK_RESULT(vmaCreateAllocator(&allocatorInfo, &allocator_));
+		garbage_.reserve(64);
+		loadPipelineCache({});
+	}
+
+	Device_T::~Device_T()
+	{
+		vkDeviceWaitIdle(handle_);
+		flushGarbage();
+		vkDestroyPipelineCache(handle_, pipelineCache_, nullptr);
+		vkDestroyDevice(handle_, nullptr);
+	}
+
+	void Device_T::loadPipelineCache(const std::vector<uint8_t>& data)
+	{
+		if (pipelineCache_ != VK_NULL_HANDLE) {
+			vkDestroyPipelineCache(handle_, pipelineCache_, nullptr);
+			pipelineCache_ = VK_NULL_HANDLE;
+		}
+
+		// Some drivers crash on truncated or foreign data instead of rejecting it, so the
+		// header must name this device before any of it is handed over.
+		bool usable = false;
+		VkPipelineCacheHeaderVersionOne header = {};
+		if (data.size() >= sizeof(header)) {
+			std::memcpy(&header, data.data(), sizeof(header));
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(physicalDevice_, &properties);
+			usable = header.headerSize >= sizeof(header) && header.headerSize <= data.size() &&
+				header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+				header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+				std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+		}
+		if (!data.empty() && !usable) {
+			log_warning("pipeline cache is from another device or damaged, starting empty");
+		}
+
+		// a failure here only costs the warm start
+		VkPipelineCacheCreateInfo info = { VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+		info.initialDataSize = usable ? data.size() : 0;
+		info.pInitialData = usable ? data.data() : nullptr;
+		if (vkCreatePipelineCache(handle_, &info, nullptr, &pipelineCache_) != VK_SUCCESS && usable) {
+			log_warning("pipeline cache rejected, starting empty");
+			info.initialDataSize = 0;
+			info.pInitialData = nullptr;
+			VK_CHECK_RESULT(vkCreatePipelineCache(handle_, &info, nullptr, &pipelineCache_));
+		}
+	}
+
+	std::vector<uint8_t> Device_T::savePipelineCache() const
+	{
+		size_t size = 0;
+		VK_CHECK_RESULT(vkGetPipelineCacheData(handle_, pipelineCache_, &size, nullptr));
+		std::vector<uint8_t> data(size);
+		VK_CHECK_RESULT(vkGetPipelineCacheData(handle_, pipelineCache_, &size, data.data()));
+		data.resize(size);
+		return data;
+	}
+
+	void Device_T::completeFrame(uint64_t frame) const
+	{
+		if (frame > completedFrame_) {
+			completedFrame_ = frame;
+		}
+
+		size_t kept = 0;
+		for (size_t i = 0; i < garbage_.size(); i++) {
+			if (garbage_[i].frame <= completedFrame_) {
+				destroy(garbage_[i]);
+			}
+			else {
+				garbage_[kept++] = garbage_[i];
+			}
+		}
+		garbage_.resize(kept);
+	}
+
+	void Device_T::retire(const Garbage& garbage) const
+	{
+		// Nothing submitted since the last completed frame can still reference it.
+		if (submittedFrame_ <= completedFrame_) {
+			destroy(garbage);
+			return;
+		}
+		garbage_.push_back(garbage);
+		garbage_.back().frame = submittedFrame_;
+	}
+
+	void Device_T::retire(VkBuffer buffer, VmaAllocation allocation) const
+	{
+		Garbage g;
+		g.buffer = buffer;
+		g.allocation = allocation;
+		retire(g);
+	}
+
+	void Device_T::retire(VkImage image, VkImageView view, VmaAllocation allocation) const
+	{
+		Garbage g;
+		g.image = image;
+		g.view = view;
+		g.allocation = allocation;
+		retire(g);
+	}
+
+	void Device_T::retire(VkFramebuffer frameBuffer) const
+	{
+		Garbage g;
+		g.frameBuffer = frameBuffer;
+		retire(g);
+	}
+
+	void Device_T::retire(VkPipeline pipeline) const
+	{
+		Garbage g;
+		g.pipeline = pipeline;
+		retire(g);
+	}
+
+	void Device_T::retire(VkSwapchainKHR swapchain) const
+	{
+		Garbage g;
+		g.swapchain = swapchain;
+		retire(g);
+	}
+
+	void Device_T::destroy(const Garbage& g) const
+	{
+		if (g.frameBuffer) {
+			vkDestroyFramebuffer(handle_, g.frameBuffer, nullptr);
+		}
+		if (g.pipeline) {
+			vkDestroyPipeline(handle_, g.pipeline, nullptr);
+		}
+		if (g.view) {
+			vkDestroyImageView(handle_, g.view, nullptr);
+		}
+		if (g.image && g.allocation) {
+			vmaDestroyImage(allocator_, g.image, g.allocation);
+		}
+		if (g.buffer) {
+			vmaDestroyBuffer(allocator_, g.buffer, g.allocation);
+		}
+		if (g.swapchain) {
+			vkDestroySwapchainKHR(handle_, g.swapchain, nullptr);
+		}
 	}
 
 	Buffer Device_T::createUniformBuffer(VkDeviceSize size, VkBool32 dynamic)
 	{
-		return std::make_unique<Buffer_T>(this, size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, dynamic ? MemoryUsage::CPU_TO_GPU : MemoryUsage::GPU_ONLY);
+		return create<Buffer_T>(size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, dynamic ? MemoryUsage::CPU_TO_GPU : MemoryUsage::GPU_ONLY);
 	}
 
 	Buffer Device_T::createVertexBuffer(VkDeviceSize size, VkBool32 dynamic)
 	{
-		return std::make_unique<Buffer_T>(this, size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, dynamic ? MemoryUsage::CPU_TO_GPU : MemoryUsage::GPU_ONLY);
+		return create<Buffer_T>(size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, dynamic ? MemoryUsage::CPU_TO_GPU : MemoryUsage::GPU_ONLY);
 	}
 	Buffer Device_T::createIndexBuffer(VkDeviceSize size, VkBool32 dynamic)
 	{
-		return std::make_unique<Buffer_T>(this, size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, dynamic ? MemoryUsage::CPU_TO_GPU : MemoryUsage::GPU_ONLY);
+		return create<Buffer_T>(size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, dynamic ? MemoryUsage::CPU_TO_GPU : MemoryUsage::GPU_ONLY);
+	}
+	Buffer Device_T::createStorageBuffer(VkDeviceSize size, VkBufferUsageFlags extraUsage)
+	{
+		return create<Buffer_T>(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | extraUsage, MemoryUsage::GPU_ONLY);
 	}
 
 	void Queue_T::submit(ArrayProxy<const VkCommandBuffer> cmds, ArrayProxy<const VkSemaphore> wait, ArrayProxy<const VkSemaphore> signal, VkFence fence, VkPipelineStageFlags waitStage) 
@@ -238,10 +387,14 @@ namespace vg::vk
 		case VK_FORMAT_BC2_SRGB_BLOCK:return BlockParams{ 4, 4, 16 };
 		case VK_FORMAT_BC3_UNORM_BLOCK:return BlockParams{ 4, 4, 16 };
 		case VK_FORMAT_BC3_SRGB_BLOCK:return BlockParams{ 4, 4, 16 };
-		case VK_FORMAT_BC4_UNORM_BLOCK:return BlockParams{ 4, 4, 16 };
-		case VK_FORMAT_BC4_SNORM_BLOCK:return BlockParams{ 4, 4, 16 };
+		case VK_FORMAT_BC4_UNORM_BLOCK:return BlockParams{ 4, 4, 8 };
+		case VK_FORMAT_BC4_SNORM_BLOCK:return BlockParams{ 4, 4, 8 };
 		case VK_FORMAT_BC5_UNORM_BLOCK:return BlockParams{ 4, 4, 16 };
 		case VK_FORMAT_BC5_SNORM_BLOCK:return BlockParams{ 4, 4, 16 };
+		case VK_FORMAT_BC6H_UFLOAT_BLOCK:return BlockParams{ 4, 4, 16 };
+		case VK_FORMAT_BC6H_SFLOAT_BLOCK:return BlockParams{ 4, 4, 16 };
+		case VK_FORMAT_BC7_UNORM_BLOCK:return BlockParams{ 4, 4, 16 };
+		case VK_FORMAT_BC7_SRGB_BLOCK:return BlockParams{ 4, 4, 16 };
 		}
 		return BlockParams{ 0, 0, 0 };
 	}
@@ -263,12 +416,8 @@ namespace vg::vk
 
 	Image_T::~Image_T()
 	{
-		if (view_) {
-			vkDestroyImageView(*device_, view_, nullptr);
-		}
-		if (handle_ && allocation_) {
-			vmaDestroyImage(device_->allocator(), handle_, allocation_);
-		}
+		// swapchain images are owned by the swapchain, only the view is ours
+		device_->retire(allocation_ ? handle_ : VK_NULL_HANDLE, view_, allocation_);
 	}
 
 	void Image_T::upload(CommandBuffer& cmd, const Buffer& staging)
@@ -282,9 +431,63 @@ namespace vg::vk
 		setLayout(cmd, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	}
 
+	void Image_T::upload(CommandBuffer& cmd, const Buffer& staging, ArrayProxy<const VkBufferImageCopy> regions)
+	{
+		setLayout(cmd, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		cmd->copyBufferToImage(*staging, handle_, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, regions);
+	}
+
+	void Image_T::generateMipmaps(CommandBuffer& cmd, uint32_t filledLevels)
+	{
+		assert(layout_ == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+		VkImageMemoryBarrier barrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = handle_;
+
+		// every level is moved to TRANSFER_SRC once written, and missing levels are blitted
+		// from the one above
+		for (uint32_t level = 1; level < info_.mipLevels; level++) {
+			barrier.subresourceRange = getSubresourceRange(level - 1, 1, 0, info_.arrayLayers);
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			cmd->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, {}, {}, barrier);
+			if (level < filledLevels) {
+				continue;
+			}
+
+			VkImageBlit blit = {};
+			blit.srcSubresource = getSubresourceLayers(level - 1, 0, info_.arrayLayers);
+			blit.srcOffsets[1] = { int32_t(std::max(info_.extent.width >> (level - 1), 1u)), int32_t(std::max(info_.extent.height >> (level - 1), 1u)), 1 };
+			blit.dstSubresource = getSubresourceLayers(level, 0, info_.arrayLayers);
+			blit.dstOffsets[1] = { int32_t(std::max(info_.extent.width >> level, 1u)), int32_t(std::max(info_.extent.height >> level, 1u)), 1 };
+			vkCmdBlitImage(cmd->get(), handle_, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, handle_, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+		}
+
+		// all but the last level are TRANSFER_SRC now, the last one is still TRANSFER_DST
+		uint32_t sourceLevels = info_.mipLevels - 1;
+		std::array<VkImageMemoryBarrier, 2> barriers = { barrier, barrier };
+		barriers[0].subresourceRange = getSubresourceRange(0, sourceLevels, 0, info_.arrayLayers);
+		barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barriers[1].subresourceRange = getSubresourceRange(sourceLevels, info_.mipLevels - sourceLevels, 0, info_.arrayLayers);
+		barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		for (auto& b : barriers) {
+			b.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			b.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		}
+		uint32_t first = sourceLevels ? 0 : 1;
+		cmd->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, {}, {}, ArrayProxy<const VkImageMemoryBarrier>(2 - first, barriers.data() + first));
+		layout_ = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+
 	void Image_T::upload(CommandPool& pool, Queue& queue, const void* value) {
 		auto size = getBlockParams(info_.format).bytesPerBlock * info_.extent.width * info_.extent.height;
-		auto staging = std::make_unique<Buffer_T>(device_, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::CPU_ONLY);
+		auto staging = device_->create<Buffer_T>(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::CPU_ONLY);
 		staging->uploadLocal(value);
 
 		auto cmd = pool->createCommandBuffer();
@@ -306,7 +509,11 @@ namespace vg::vk
 		info.imageType = VK_IMAGE_TYPE_2D;
 		info.tiling = VK_IMAGE_TILING_OPTIMAL;
 		info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-		return std::make_unique<Image_T>(this, info, MemoryUsage::GPU_ONLY);
+		if (mipLevels > 1) {
+			// generateMipmaps blits between the levels
+			info.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		}
+		return create<Image_T>(info, MemoryUsage::GPU_ONLY);
 	}
 
 	Image Device_T::createDepthStencilAttachment(uint32_t width, uint32_t height, VkSampleCountFlagBits sample, VkFormat format)
@@ -320,7 +527,7 @@ namespace vg::vk
 		info.imageType = VK_IMAGE_TYPE_2D;
 		info.tiling = VK_IMAGE_TILING_OPTIMAL;
 		info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-		return std::make_unique<Image_T>(this, info, MemoryUsage::GPU_ONLY);
+		return create<Image_T>(info, MemoryUsage::GPU_ONLY);
 	}
 
 	Image Device_T::createColorAttachment(uint32_t width, uint32_t height, VkSampleCountFlagBits sample, VkFormat format)
@@ -334,7 +541,7 @@ namespace vg::vk
 		info.imageType = VK_IMAGE_TYPE_2D;
 		info.tiling = VK_IMAGE_TILING_OPTIMAL;
 		info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-		return std::make_unique<Image_T>(this, info, MemoryUsage::GPU_ONLY);
+		return create<Image_T>(info, MemoryUsage::GPU_ONLY);
 	}
 
 	Image Device_T::createTransferImage(uint32_t width, uint32_t height, VkFormat format)
@@ -348,7 +555,7 @@ namespace vg::vk
 		info.imageType = VK_IMAGE_TYPE_2D;
 		info.tiling = VK_IMAGE_TILING_LINEAR;
 		info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-		return std::make_unique<Image_T>(this, info, MemoryUsage::CPU_ONLY, ViewType::NONE);
+		return create<Image_T>(info, MemoryUsage::CPU_ONLY, ViewType::NONE);
 	}
 
 	void Image_T::setupView(VkImageViewType viewType)
@@ -498,7 +705,7 @@ namespace vg::vk
 		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 		for (auto& image : images)
 		{
-			images_.emplace_back(std::make_unique<Image_T>(device_, imageInfo, image));
+			images_.emplace_back(device_->create<Image_T>(imageInfo, image));
 		}
 		return true;
 	}
@@ -519,7 +726,7 @@ namespace vg::vk
 
 	Buffer_T::~Buffer_T()
 	{
-		vmaDestroyBuffer(device_->allocator(), handle_, allocation_);
+		device_->retire(handle_, allocation_);
 	}
 
 	void Buffer_T::uploadLocal(const void* value)
@@ -539,7 +746,7 @@ namespace vg::vk
 
 	void Buffer_T::upload(CommandPool& pool, Queue& queue, const void* value)
 	{
-		auto staging = std::make_unique<Buffer_T>(device_, size_, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::CPU_ONLY);
+		auto staging = device_->create<Buffer_T>(size_, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::CPU_ONLY);
 		staging->uploadLocal(value);
 
 		auto cmd = pool->createCommandBuffer();
@@ -564,13 +771,17 @@ namespace vg::vk
 	{
 		vmaFlushAllocation(device_->allocator(), allocation_, 0, VK_WHOLE_SIZE);
 	}
+	void Buffer_T::invalidate()
+	{
+		vmaInvalidateAllocation(device_->allocator(), allocation_, 0, VK_WHOLE_SIZE);
+	}
 
-	CommandBuffer_T::CommandBuffer_T(const Device_T* device, const CommandPool_T* pool) : device_(device), pool_(pool) 
+	CommandBuffer_T::CommandBuffer_T(const Device_T* device, const CommandPool_T* pool, VkCommandBufferLevel level) : device_(device), pool_(pool) 
 	{
 		VkCommandBufferAllocateInfo info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
 		info.commandBufferCount = 1;
 		info.commandPool = pool_->get();
-		info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		info.level = level;
 		VK_CHECK_RESULT(vkAllocateCommandBuffers(*device_, &info, &handle_));
 	}
 	CommandBuffer_T::~CommandBuffer_T() 
@@ -592,7 +803,7 @@ namespace vg::vk
 		return shaderc_shader_kind();
 	}
 
-	PipelineMaker& PipelineMaker::shaderGLSL(VkShaderStageFlagBits stage, const std::string& src) {
+	std::vector<uint32_t> compileGLSL(VkShaderStageFlagBits stage, const std::string& src) {
 		shaderc_compiler_t compiler = shaderc_compiler_initialize();
 		auto result = shaderc_compile_into_spv(
 			compiler, src.c_str(), src.size(),
@@ -604,14 +815,18 @@ namespace vg::vk
 		}
 
 		auto length = shaderc_result_get_length(result);
-		auto bytes = (uint32_t*)shaderc_result_get_bytes(result);
-
-		shader(stage, length, bytes);
+		auto bytes = (const uint32_t*)shaderc_result_get_bytes(result);
+		std::vector<uint32_t> code(bytes, bytes + length / sizeof(uint32_t));
 
 		shaderc_result_release(result);
 		shaderc_compiler_release(compiler);
 
-		return *this;
+		return code;
+	}
+
+	PipelineMaker& PipelineMaker::shaderGLSL(VkShaderStageFlagBits stage, const std::string& src) {
+		auto code = compileGLSL(stage, src);
+		return shader(stage, code.size() * sizeof(uint32_t), code.data());
 	}
 
 } // namespace vg::vk
@@ -6,10 +6,16 @@
 #endif
 
 #include <core/log.h>
+#include <render/vertexFormat.h>
+#include "pool.h"
 #include <vector>
 #include <array>
+#include <cstring>
 #include <assert.h>
 #include <memory>
+#include <tuple>
+#include <algorithm>
+#include <string>
 
 #include <vulkan/vulkan.h>
 
@@ -31,33 +37,35 @@ namespace vg::vk
 	class DescriptorPool_T;
 	using DescriptorPool = std::unique_ptr<DescriptorPool_T>;
 	class Image_T;
-	using Image = std::unique_ptr<Image_T>;
+	using Image = Pooled<Image_T>;
 	class Swapchain_T;
 	using Swapchain = std::unique_ptr<Swapchain_T>;
 	class RenderPass_T;
-	using RenderPass = std::unique_ptr<RenderPass_T>;
+	using RenderPass = Pooled<RenderPass_T>;
 	class Pipeline_T;
-	using Pipeline = std::unique_ptr<Pipeline_T>;
+	using Pipeline = Pooled<Pipeline_T>;
 	class DescriptorSetLayout_T;
-	using DescriptorSetLayout = std::unique_ptr<DescriptorSetLayout_T>;
+	using DescriptorSetLayout = Pooled<DescriptorSetLayout_T>;
 	class DescriptorSet_T;
-	using DescriptorSet = std::unique_ptr<DescriptorSet_T>;
+	using DescriptorSet = Pooled<DescriptorSet_T>;
 	class PipelineLayout_T;
-	using PipelineLayout = std::unique_ptr<PipelineLayout_T>;
+	using PipelineLayout = Pooled<PipelineLayout_T>;
 	class FrameBuffer_T;
-	using FrameBuffer = std::unique_ptr<FrameBuffer_T>;
+	using FrameBuffer = Pooled<FrameBuffer_T>;
 	class Fence_T;
-	using Fence = std::unique_ptr<Fence_T>;
+	using Fence = Pooled<Fence_T>;
 	class Semaphore_T;
-	using Semaphore = std::unique_ptr<Semaphore_T>;
+	using Semaphore = Pooled<Semaphore_T>;
 	class Buffer_T;
-	using Buffer = std::unique_ptr<Buffer_T>;
+	using Buffer = Pooled<Buffer_T>;
 	class Sampler_T;
-	using Sampler = std::unique_ptr<Sampler_T>;
+	using Sampler = Pooled<Sampler_T>;
 	class CommandPool_T;
 	using CommandPool = std::unique_ptr<CommandPool_T>;
 	class CommandBuffer_T;
-	using CommandBuffer = std::unique_ptr<CommandBuffer_T>;
+	using CommandBuffer = Pooled<CommandBuffer_T>;
+	class QueryPool_T;
+	using QueryPool = std::unique_ptr<QueryPool_T>;
 
 #define VK_CHECK_RESULT(result) assert(VK_SUCCESS == result);
 
@@ -92,6 +100,33 @@ namespace vg::vk
 		T* m_ptr;
 	};
 
+	// Per command buffer counters, reset by CommandBuffer_T::begin().
+	struct CommandStats
+	{
+		uint32_t draws = 0;
+		uint64_t triangles = 0;
+		uint32_t instances = 0;
+		uint32_t pipelineBinds = 0;
+		uint32_t descriptorBinds = 0;
+		uint32_t vertexBufferBinds = 0;
+		uint32_t indexBufferBinds = 0;
+		uint32_t pushConstantBytes = 0;
+		uint32_t skipped = 0;
+
+		CommandStats& operator+=(const CommandStats& o) {
+			draws += o.draws;
+			triangles += o.triangles;
+			instances += o.instances;
+			pipelineBinds += o.pipelineBinds;
+			descriptorBinds += o.descriptorBinds;
+			vertexBufferBinds += o.vertexBufferBinds;
+			indexBufferBinds += o.indexBufferBinds;
+			pushConstantBytes += o.pushConstantBytes;
+			skipped += o.skipped;
+			return *this;
+		}
+	};
+
 	template<typename Type> class Handle_T
 	{
 	public:
@@ -204,8 +239,8 @@ namespace vg::vk
 	class Device_T : public Handle_T<VkDevice>
 	{
 	public:
-		Device_T(VkPhysicalDevice physicalDevice, VkDevice device);
-		~Device_T() { vkDestroyDevice(handle_, nullptr); }
+		Device_T(VkPhysicalDevice physicalDevice, VkDevice device, std::vector<std::string> extensions = {});
+		~Device_T();
 		VmaAllocator allocator() const { return allocator_; }
 		operator VkPhysicalDevice() const { return physicalDevice_; }
 
@@ -225,6 +260,23 @@ namespace vg::vk
 			return capabilities;
 		}
 
+		bool supportsFormat(VkFormat format, VkFormatFeatureFlags features) const {
+			VkFormatProperties properties;
+			vkGetPhysicalDeviceFormatProperties(physicalDevice_, format, &properties);
+			return (properties.optimalTilingFeatures & features) == features;
+		}
+
+		// enabled when the device was created
+		bool hasExtension(const char* name) const {
+			return std::find(extensions_.begin(), extensions_.end(), name) != extensions_.end();
+		}
+
+		// Pipelines can be built from separately compiled parts and linked quickly, see
+		// PipelineMaker::createLibrary.
+		bool graphicsPipelineLibrary() const {
+			return hasExtension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+		}
+
 		VkPhysicalDeviceProperties getPhysicalDeviceProperties() {
 			VkPhysicalDeviceProperties prop;
 			vkGetPhysicalDeviceProperties(physicalDevice_, &prop);
@@ -240,7 +292,7 @@ namespace vg::vk
 		}
 
 		FrameBuffer createFrameBuffer(const RenderPass& renderPass, uint32_t width, uint32_t height, ArrayProxy<const VkImageView> attachments) {
-			return std::make_unique<FrameBuffer_T>(this, renderPass.get(), width, height, attachments);
+			return create<FrameBuffer_T>(renderPass.get(), width, height, attachments);
 		}
 
 		Swapchain createSwapchain(const Surface& surface) {
@@ -248,11 +300,15 @@ namespace vg::vk
 		}
 
 		Fence createFence() {
-			return std::make_unique<Fence_T>(this);
+			return create<Fence_T>();
 		}
 
 		Semaphore createSemaphore() {
-			return std::make_unique<Semaphore_T>(this);
+			return create<Semaphore_T>();
+		}
+
+		QueryPool createQueryPool(VkQueryType type, uint32_t count) {
+			return std::make_unique<QueryPool_T>(this, type, count);
 		}
 
 		Queue getQueue(uint32_t familyIndex,uint32_t index = 0) {
@@ -281,12 +337,66 @@ namespace vg::vk
 		Image createColorAttachment(uint32_t width, uint32_t height, VkSampleCountFlagBits sample = VK_SAMPLE_COUNT_1_BIT, VkFormat format = VK_FORMAT_B8G8R8A8_UNORM);
 		Image createTransferImage(uint32_t width, uint32_t height, VkFormat format = VK_FORMAT_B8G8R8A8_UNORM);
 
+		// Every pipeline is created through this cache. Its contents can be saved and handed
+		// back on the next run, which turns most pipeline compiles into lookups.
+		VkPipelineCache pipelineCache() const { return pipelineCache_; }
+		void loadPipelineCache(const std::vector<uint8_t>& data);
+		std::vector<uint8_t> savePipelineCache() const;
+
+		// Wrappers live in per type pools owned by the device, see pool.h. The device is passed
+		// to the constructor ahead of args. Pooled objects must be gone before the device is.
+		template<typename T, typename... Args> Pooled<T> create(Args&&... args) const;
+		template<typename T> Pool<T>& pool() const;
+
 		Buffer createUniformBuffer(VkDeviceSize size, VkBool32 dynamic = false);
 		Buffer createVertexBuffer(VkDeviceSize size, VkBool32 dynamic = false);
 		Buffer createIndexBuffer(VkDeviceSize size, VkBool32 dynamic = false);
+		// Also usable for the extra usage, e.g. a storage buffer that is bound as vertex buffer too.
+		Buffer createStorageBuffer(VkDeviceSize size, VkBufferUsageFlags extraUsage = 0);
+
+		// Deferred destruction. Wrappers hand their handles over here instead of destroying
+		// them, and they are released once every frame submitted before the hand-over has
+		// completed. Returns the frame number to pass to completeFrame().
+		uint64_t submitFrame() { return ++submittedFrame_; }
+		void completeFrame(uint64_t frame) const;
+		void flushGarbage() const { completeFrame(submittedFrame_); }
+
+		// Frame that work recorded now will be part of, and the last frame known complete.
+		uint64_t pendingFrame() const { return submittedFrame_ + 1; }
+		uint64_t completedFrame() const { return completedFrame_; }
+
+		void retire(VkBuffer buffer, VmaAllocation allocation) const;
+		void retire(VkImage image, VkImageView view, VmaAllocation allocation) const;
+		void retire(VkFramebuffer frameBuffer) const;
+		void retire(VkPipeline pipeline) const;
+		void retire(VkSwapchainKHR swapchain) const;
 	private:
+		struct Garbage
+		{
+			uint64_t frame = 0;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkImage image = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			VkFramebuffer frameBuffer = VK_NULL_HANDLE;
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+			VmaAllocation allocation = VK_NULL_HANDLE;
+		};
+
+		void retire(const Garbage& garbage) const;
+		void destroy(const Garbage& garbage) const;
+
+		struct Pools;
+
 		VkPhysicalDevice physicalDevice_;
+		std::vector<std::string> extensions_;
 		VmaAllocator allocator_;
+		VkPipelineCache pipelineCache_ = VK_NULL_HANDLE;
+		std::unique_ptr<Pools> pools_;
+
+		uint64_t submittedFrame_ = 0;
+		mutable uint64_t completedFrame_ = 0;
+		mutable std::vector<Garbage> garbage_;
 	};
 
 	class Queue_T : public Handle_T<VkQueue>
@@ -337,7 +447,7 @@ namespace vg::vk
 		~DescriptorPool_T() { vkDestroyDescriptorPool(*device_, handle_, nullptr); }
 
 		DescriptorSet createDescriptorSet(ArrayProxy<const VkDescriptorSetLayout> layouts) {
-			return std::make_unique<DescriptorSet_T>(device_, this, layouts);
+			return device_->create<DescriptorSet_T>(this, layouts);
 		}
 	private:
 		const Device_T* device_;
@@ -356,10 +466,20 @@ namespace vg::vk
 		void upload(CommandBuffer& cmd, const Buffer& staging);
 		void upload(CommandPool& pool, Queue& queue, const void* value);
 
+		// Copies the regions and leaves the image in TRANSFER_DST, for generateMipmaps or setLayout.
+		void upload(CommandBuffer& cmd, const Buffer& staging, ArrayProxy<const VkBufferImageCopy> regions);
+
+		// Fills levels [filledLevels, mipLevels) by blitting down from the level above, then moves
+		// the whole image to SHADER_READ_ONLY. Expects TRANSFER_DST and a linear-blittable format.
+		void generateMipmaps(CommandBuffer& cmd, uint32_t filledLevels = 1);
+
 		void* map();
 		void unmap();
 
 		VkDeviceSize size() const;
+		VkFormat format() const { return info_.format; }
+		VkExtent3D extent() const { return info_.extent; }
+		uint32_t mipLevels() const { return info_.mipLevels; }
 
 		VkImageSubresourceLayers getSubresourceLayers(uint32_t mipLevel, uint32_t baseArrayLayer = 0, uint32_t layerCount = 1) const;
 		VkImageSubresourceRange getSubresourceRange() const;
@@ -382,7 +502,10 @@ namespace vg::vk
 
 		void destroy() {
 			images_.swap(std::vector<Image>());
-			vkDestroySwapchainKHR(*device_, handle_, nullptr);
+			if (handle_ != VK_NULL_HANDLE) {
+				device_->retire(handle_);
+				handle_ = VK_NULL_HANDLE;
+			}
 		}
 
 		bool reCreate();
@@ -404,14 +527,24 @@ namespace vg::vk
 	{
 	public:
 		Pipeline_T(const Device_T* device, const VkGraphicsPipelineCreateInfo& info) : device_(device) {
-			VK_CHECK_RESULT(vkCreateGraphicsPipelines(*device_, VkPipelineCache(), 1, &info, nullptr, &handle_));
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(*device_, device_->pipelineCache(), 1, &info, nullptr, &handle_));
+			if (info.pInputAssemblyState) topology_ = info.pInputAssemblyState->topology;
+			for (uint32_t i = 0; info.pDynamicState && i < info.pDynamicState->dynamicStateCount; i++) {
+				auto state = info.pDynamicState->pDynamicStates[i];
+				if (state <= VK_DYNAMIC_STATE_STENCIL_REFERENCE) dynamic_ |= 1u << state;
+			}
 		}
 		Pipeline_T(const Device_T* device, const VkComputePipelineCreateInfo& info) : device_(device) {
-			VK_CHECK_RESULT(vkCreateComputePipelines(*device_, VkPipelineCache(), 1, &info, nullptr, &handle_));
+			VK_CHECK_RESULT(vkCreateComputePipelines(*device_, device_->pipelineCache(), 1, &info, nullptr, &handle_));
 		}
-		~Pipeline_T() { vkDestroyPipeline(*device_, handle_, nullptr); }
+		~Pipeline_T() { device_->retire(handle_); }
+
+		VkPrimitiveTopology topology() const { return topology_; }
+		bool isDynamic(VkDynamicState state) const { return state <= VK_DYNAMIC_STATE_STENCIL_REFERENCE && (dynamic_ & (1u << state)); }
 	private:
 		const Device_T* device_;
+		VkPrimitiveTopology topology_ = VK_PRIMITIVE_TOPOLOGY_MAX_ENUM;
+		uint32_t dynamic_ = 0;
 	};
 
 	class DescriptorSetLayout_T : public Handle_T<VkDescriptorSetLayout>
@@ -466,7 +599,7 @@ namespace vg::vk
 
 			VK_CHECK_RESULT(vkCreateFramebuffer(*device_, &info, nullptr, &handle_));
 		}
-		~FrameBuffer_T() { vkDestroyFramebuffer(*device_, handle_, nullptr); }
+		~FrameBuffer_T() { device_->retire(handle_); }
 	private:
 		const Device_T* device_;
 	};
@@ -496,6 +629,30 @@ namespace vg::vk
 		const Device_T* device_;
 	};
 
+	// Queries are reset and written from command buffers; results are read on the host
+	// once the submission that wrote them is known to be complete.
+	class QueryPool_T : public Handle_T<VkQueryPool>
+	{
+	public:
+		QueryPool_T(const Device_T* device, VkQueryType type, uint32_t count) : device_(device), count_(count) {
+			VkQueryPoolCreateInfo info = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+			info.queryType = type;
+			info.queryCount = count;
+			VK_CHECK_RESULT(vkCreateQueryPool(*device_, &info, nullptr, &handle_));
+		}
+		~QueryPool_T() { vkDestroyQueryPool(*device_, handle_, nullptr); }
+
+		// False while any of the queries has no result yet; does not wait.
+		bool results(uint32_t first, uint32_t count, uint64_t* values) const {
+			return vkGetQueryPoolResults(*device_, handle_, first, count, sizeof(uint64_t) * count, values, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS;
+		}
+
+		uint32_t size() const { return count_; }
+	private:
+		const Device_T* device_;
+		uint32_t count_;
+	};
+
 	class Buffer_T : public Handle_T<VkBuffer>
 	{
 	public:
@@ -509,6 +666,7 @@ namespace vg::vk
 		void* map();
 		void unmap();
 		void flush();
+		void invalidate();
 
 		VkDeviceSize size() const { return size_; }
 	private:
@@ -531,7 +689,7 @@ namespace vg::vk
 	class CommandBuffer_T : public Handle_T<VkCommandBuffer>
 	{
 	public:
-		CommandBuffer_T(const Device_T* device, const CommandPool_T* pool);
+		CommandBuffer_T(const Device_T* device, const CommandPool_T* pool, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 		~CommandBuffer_T();
 
 		void pipelineBarrier(VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, VkDependencyFlags dependencyFlags,
@@ -549,69 +707,190 @@ namespace vg::vk
 			VkCommandBufferBeginInfo info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
 			info.flags = usage;
 			VK_CHECK_RESULT(vkBeginCommandBuffer(handle_, &info));
+			state_ = {};
+			stats_ = {};
+		}
+		// Secondary command buffers executed inside the given render pass; dynamic state is
+		// not inherited from the primary, so viewport and scissor have to be set again.
+		void beginSecondary(const RenderPass& renderPass, uint32_t subpass = 0, VkCommandBufferUsageFlags usage = 0) {
+			VkCommandBufferInheritanceInfo inheritance = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+			inheritance.renderPass = renderPass->get();
+			inheritance.subpass = subpass;
+			VkCommandBufferBeginInfo info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+			info.flags = usage | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			info.pInheritanceInfo = &inheritance;
+			VK_CHECK_RESULT(vkBeginCommandBuffer(handle_, &info));
+			state_ = {};
+			stats_ = {};
 		}
 		void end() {
 			VK_CHECK_RESULT(vkEndCommandBuffer(handle_));
 		}
-		void beginRenderPass(const RenderPass& renderPass,const FrameBuffer& frameBuffer, VkRect2D area, ArrayProxy<const VkClearValue> clear) {
+		void beginRenderPass(const RenderPass& renderPass,const FrameBuffer& frameBuffer, VkRect2D area, ArrayProxy<const VkClearValue> clear, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE) {
 			VkRenderPassBeginInfo info = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
 			info.renderArea = area;
 			info.clearValueCount = clear.size();
 			info.pClearValues = clear.data();
 			info.renderPass = renderPass->get();
 			info.framebuffer = frameBuffer->get();
-			vkCmdBeginRenderPass(handle_, &info, VK_SUBPASS_CONTENTS_INLINE);
+			vkCmdBeginRenderPass(handle_, &info, contents);
 		}
 		void endRenderPass() {
 			vkCmdEndRenderPass(handle_);
 		}
 
+		void executeCommands(ArrayProxy<const VkCommandBuffer> cmds) {
+			vkCmdExecuteCommands(handle_, cmds.size(), cmds.data());
+		}
+
+		// The bind/set functions below shadow the current state and skip calls that would
+		// not change it. The shadow is reset by begin().
 		void bindPipeline(const Pipeline& pipeline, VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS)
 		{
+			if (state_.pipeline == pipeline->get()) {
+				stats_.skipped++;
+				return;
+			}
+			state_.pipeline = pipeline->get();
+			state_.topology = pipeline->topology();
+			// binding a pipeline with static state overwrites the dynamic value we shadowed
+			if (!pipeline->isDynamic(VK_DYNAMIC_STATE_VIEWPORT)) state_.hasViewport = false;
+			if (!pipeline->isDynamic(VK_DYNAMIC_STATE_SCISSOR)) state_.hasScissor = false;
+			if (!pipeline->isDynamic(VK_DYNAMIC_STATE_LINE_WIDTH)) state_.lineWidth = -1.0f;
 			vkCmdBindPipeline(handle_, bindPoint, *pipeline);
+			stats_.pipelineBinds++;
 		}
 
 		void bindVertexBuffer(uint32_t first, ArrayProxy<const VkBuffer> buffer, ArrayProxy<const VkDeviceSize> offset) {
-			vkCmdBindVertexBuffers(handle_, 0, buffer.size(), buffer.data(), offset.data());
+			bool same = first + buffer.size() <= maxVertexBindings;
+			for (uint32_t i = 0; same && i < buffer.size(); i++) {
+				same = state_.vertexBuffers[first + i] == buffer.data()[i] && state_.vertexOffsets[first + i] == offset.data()[i];
+			}
+			if (same) {
+				stats_.skipped++;
+				return;
+			}
+			for (uint32_t i = 0; i < buffer.size() && first + i < maxVertexBindings; i++) {
+				state_.vertexBuffers[first + i] = buffer.data()[i];
+				state_.vertexOffsets[first + i] = offset.data()[i];
+			}
+			vkCmdBindVertexBuffers(handle_, first, buffer.size(), buffer.data(), offset.data());
+			stats_.vertexBufferBinds++;
 		}
 
 		void bindIndexBuffer(VkBuffer buffer, uint32_t offset = 0, VkIndexType indexType = VK_INDEX_TYPE_UINT16) {
+			if (state_.indexBuffer == buffer && state_.indexOffset == offset && state_.indexType == indexType) {
+				stats_.skipped++;
+				return;
+			}
+			state_.indexBuffer = buffer;
+			state_.indexOffset = offset;
+			state_.indexType = indexType;
 			vkCmdBindIndexBuffer(handle_, buffer, offset, indexType);
+			stats_.indexBufferBinds++;
 		}
 
 		void bindDescriptorSet(PipelineLayout& layout, uint32_t first, ArrayProxy<const VkDescriptorSet> sets, ArrayProxy<uint32_t> offset = nullptr, VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS) {
+			bool same = first + sets.size() <= maxDescriptorSets && offset.size() <= 1 && state_.setLayout == layout->get();
+			for (uint32_t i = 0; same && i < sets.size(); i++) {
+				auto& bound = state_.sets[first + i];
+				same = bound.set == sets.data()[i] && bound.offset == (offset.empty() ? 0 : offset.front());
+			}
+			if (same) {
+				stats_.skipped++;
+				return;
+			}
+			if (state_.setLayout != layout->get()) {
+				// binding with an incompatible layout may disturb the sets it does not bind
+				for (auto& bound : state_.sets) {
+					bound = {};
+				}
+				state_.setLayout = layout->get();
+			}
+			for (uint32_t i = 0; i < sets.size() && first + i < maxDescriptorSets; i++) {
+				// only a single dynamic offset is shadowed; anything else always rebinds
+				state_.sets[first + i] = { offset.size() <= 1 ? sets.data()[i] : VkDescriptorSet(VK_NULL_HANDLE), offset.empty() ? 0 : offset.front() };
+			}
 			vkCmdBindDescriptorSets(handle_, bindPoint, *layout, first, sets.size(), sets.data(), offset.size(), offset.data());
+			stats_.descriptorBinds++;
 		}
 
 		void pushContants(PipelineLayout& layout, VkShaderStageFlags stage, uint32_t offset, uint32_t size, const void* value) {
+			auto& pc = state_.pushConstant;
+			if (pc.layout == layout->get() && pc.stage == stage && pc.offset == offset && pc.size == size && memcmp(pc.data, value, size) == 0) {
+				stats_.skipped++;
+				return;
+			}
+			if (size <= sizeof(pc.data)) {
+				pc.layout = layout->get();
+				pc.stage = stage;
+				pc.offset = offset;
+				pc.size = size;
+				memcpy(pc.data, value, size);
+			}
+			else {
+				pc = {};
+			}
 			vkCmdPushConstants(handle_, *layout, stage, offset, size, value);
+			stats_.pushConstantBytes += size;
 		}
 
 		template<typename T> void pushContants(PipelineLayout& layout, VkShaderStageFlags stage, uint32_t offset, const T& value) {
-			vkCmdPushConstants(handle_, *layout, stage, offset, sizeof(T), &value);
+			pushContants(layout, stage, offset, sizeof(T), &value);
 		}
 
 		template<typename T1, typename T2, typename T3, typename T4> void viewport(T1 x, T2 y, T3 width, T4 height) {
 			VkViewport value = { static_cast<float>(x),static_cast<float>(y), static_cast<float>(width), static_cast<float>(height),0.0f,1.0f };
+			if (state_.hasViewport && memcmp(&state_.viewport, &value, sizeof(value)) == 0) {
+				stats_.skipped++;
+				return;
+			}
+			state_.hasViewport = true;
+			state_.viewport = value;
 			vkCmdSetViewport(handle_, 0, 1, &value);
 		}
 
 		template<typename T1, typename T2, typename T3, typename T4> void scissor(T1 x, T2 y, T3 width, T4 height) {
 			VkRect2D value = { {static_cast<int32_t>(x),static_cast<int32_t>(y)},{static_cast<uint32_t>(width),static_cast<uint32_t>(height)} };
+			if (state_.hasScissor && memcmp(&state_.scissor, &value, sizeof(value)) == 0) {
+				stats_.skipped++;
+				return;
+			}
+			state_.hasScissor = true;
+			state_.scissor = value;
 			vkCmdSetScissor(handle_, 0, 1, &value);
 		}
 
 		void lineWidth(float width)
 		{
+			if (state_.lineWidth == width) {
+				stats_.skipped++;
+				return;
+			}
+			state_.lineWidth = width;
 			vkCmdSetLineWidth(handle_, width);
 		}
 
 		void draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex = 0, uint32_t firstInstance = 0) {
 			vkCmdDraw(handle_, vertexCount, instanceCount, firstVertex, firstInstance);
+			countDraw(vertexCount, instanceCount);
 		}
 
 		void drawIndexd(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex = 0, int32_t vertexOffset = 0, uint32_t firstInstance = 0) {
 			vkCmdDrawIndexed(handle_, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+			countDraw(indexCount, instanceCount);
+		}
+
+		// Counters since the last begin().
+		const CommandStats& stats() const { return stats_; }
+
+		// Must be recorded outside of a render pass.
+		void resetQueryPool(const QueryPool& pool, uint32_t first, uint32_t count) {
+			vkCmdResetQueryPool(handle_, pool->get(), first, count);
+		}
+
+		void writeTimestamp(VkPipelineStageFlagBits stage, const QueryPool& pool, uint32_t query) {
+			vkCmdWriteTimestamp(handle_, stage, pool->get(), query);
 		}
 
 		void copyBuffer(VkBuffer src, VkBuffer dst, ArrayProxy<const VkBufferCopy> region) {
@@ -622,6 +901,10 @@ namespace vg::vk
 			vkCmdCopyBufferToImage(handle_, src, dst, layout, region.size(), region.data());
 		}
 
+		void copyImageToBuffer(VkImage src, VkImageLayout layout, VkBuffer dst, ArrayProxy<const VkBufferImageCopy> region) {
+			vkCmdCopyImageToBuffer(handle_, src, layout, dst, region.size(), region.data());
+		}
+
 		void copyImage(const Image& src, VkImageLayout srcLayout, const Image& dst, VkImageLayout dstLayout, ArrayProxy<const VkImageCopy> region) {
 			vkCmdCopyImage(handle_, src->get(), srcLayout, dst->get(), dstLayout, region.size(), region.data());
 		}
@@ -630,8 +913,55 @@ namespace vg::vk
 			vkCmdBlitImage(handle_, src->get(), srcLayout, dst->get(), dstLayout, blits.size(), blits.data(), filter);
 		}
 	private:
+		void countDraw(uint32_t count, uint32_t instanceCount) {
+			stats_.draws++;
+			stats_.instances += instanceCount;
+			switch (state_.topology)
+			{
+			case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST:		stats_.triangles += uint64_t(count / 3) * instanceCount; break;
+			case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP:
+			case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN:		stats_.triangles += uint64_t(count > 2 ? count - 2 : 0) * instanceCount; break;
+			default: break;
+			}
+		}
+
+		static constexpr uint32_t maxVertexBindings = 4;
+		static constexpr uint32_t maxDescriptorSets = 4;
+
+		struct State
+		{
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_MAX_ENUM;
+			VkBuffer vertexBuffers[maxVertexBindings] = {};
+			VkDeviceSize vertexOffsets[maxVertexBindings] = {};
+			VkBuffer indexBuffer = VK_NULL_HANDLE;
+			VkDeviceSize indexOffset = 0;
+			VkIndexType indexType = VK_INDEX_TYPE_MAX_ENUM;
+			VkPipelineLayout setLayout = VK_NULL_HANDLE;
+			struct
+			{
+				VkDescriptorSet set;
+				uint32_t offset;
+			}sets[maxDescriptorSets] = {};
+			struct
+			{
+				VkPipelineLayout layout;
+				VkShaderStageFlags stage;
+				uint32_t offset;
+				uint32_t size;
+				uint8_t data[128];
+			}pushConstant = {};
+			bool hasViewport = false;
+			bool hasScissor = false;
+			VkViewport viewport = {};
+			VkRect2D scissor = {};
+			float lineWidth = -1.0f;
+		};
+
 		const Device_T* device_;
 		const CommandPool_T* pool_;
+		State state_;
+		CommandStats stats_;
 	};
 
 	class CommandPool_T : public Handle_T<VkCommandPool>
@@ -645,8 +975,8 @@ namespace vg::vk
 		}
 		~CommandPool_T() { vkDestroyCommandPool(*device_, handle_, nullptr); }
 
-		inline CommandBuffer createCommandBuffer() {
-			return std::make_unique<CommandBuffer_T>(device_, this);
+		inline CommandBuffer createCommandBuffer(VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY) {
+			return device_->create<CommandBuffer_T>(this, level);
 		}
 	private:
 		const Device_T* device_;
@@ -751,6 +1081,15 @@ namespace vg::vk
 			return *this;
 		}
 
+		// Feature structures chained to the device create info; must outlive create().
+		DeviceMaker& next(void* features)
+		{
+			auto header = static_cast<VkBaseOutStructure*>(features);
+			header->pNext = static_cast<VkBaseOutStructure*>(const_cast<void*>(next_));
+			next_ = features;
+			return *this;
+		}
+
 		DeviceMaker& queue(uint32_t familyIndex, float priority = 0.0f, uint32_t n = 1)
 		{
 			queue_priorities_.emplace_back(n, priority);
@@ -774,16 +1113,18 @@ namespace vg::vk
 			device_info.enabledLayerCount = static_cast<uint32_t>(layers_.size());
 			device_info.ppEnabledLayerNames = layers_.data();
 			device_info.pEnabledFeatures = &features_;
+			device_info.pNext = next_;
 			VkDevice device = VK_NULL_HANDLE;
 			VK_CHECK_RESULT(vkCreateDevice(physical_device, &device_info, nullptr, &device));
 
-			return std::make_unique<Device_T>(physical_device, device);
+			return std::make_unique<Device_T>(physical_device, device, std::vector<std::string>(extensions_.begin(), extensions_.end()));
 		}
 
 	private:
 		std::vector<const char*> layers_;
 		std::vector<const char*> extensions_;
 		VkPhysicalDeviceFeatures features_;
+		const void* next_ = nullptr;
 		std::vector<std::vector<float>> queue_priorities_;
 		std::vector<VkDeviceQueueCreateInfo> qci_;
 	};
@@ -852,7 +1193,7 @@ namespace vg::vk
 			info.pSubpasses = s.subpassDescriptions.data();
 			info.dependencyCount = (uint32_t)s.subpassDependencies.size();
 			info.pDependencies = s.subpassDependencies.data();
-			return std::make_unique<RenderPass_T>(device.get(), info);
+			return device->create<RenderPass_T>(info);
 		}
 
 		void dependencyBegin(uint32_t srcSubpass, uint32_t dstSubpass) {
@@ -886,6 +1227,24 @@ namespace vg::vk
 		}s;
 	};
 
+	// Compiles GLSL to SPIR-V once, for makers that build many pipelines from one source.
+	std::vector<uint32_t> compileGLSL(VkShaderStageFlagBits stage, const std::string& src);
+
+	inline VkFormat toVkFormat(AttributeFormat format) {
+		switch (format)
+		{
+		case AttributeFormat::Float2: return VK_FORMAT_R32G32_SFLOAT;
+		case AttributeFormat::Float3: return VK_FORMAT_R32G32B32_SFLOAT;
+		case AttributeFormat::Float4: return VK_FORMAT_R32G32B32A32_SFLOAT;
+		case AttributeFormat::Half2: return VK_FORMAT_R16G16_SFLOAT;
+		case AttributeFormat::Unorm16x2: return VK_FORMAT_R16G16_UNORM;
+		case AttributeFormat::Unorm16x4: return VK_FORMAT_R16G16B16A16_UNORM;
+		case AttributeFormat::Snorm16x2: return VK_FORMAT_R16G16_SNORM;
+		case AttributeFormat::Snorm8x2: return VK_FORMAT_R8G8_SNORM;
+		default: return VK_FORMAT_UNDEFINED;
+		}
+	}
+
 	class PipelineMaker {
 	public:
 		PipelineMaker(const Device& device) : device_(device.get()) 
@@ -916,42 +1275,38 @@ namespace vg::vk
 		}
 
 		Pipeline create(const PipelineLayout& pipelineLayout, const RenderPass& renderPass) {
-			auto count = (uint32_t)colorBlendAttachments_.size();
-			colorBlendState_.attachmentCount = count;
-			colorBlendState_.pAttachments = count ? colorBlendAttachments_.data() : nullptr;
-
-			VkPipelineViewportStateCreateInfo viewportState = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
-			viewportState.viewportCount = 1;
-			viewportState.pViewports = &viewport_;
-			viewportState.scissorCount = 1;
-			viewportState.pScissors = &scissor_;
-
-			VkPipelineVertexInputStateCreateInfo vertexInputState = {VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO};
-			vertexInputState.vertexAttributeDescriptionCount = (uint32_t)vertexAttributeDescriptions_.size();
-			vertexInputState.pVertexAttributeDescriptions = vertexAttributeDescriptions_.data();
-			vertexInputState.vertexBindingDescriptionCount = (uint32_t)vertexBindingDescriptions_.size();
-			vertexInputState.pVertexBindingDescriptions = vertexBindingDescriptions_.data();
+			return create(pipelineLayout->get(), renderPass->get());
+		}
 
-			VkPipelineDynamicStateCreateInfo dynState = { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
-			dynState.dynamicStateCount = (uint32_t)dynamicState_.size();
-			dynState.pDynamicStates = dynamicState_.data();
+		Pipeline create(VkPipelineLayout pipelineLayout, VkRenderPass renderPass) {
+			return make(pipelineLayout, renderPass, 0, nullptr, VK_SHADER_STAGE_ALL_GRAPHICS);
+		}
 
-			VkGraphicsPipelineCreateInfo pipelineInfo = {VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO};
-			pipelineInfo.pVertexInputState = &vertexInputState;
-			pipelineInfo.stageCount = (uint32_t)modules_.size();
-			pipelineInfo.pStages = modules_.data();
-			pipelineInfo.pInputAssemblyState = &inputAssemblyState_;
-			pipelineInfo.pViewportState = &viewportState;
-			pipelineInfo.pRasterizationState = &rasterizationState_;
-			pipelineInfo.pMultisampleState = &multisampleState_;
-			pipelineInfo.pColorBlendState = &colorBlendState_;
-			pipelineInfo.pDepthStencilState = &depthStencilState_;
-			pipelineInfo.layout = pipelineLayout->get();
-			pipelineInfo.renderPass = renderPass->get();
-			pipelineInfo.pDynamicState = dynamicState_.empty() ? nullptr : &dynState;
-			pipelineInfo.subpass = subpass_;
+		// Only the given parts of the pipeline (VK_GRAPHICS_PIPELINE_LIBRARY_*_BIT_EXT) as a
+		// library for link(); needs Device_T::graphicsPipelineLibrary. Libraries keep what link
+		// time optimization needs, so one set serves both links.
+		Pipeline createLibrary(VkGraphicsPipelineLibraryFlagsEXT parts, VkPipelineLayout pipelineLayout, VkRenderPass renderPass) {
+			VkGraphicsPipelineLibraryCreateInfoEXT library = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT };
+			library.flags = parts;
+			VkShaderStageFlags stages = 0;
+			if (parts & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT) {
+				stages |= VK_SHADER_STAGE_ALL_GRAPHICS & ~VK_SHADER_STAGE_FRAGMENT_BIT;
+			}
+			if (parts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT) {
+				stages |= VK_SHADER_STAGE_FRAGMENT_BIT;
+			}
+			return make(pipelineLayout, renderPass, VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT, &library, stages);
+		}
 
-			return std::make_unique<Pipeline_T>(device_, pipelineInfo);
+		// A complete pipeline out of libraries covering all four parts. Without optimize the
+		// link is fast but the code may be slower; link again with it in the background.
+		// Only the input assembly and dynamic state of this maker are looked at, for the
+		// bookkeeping of the returned pipeline.
+		Pipeline link(ArrayProxy<const VkPipeline> libraries, VkPipelineLayout pipelineLayout, VkRenderPass renderPass, bool optimize) {
+			VkPipelineLibraryCreateInfoKHR info = { VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR };
+			info.libraryCount = libraries.size();
+			info.pLibraries = libraries.data();
+			return make(pipelineLayout, renderPass, optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0, &info, 0);
 		}
 
 		PipelineMaker& shader(VkShaderStageFlagBits stage,size_t size,const uint32_t* code) {
@@ -978,6 +1333,28 @@ namespace vg::vk
 
 		PipelineMaker& shaderGLSL(VkShaderStageFlagBits stage, const std::string& src);
 
+		PipelineMaker& shaderSPIRV(VkShaderStageFlagBits stage, const std::vector<uint32_t>& code) {
+			return shader(stage, code.size() * sizeof(uint32_t), code.data());
+		}
+
+		// Sets `layout(constant_id = id)` of the stage's shader; values are 32 bit (bool, int, uint, float).
+		PipelineMaker& specialization(VkShaderStageFlagBits stage, uint32_t id, uint32_t value) {
+			auto it = std::find_if(specializations_.begin(), specializations_.end(), [&](const Specialization& s) { return s.stage == stage; });
+			if (it == specializations_.end()) {
+				specializations_.push_back({ stage });
+				it = specializations_.end() - 1;
+			}
+			for (auto& entry : it->entries) {
+				if (entry.constantID == id) {
+					it->data[entry.offset / sizeof(uint32_t)] = value;
+					return *this;
+				}
+			}
+			it->entries.push_back({ id, static_cast<uint32_t>(it->data.size() * sizeof(uint32_t)), sizeof(uint32_t) });
+			it->data.push_back(value);
+			return *this;
+		}
+
 		PipelineMaker& subPass(uint32_t subpass) { subpass_ = subpass; return *this; }
 
 		PipelineMaker& defaultBlend(VkBool32 enable) {
@@ -1050,6 +1427,40 @@ namespace vg::vk
 			return *this; 
 		}
 
+		// Position, normal and texcoord at locations 0, 1 and 2; absent ones read the position
+		// so every input of the geometry shaders is fed. Binding 0 holds the interleaved
+		// vertices or the separate positions, binding 1 the other attributes then.
+		PipelineMaker& vertexFormat(const VertexFormat& format) {
+			vertexPositions(format);
+			uint32_t binding = 0;
+			if (format.separatePositions() && (format.normal.present() || format.texcoord.present())) {
+				binding = 1;
+				vertexBinding(binding, format.stride);
+			}
+			const VertexAttribute* attributes[] = { &format.normal, &format.texcoord };
+			for (uint32_t location = 1; location < 3; location++) {
+				auto& attribute = *attributes[location - 1];
+				if (attribute.present()) {
+					vertexAttribute(location, binding, toVkFormat(attribute.format), attribute.offset);
+				}
+				else {
+					vertexAttribute(location, 0, toVkFormat(format.position.format), format.position.offset);
+				}
+			}
+			return *this;
+		}
+
+		template<typename V> PipelineMaker& vertexFormat() {
+			return vertexFormat(vertexFormatOf<V>());
+		}
+
+		// Only the position at location 0 of binding 0, for depth-only and pick passes.
+		PipelineMaker& vertexPositions(const VertexFormat& format) {
+			vertexBinding(0, format.positionBindingStride());
+			vertexAttribute(0, 0, toVkFormat(format.position.format), format.position.offset);
+			return *this;
+		}
+
 		PipelineMaker& topology(VkPrimitiveTopology topology) { inputAssemblyState_.topology = topology; return *this; }
 
 		PipelineMaker& primitiveRestartEnable(VkBool32 primitiveRestartEnable) { inputAssemblyState_.primitiveRestartEnable = primitiveRestartEnable; return *this; }
@@ -1093,6 +1504,68 @@ namespace vg::vk
 		 
 		PipelineMaker& dynamicState(VkDynamicState value) { dynamicState_.emplace_back(value); return *this; }
 	private:
+		// The shaders of stages with all state; create flags and next say what is built of it.
+		Pipeline make(VkPipelineLayout pipelineLayout, VkRenderPass renderPass, VkPipelineCreateFlags flags, const void* next, VkShaderStageFlags stages) {
+			auto count = (uint32_t)colorBlendAttachments_.size();
+			colorBlendState_.attachmentCount = count;
+			colorBlendState_.pAttachments = count ? colorBlendAttachments_.data() : nullptr;
+
+			VkPipelineViewportStateCreateInfo viewportState = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+			viewportState.viewportCount = 1;
+			viewportState.pViewports = &viewport_;
+			viewportState.scissorCount = 1;
+			viewportState.pScissors = &scissor_;
+
+			VkPipelineVertexInputStateCreateInfo vertexInputState = {VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO};
+			vertexInputState.vertexAttributeDescriptionCount = (uint32_t)vertexAttributeDescriptions_.size();
+			vertexInputState.pVertexAttributeDescriptions = vertexAttributeDescriptions_.data();
+			vertexInputState.vertexBindingDescriptionCount = (uint32_t)vertexBindingDescriptions_.size();
+			vertexInputState.pVertexBindingDescriptions = vertexBindingDescriptions_.data();
+
+			VkPipelineDynamicStateCreateInfo dynState = { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+			dynState.dynamicStateCount = (uint32_t)dynamicState_.size();
+			dynState.pDynamicStates = dynamicState_.data();
+
+			std::vector<VkSpecializationInfo> specInfo(specializations_.size());
+			std::vector<VkPipelineShaderStageCreateInfo> modules;
+			for (auto module : modules_) {
+				if (!(module.stage & stages)) {
+					continue;
+				}
+				module.pSpecializationInfo = nullptr;
+				for (size_t i = 0; i < specializations_.size(); i++) {
+					auto& spec = specializations_[i];
+					if (spec.stage == module.stage) {
+						specInfo[i].mapEntryCount = static_cast<uint32_t>(spec.entries.size());
+						specInfo[i].pMapEntries = spec.entries.data();
+						specInfo[i].dataSize = spec.data.size() * sizeof(uint32_t);
+						specInfo[i].pData = spec.data.data();
+						module.pSpecializationInfo = &specInfo[i];
+					}
+				}
+				modules.push_back(module);
+			}
+
+			VkGraphicsPipelineCreateInfo pipelineInfo = {VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO};
+			pipelineInfo.pNext = next;
+			pipelineInfo.flags = flags;
+			pipelineInfo.pVertexInputState = &vertexInputState;
+			pipelineInfo.stageCount = (uint32_t)modules.size();
+			pipelineInfo.pStages = modules.empty() ? nullptr : modules.data();
+			pipelineInfo.pInputAssemblyState = &inputAssemblyState_;
+			pipelineInfo.pViewportState = &viewportState;
+			pipelineInfo.pRasterizationState = &rasterizationState_;
+			pipelineInfo.pMultisampleState = &multisampleState_;
+			pipelineInfo.pColorBlendState = &colorBlendState_;
+			pipelineInfo.pDepthStencilState = &depthStencilState_;
+			pipelineInfo.layout = pipelineLayout;
+			pipelineInfo.renderPass = renderPass;
+			pipelineInfo.pDynamicState = dynamicState_.empty() ? nullptr : &dynState;
+			pipelineInfo.subpass = subpass_;
+
+			return device_->create<Pipeline_T>(pipelineInfo);
+		}
+
 		const Device_T* device_;
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState_ = {VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO};
 		VkViewport viewport_;
@@ -1107,6 +1580,14 @@ namespace vg::vk
 		std::vector<VkVertexInputBindingDescription> vertexBindingDescriptions_;
 		std::vector<VkDynamicState> dynamicState_;
 		uint32_t subpass_ = 0;
+
+		struct Specialization
+		{
+			VkShaderStageFlagBits stage;
+			std::vector<VkSpecializationMapEntry> entries;
+			std::vector<uint32_t> data;
+		};
+		std::vector<Specialization> specializations_;
 	};
 
 	class PipelineLayoutMaker
@@ -1124,7 +1605,7 @@ namespace vg::vk
 			info.pPushConstantRanges = pushConstants_.data();
 			info.setLayoutCount = static_cast<uint32_t>(setLayouts_.size());
 			info.pSetLayouts = setLayouts_.data();
-			return std::make_unique<PipelineLayout_T>(device.get(), info);
+			return device->create<PipelineLayout_T>(info);
 		}
 	private:
 		std::vector<VkPushConstantRange> pushConstants_;
@@ -1143,7 +1624,7 @@ namespace vg::vk
 			VkDescriptorSetLayoutCreateInfo info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
 			info.bindingCount = static_cast<uint32_t>(bindings_.size());
 			info.pBindings = bindings_.data();
-			return std::make_unique<DescriptorSetLayout_T>(device.get(), info);
+			return device->create<DescriptorSetLayout_T>(info);
 		}
 	private:
 		std::vector<VkDescriptorSetLayoutBinding> bindings_;
@@ -1185,7 +1666,7 @@ namespace vg::vk
 		SamplerMaker &unnormalizedCoordinates(VkBool32 value) { info.unnormalizedCoordinates = value; return *this; }
 
 		Sampler create(const Device& device) const {
-			return std::make_unique<Sampler_T>(device.get(), info);
+			return device->create<Sampler_T>(info);
 		}
 	private:
 		VkSamplerCreateInfo info = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
@@ -1259,6 +1740,26 @@ namespace vg::vk
 		bool ok_ = true;
 	};
 
+	struct Device_T::Pools
+	{
+		std::tuple<
+			Pool<Buffer_T>, Pool<Image_T>, Pool<Sampler_T>,
+			Pool<RenderPass_T>, Pool<FrameBuffer_T>, Pool<Pipeline_T>, Pool<PipelineLayout_T>,
+			Pool<DescriptorSetLayout_T>, Pool<DescriptorSet_T>,
+			Pool<Fence_T>, Pool<Semaphore_T>, Pool<CommandBuffer_T>> pools;
+	};
+
+	template<typename T> Pool<T>& Device_T::pool() const
+	{
+		return std::get<Pool<T>>(pools_->pools);
+	}
+
+	template<typename T, typename... Args> Pooled<T> Device_T::create(Args&&... args) const
+	{
+		auto& p = pool<T>();
+		return Pooled<T>(p.create(this, std::forward<Args>(args)...), PoolDeleter<T>(&p));
+	}
+
 	static std::vector<VkQueueFamilyProperties> getQueueFamilyProperties(VkPhysicalDevice physicalDevice) {
 		uint32_t count = 0;
 		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &count, nullptr);
@@ -1267,6 +1768,19 @@ namespace vg::vk
 		return std::move(props);
 	}
 
+	static std::vector<VkExtensionProperties> getDeviceExtensions(VkPhysicalDevice physicalDevice) {
+		uint32_t count = 0;
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, nullptr);
+		std::vector<VkExtensionProperties> props(count);
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, props.data());
+		props.resize(count);
+		return props;
+	}
+
+	static bool hasDeviceExtension(const std::vector<VkExtensionProperties>& extensions, const char* name) {
+		return std::any_of(extensions.begin(), extensions.end(), [name](const VkExtensionProperties& e) { return std::strcmp(e.extensionName, name) == 0; });
+	}
+
 	static VkBool32 getSurfaceSupport(VkPhysicalDevice physicalDevice,uint32_t familyIndex, VkSurfaceKHR surface)
 	{
 		VkBool32 support;
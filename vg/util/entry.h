@@ -1,12 +1,15 @@
 #pragma once
 
 #include <iostream>
+#include <atomic>
+#include <memory>
 
 #if defined(WIN32)
 #include <Windows.h>
 #endif
 
 #include "key.h"
+#include "trace.h"
 
 namespace vg
 {
@@ -17,7 +20,7 @@ namespace vg
 		uint32_t height = 960;
 		const char* title = "vg";
 #if defined(WIN32)
-		HWND handle;
+		HWND handle = NULL;
 #endif
 	};
 
@@ -53,12 +56,44 @@ namespace vg
 			int width, height;
 		};
 
+		enum class RenderMode
+		{
+			// update and draw as fast as possible
+			Continuous,
+			// block on window messages and only draw when a frame was requested
+			OnDemand
+		};
+
 		virtual void init() = 0;
 		virtual void update() = 0;
 		virtual void draw() = 0;
+		// Called after the message loop ends, while the window still exists.
+		virtual void shutdown() {}
 
 		void start();
 
+		inline void setRenderMode(RenderMode mode)
+		{
+			renderMode = mode;
+		}
+
+		inline RenderMode getRenderMode() const
+		{
+			return renderMode;
+		}
+
+		// Schedules at least `frames` more frames in on-demand mode. Safe to call from any thread.
+		void requestRedraw(uint32_t frames = 1);
+
+		// Keeps drawing every frame while an animation is running.
+		inline void setAnimating(bool value)
+		{
+			animating = value;
+			if (value) {
+				requestRedraw();
+			}
+		}
+
 		inline void setWindowSize(uint32_t width, uint32_t height)
 		{
 			windowInfo.width = width;
@@ -85,9 +120,26 @@ namespace vg
 		bool getKeyState(Key key) {
 			return keyDown[static_cast<uint32_t>(key)];
 		}
+
+		// Records mouse, window and key events into trace, usually the writer the renderer
+		// records into; nullptr stops. Replayed events come back through Renderer::replay.
+		inline void setTrace(std::shared_ptr<TraceWriter> writer)
+		{
+			trace = std::move(writer);
+		}
+
+		// Input as the window delivers it: recorded if tracing, then handed to the virtuals.
+		void dispatchMouse(const MouseEvent& event);
+		void dispatchWindow(const WindowEvent& event);
+		void dispatchKey(Key key, bool isDown);
     private:
 		WindowInfo windowInfo;
 		bool keyDown[512] = {};
+
+		RenderMode renderMode = RenderMode::Continuous;
+		std::atomic<uint32_t> pendingFrames{ 0 };
+		std::atomic<bool> animating{ false };
+		std::shared_ptr<TraceWriter> trace;
     };
 
 }
\ No newline at end of file
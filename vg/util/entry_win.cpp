@@ -7,19 +7,45 @@
 
 namespace vg
 {
+	// ImGui resolves hover and focus changes a frame after the input that caused them,
+	// so input schedules a few frames instead of one.
+	static const uint32_t inputFrames = 3;
+
+	// Upper bound on the idle wait while a text field is active, so the cursor keeps blinking.
+	static const DWORD textInputWakeup = 250;
+
 	LRESULT CALLBACK WindowProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 	{
 		ImGui::win32_WndProcHandler(hwnd, message, wParam, lParam);
 
 		auto entry = (Entry*)::GetWindowLongPtr(hwnd, GWLP_USERDATA);
 
+		switch (message)
+		{
+		case WM_MOUSEWHEEL:
+		case WM_LBUTTONDOWN: case WM_LBUTTONDBLCLK: case WM_LBUTTONUP:
+		case WM_RBUTTONDOWN: case WM_RBUTTONDBLCLK: case WM_RBUTTONUP:
+		case WM_MBUTTONDOWN: case WM_MBUTTONDBLCLK: case WM_MBUTTONUP:
+		case WM_MOUSEMOVE:
+		case WM_SYSKEYDOWN: case WM_KEYDOWN:
+		case WM_SYSKEYUP: case WM_KEYUP:
+		case WM_CHAR:
+		case WM_SIZE:
+		case WM_PAINT:
+		case WM_SETFOCUS: case WM_KILLFOCUS:
+			if (entry) {
+				entry->requestRedraw(inputFrames);
+			}
+			break;
+		}
+
 		switch (message)
 		{
 		case WM_DESTROY:
 			PostQuitMessage(0);
 			return 0;
 		case WM_MOUSEWHEEL:
-			entry->mouseEvent({ Entry::MouseEvent::Type::Wheel, 0, (float)GET_WHEEL_DELTA_WPARAM(wParam) / (float)WHEEL_DELTA });
+			entry->dispatchMouse({ Entry::MouseEvent::Type::Wheel, 0, (float)GET_WHEEL_DELTA_WPARAM(wParam) / (float)WHEEL_DELTA });
 			break;
 		case WM_LBUTTONDOWN: case WM_LBUTTONDBLCLK:
 		case WM_RBUTTONDOWN: case WM_RBUTTONDBLCLK:
@@ -28,7 +54,7 @@ namespace vg
 			auto type = Entry::MouseEvent::Type::LeftDown;
 			if (message == WM_RBUTTONDOWN || message == WM_RBUTTONDBLCLK) { type = Entry::MouseEvent::Type::RightDown; }
 			if (message == WM_MBUTTONDOWN || message == WM_MBUTTONDBLCLK) { type = Entry::MouseEvent::Type::MiddleDown; }
-			entry->mouseEvent({ type,(float)LOWORD(lParam), (float)HIWORD(lParam) });
+			entry->dispatchMouse({ type,(float)LOWORD(lParam), (float)HIWORD(lParam) });
 			break;
 		}
 		case WM_LBUTTONUP:
@@ -38,11 +64,11 @@ namespace vg
 			auto type = Entry::MouseEvent::Type::LeftUp;
 			if (message == WM_RBUTTONUP) { type = Entry::MouseEvent::Type::RightUp; }
 			if (message == WM_MBUTTONUP) { type = Entry::MouseEvent::Type::MiddleUp; }
-			entry->mouseEvent({ type,(float)LOWORD(lParam), (float)HIWORD(lParam) });
+			entry->dispatchMouse({ type,(float)LOWORD(lParam), (float)HIWORD(lParam) });
 			break;
 		}
 		case WM_MOUSEMOVE:
-			entry->mouseEvent({ Entry::MouseEvent::Type::Move,(float)LOWORD(lParam), (float)HIWORD(lParam) });
+			entry->dispatchMouse({ Entry::MouseEvent::Type::Move,(float)LOWORD(lParam), (float)HIWORD(lParam) });
 			break;
 		case WM_SIZE:
 			if (entry) {
@@ -50,21 +76,21 @@ namespace vg
 				int height = HIWORD(lParam);
 				switch (wParam)
 				{
-				case SIZE_MINIMIZED:entry->windowEvent({ Entry::WindowEvent::Type::Minimized,width,height }); break;
-				case SIZE_MAXIMIZED:entry->windowEvent({ Entry::WindowEvent::Type::Maximized,width,height }); break;
-				case SIZE_RESTORED:entry->windowEvent({ Entry::WindowEvent::Type::Restored,width,height }); break;
-				case SIZE_MAXSHOW:entry->windowEvent({ Entry::WindowEvent::Type::MaxShow,width,height }); break;
-				case SIZE_MAXHIDE:entry->windowEvent({ Entry::WindowEvent::Type::MaxHide,width,height }); break;
+				case SIZE_MINIMIZED:entry->dispatchWindow({ Entry::WindowEvent::Type::Minimized,width,height }); break;
+				case SIZE_MAXIMIZED:entry->dispatchWindow({ Entry::WindowEvent::Type::Maximized,width,height }); break;
+				case SIZE_RESTORED:entry->dispatchWindow({ Entry::WindowEvent::Type::Restored,width,height }); break;
+				case SIZE_MAXSHOW:entry->dispatchWindow({ Entry::WindowEvent::Type::MaxShow,width,height }); break;
+				case SIZE_MAXHIDE:entry->dispatchWindow({ Entry::WindowEvent::Type::MaxHide,width,height }); break;
 				}
 			}
 			break;
 		case WM_SYSKEYDOWN:
 		case WM_KEYDOWN:
-			entry->setKeyState(static_cast<Key>(wParam), true);
+			entry->dispatchKey(static_cast<Key>(wParam), true);
 			break;
 		case WM_SYSKEYUP:
 		case WM_KEYUP:
-			entry->setKeyState(static_cast<Key>(wParam), false);
+			entry->dispatchKey(static_cast<Key>(wParam), false);
 			break;
 		case WM_CHAR:
 			break;
@@ -111,8 +137,10 @@ namespace vg
 		ImGui::win32_Init(windowInfo.handle);
 
 		init();
+		requestRedraw(inputFrames);
 
 		MSG msg = {};
+		DWORD idleTimeout = INFINITE;
 		while (msg.message != WM_QUIT)
 		{
 			if (PeekMessage(&msg, NULL, 0U, 0U, PM_REMOVE))
@@ -121,18 +149,82 @@ namespace vg
 				DispatchMessage(&msg);
 				continue;
 			}
+
+			if (renderMode == RenderMode::OnDemand && !animating && pendingFrames == 0) {
+				// sleep until a message arrives, requestRedraw posts one from other threads
+				if (MsgWaitForMultipleObjectsEx(0, NULL, idleTimeout, QS_ALLINPUT, MWMO_INPUTAVAILABLE) == WAIT_TIMEOUT) {
+					requestRedraw();
+				}
+				continue;
+			}
+
+			uint32_t frames = pendingFrames;
+			while (frames > 0 && !pendingFrames.compare_exchange_weak(frames, frames - 1)) {}
+
 			ImGui::win32_NewFrame();
 
 			update();
 
+			// keep drawing while ImGui is being interacted with
+			auto& io = ImGui::GetIO();
+			bool mouseHeld = io.MouseDown[0] || io.MouseDown[1] || io.MouseDown[2];
+			if (mouseHeld && io.WantCaptureMouse) {
+				requestRedraw();
+			}
+			idleTimeout = io.WantTextInput ? textInputWakeup : INFINITE;
+
 			draw();
 		}
 
+		shutdown();
+
 		ImGui::win32_Shutdown();
 
+		// joining the log thread is not allowed once the dll is being unloaded
+		Log::shutdown();
+
 		DestroyWindow(windowInfo.handle);
 		UnregisterClass("vg", wc.hInstance);
 	}
+
+	void Entry::dispatchMouse(const MouseEvent& event)
+	{
+		if (trace) {
+			trace->write(TraceCall::MouseEvent, &event, sizeof(event));
+		}
+		mouseEvent(event);
+	}
+
+	void Entry::dispatchWindow(const WindowEvent& event)
+	{
+		if (trace) {
+			trace->write(TraceCall::WindowEvent, &event, sizeof(event));
+		}
+		windowEvent(event);
+	}
+
+	void Entry::dispatchKey(Key key, bool isDown)
+	{
+		if (trace) {
+			TraceBuffer payload;
+			payload.put(static_cast<uint32_t>(key));
+			payload.put(isDown);
+			trace->write(TraceCall::KeyEvent, payload);
+		}
+		setKeyState(key, isDown);
+	}
+
+	void Entry::requestRedraw(uint32_t frames)
+	{
+		uint32_t current = pendingFrames;
+		while (current < frames && !pendingFrames.compare_exchange_weak(current, frames)) {}
+
+		// wake the message loop if it is blocked waiting for input on another thread
+		if (renderMode == RenderMode::OnDemand && windowInfo.handle &&
+			::GetWindowThreadProcessId(windowInfo.handle, NULL) != ::GetCurrentThreadId()) {
+			::PostMessage(windowInfo.handle, WM_NULL, 0, 0);
+		}
+	}
 }
 
 
@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <glm/glm.hpp>
+#include <render/geometryInfo.h>
 
 namespace vg
 {
@@ -23,4 +24,10 @@ namespace vg
 
 		static SimpleGeometry createSphere(float radius = 1, uint32_t segmentX = 8, uint32_t segmentY = 6);
 	};
-}
\ No newline at end of file
+
+	template<> struct VertexTraits<SimpleGeometry::Vertex>
+	{
+		using V = SimpleGeometry::Vertex;
+		static constexpr VertexFormat format = { sizeof(V), VG_VERTEX_ATTRIBUTE(V, position), VG_VERTEX_ATTRIBUTE(V, normal), VG_VERTEX_ATTRIBUTE(V, texcoord) };
+	};
+}
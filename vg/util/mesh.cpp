@@ -0,0 +1,979 @@
+#include "mesh.h"
+#include <core/hash.h>
+#include <core/log.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+namespace vg
+{
+	namespace
+	{
+		struct Vertex
+		{
+			glm::vec3 position = glm::vec3(0.0f);
+			glm::vec3 normal = glm::vec3(0.0f);
+			glm::vec2 texcoord = glm::vec2(0.0f);
+		};
+
+		bool has(VertexType flags, VertexType flag)
+		{
+			return (flags & flag) == flag;
+		}
+
+		bool near(glm::vec2 a, glm::vec2 b, float tolerance)
+		{
+			auto d = glm::abs(a - b);
+			return d.x <= tolerance && d.y <= tolerance;
+		}
+
+		bool near(glm::vec3 a, glm::vec3 b, float tolerance)
+		{
+			auto d = glm::abs(a - b);
+			return d.x <= tolerance && d.y <= tolerance && d.z <= tolerance;
+		}
+
+		// Any layout with float attributes; the rest are ignored.
+		std::vector<Vertex> decodeVertices(const GeometryBufferInfo& source)
+		{
+			auto& format = source.format;
+			std::vector<Vertex> vertices(format.vertexCount(source.vertexSize));
+			auto positions = static_cast<const uint8_t*>(source.vertex);
+			auto attributes = positions + format.attributeOffset(source.vertexSize);
+			for (auto& v : vertices) {
+				std::memcpy(&v.position, positions + format.position.offset, sizeof(glm::vec3));
+				if (format.normal.format == AttributeFormat::Float3) {
+					std::memcpy(&v.normal, attributes + format.normal.offset, sizeof(glm::vec3));
+				}
+				if (format.texcoord.format == AttributeFormat::Float2) {
+					std::memcpy(&v.texcoord, attributes + format.texcoord.offset, sizeof(glm::vec2));
+				}
+				positions += format.positionBindingStride();
+				attributes += format.stride;
+			}
+			return vertices;
+		}
+
+		std::vector<uint32_t> decodeIndices(const GeometryBufferInfo& source, uint32_t vertexCount)
+		{
+			std::vector<uint32_t> indices;
+			if (source.indexType == IndexType::u32) {
+				indices.resize(source.indexSize / sizeof(uint32_t));
+				std::memcpy(indices.data(), source.index, indices.size() * sizeof(uint32_t));
+			}
+			else {
+				std::vector<uint16_t> narrow(source.indexSize / sizeof(uint16_t));
+				std::memcpy(narrow.data(), source.index, narrow.size() * sizeof(uint16_t));
+				indices.assign(narrow.begin(), narrow.end());
+			}
+			indices.resize(indices.size() - indices.size() % 3);
+
+			// triangles reaching past the vertices are dropped rather than read out of bounds
+			uint32_t kept = 0;
+			for (uint32_t t = 0; t < indices.size(); t += 3) {
+				if (indices[t] < vertexCount && indices[t + 1] < vertexCount && indices[t + 2] < vertexCount) {
+					std::copy_n(&indices[t], 3, &indices[kept]);
+					kept += 3;
+				}
+			}
+			if (kept != indices.size()) {
+				log_warning("mesh import dropped ", (indices.size() - kept) / 3, " triangles with indices out of range");
+				indices.resize(kept);
+			}
+			return indices;
+		}
+
+		// Spatial hash with cells of the tolerance size; a vertex is compared against the
+		// vertices of its own and the 26 neighbouring cells. Returns for every vertex the
+		// index in unique of the first one within tolerance that same() accepts.
+		template<typename Same> std::vector<uint32_t> weldMap(const std::vector<Vertex>& vertices, float tolerance, std::vector<uint32_t>& unique, Same same)
+		{
+			tolerance = std::max(tolerance, 0.0f);
+			double scale = tolerance > 0.0f ? 1.0 / tolerance : 0.0;
+			int64_t reach = tolerance > 0.0f ? 1 : 0;
+
+			// exact duplicates share the bits of their position instead of a cell
+			auto cellOf = [&](glm::vec3 p, int64_t* cell) {
+				for (int k = 0; k < 3; k++) {
+					int32_t bits;
+					std::memcpy(&bits, &p[k], sizeof(bits));
+					cell[k] = tolerance > 0.0f ? static_cast<int64_t>(std::floor(p[k] * scale)) : bits;
+				}
+			};
+			auto cellKey = [](int64_t x, int64_t y, int64_t z) {
+				return hashCombine(hashCombine(hashMix(static_cast<uint64_t>(x)), static_cast<uint64_t>(y)), static_cast<uint64_t>(z));
+			};
+
+			std::unordered_map<uint64_t, uint32_t> heads;
+			heads.reserve(vertices.size());
+			std::vector<uint32_t> next;
+			next.reserve(vertices.size());
+			unique.clear();
+			std::vector<uint32_t> remap(vertices.size());
+
+			for (size_t i = 0; i < vertices.size(); i++) {
+				auto& v = vertices[i];
+				int64_t cell[3];
+				cellOf(v.position, cell);
+				uint32_t match = ~0u;
+				for (int64_t z = -reach; z <= reach && match == ~0u; z++) {
+					for (int64_t y = -reach; y <= reach && match == ~0u; y++) {
+						for (int64_t x = -reach; x <= reach && match == ~0u; x++) {
+							auto head = heads.find(cellKey(cell[0] + x, cell[1] + y, cell[2] + z));
+							for (uint32_t w = head == heads.end() ? ~0u : head->second; w != ~0u; w = next[w]) {
+								auto& o = vertices[unique[w]];
+								auto d = o.position - v.position;
+								if (glm::dot(d, d) <= tolerance * tolerance && same(o, v)) {
+									match = w;
+									break;
+								}
+							}
+						}
+					}
+				}
+
+				if (match == ~0u) {
+					match = static_cast<uint32_t>(unique.size());
+					unique.push_back(static_cast<uint32_t>(i));
+					auto& head = heads.emplace(cellKey(cell[0], cell[1], cell[2]), ~0u).first->second;
+					next.push_back(head);
+					head = match;
+				}
+				remap[i] = match;
+			}
+			return remap;
+		}
+
+		std::vector<Vertex> weld(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, const MeshImportOptions& options, bool compareNormals)
+		{
+			std::vector<uint32_t> unique;
+			auto remap = weldMap(vertices, options.weldTolerance, unique, [&](const Vertex& a, const Vertex& b) {
+				return near(a.texcoord, b.texcoord, options.attributeTolerance) &&
+					(!compareNormals || near(a.normal, b.normal, options.attributeTolerance));
+			});
+
+			std::vector<Vertex> welded;
+			welded.reserve(unique.size());
+			for (auto u : unique) {
+				welded.push_back(vertices[u]);
+			}
+			for (auto& i : indices) {
+				i = remap[i];
+			}
+			return welded;
+		}
+
+		// corners of every key, key(corner) < keyCount, as offsets into the returned list
+		template<typename Key> std::vector<uint32_t> cornersBy(uint32_t cornerCount, uint32_t keyCount, std::vector<uint32_t>& offsets, Key key)
+		{
+			offsets.assign(keyCount + 1, 0);
+			for (uint32_t c = 0; c < cornerCount; c++) {
+				offsets[key(c) + 1]++;
+			}
+			for (uint32_t k = 0; k < keyCount; k++) {
+				offsets[k + 1] += offsets[k];
+			}
+			std::vector<uint32_t> corners(cornerCount);
+			auto fill = offsets;
+			for (uint32_t c = 0; c < cornerCount; c++) {
+				corners[fill[key(c)]++] = c;
+			}
+			return corners;
+		}
+
+		uint32_t removeDegenerates(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, float tolerance)
+		{
+			// |cross| is twice the area
+			float minArea = 2.0f * tolerance * tolerance;
+			uint32_t kept = 0;
+			for (uint32_t t = 0; t < indices.size(); t += 3) {
+				uint32_t a = indices[t], b = indices[t + 1], c = indices[t + 2];
+				if (a == b || b == c || a == c) {
+					continue;
+				}
+				auto n = glm::cross(vertices[b].position - vertices[a].position, vertices[c].position - vertices[a].position);
+				if (glm::dot(n, n) <= minArea * minArea) {
+					continue;
+				}
+				std::copy_n(&indices[t], 3, &indices[kept]);
+				kept += 3;
+			}
+			uint32_t removed = static_cast<uint32_t>(indices.size() - kept) / 3;
+			indices.resize(kept);
+			return removed;
+		}
+
+		// Every corner gets the angle weighted average of the face normals around its position
+		// that are within the crease angle of its own face, so texcoord seams stay smooth;
+		// corners of a vertex that end up with different normals get a vertex each.
+		std::vector<Vertex> generateNormals(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, float creaseAngle, float tolerance, uint32_t& splits)
+		{
+			uint32_t triangles = static_cast<uint32_t>(indices.size() / 3);
+			std::vector<glm::vec3> faceNormals(triangles);
+			std::vector<float> cornerAngles(indices.size());
+			for (uint32_t t = 0; t < triangles; t++) {
+				glm::vec3 p[3];
+				for (uint32_t k = 0; k < 3; k++) {
+					p[k] = vertices[indices[t * 3 + k]].position;
+				}
+				auto n = glm::cross(p[1] - p[0], p[2] - p[0]);
+				float length = glm::length(n);
+				faceNormals[t] = length > 0.0f ? n / length : glm::vec3(0.0f);
+				for (uint32_t k = 0; k < 3; k++) {
+					auto e0 = p[(k + 1) % 3] - p[k];
+					auto e1 = p[(k + 2) % 3] - p[k];
+					float l = glm::length(e0) * glm::length(e1);
+					cornerAngles[t * 3 + k] = l > 0.0f ? std::acos(glm::clamp(glm::dot(e0, e1) / l, -1.0f, 1.0f)) : 0.0f;
+				}
+			}
+
+			// corners of every vertex, and of every position shared by vertices that differ
+			// only in their texcoords
+			std::vector<uint32_t> positions;
+			auto group = weldMap(vertices, tolerance, positions, [](const Vertex&, const Vertex&) { return true; });
+			uint32_t cornerCount = static_cast<uint32_t>(indices.size());
+			std::vector<uint32_t> offsets, groupOffsets;
+			auto corners = cornersBy(cornerCount, static_cast<uint32_t>(vertices.size()), offsets, [&](uint32_t c) { return indices[c]; });
+			auto groupCorners = cornersBy(cornerCount, static_cast<uint32_t>(positions.size()), groupOffsets, [&](uint32_t c) { return group[indices[c]]; });
+
+			float cosCrease = std::cos(glm::radians(glm::clamp(creaseAngle, 0.0f, 180.0f)));
+			std::vector<Vertex> result;
+			result.reserve(vertices.size());
+			std::vector<uint32_t> split;
+			for (size_t v = 0; v < vertices.size(); v++) {
+				split.clear();
+				for (uint32_t c = offsets[v]; c < offsets[v + 1]; c++) {
+					uint32_t corner = corners[c];
+					auto own = faceNormals[corner / 3];
+					glm::vec3 sum(0.0f);
+					for (uint32_t o = groupOffsets[group[v]]; o < groupOffsets[group[v] + 1]; o++) {
+						uint32_t other = groupCorners[o];
+						auto n = faceNormals[other / 3];
+						if (glm::dot(n, own) >= cosCrease) {
+							sum += n * cornerAngles[other];
+						}
+					}
+					float length = glm::length(sum);
+					auto normal = length > 0.0f ? sum / length : own;
+
+					uint32_t target = ~0u;
+					for (auto s : split) {
+						if (glm::dot(result[s].normal, normal) >= 0.9999f) {
+							target = s;
+							break;
+						}
+					}
+					if (target == ~0u) {
+						target = static_cast<uint32_t>(result.size());
+						result.push_back(vertices[v]);
+						result.back().normal = normal;
+						split.push_back(target);
+					}
+					indices[corner] = target;
+				}
+				splits += split.empty() ? 0 : static_cast<uint32_t>(split.size()) - 1;
+			}
+			return result;
+		}
+
+		uint16_t unorm16(float v)
+		{
+			return static_cast<uint16_t>(std::lround(glm::clamp(v, 0.0f, 1.0f) * 65535.0f));
+		}
+
+		int16_t snorm16(float v)
+		{
+			return static_cast<int16_t>(std::lround(glm::clamp(v, -1.0f, 1.0f) * 32767.0f));
+		}
+
+		int8_t snorm8(float v)
+		{
+			return static_cast<int8_t>(std::lround(glm::clamp(v, -1.0f, 1.0f) * 127.0f));
+		}
+
+		// IEEE half, rounded to nearest even; overflow saturates to infinity
+		uint16_t half(float v)
+		{
+			uint32_t bits;
+			std::memcpy(&bits, &v, sizeof(bits));
+			uint32_t sign = (bits >> 16) & 0x8000;
+			uint32_t magnitude = bits & 0x7fffffff;
+			if (magnitude >= 0x7f800000) {
+				// inf stays inf, nan stays nan
+				return static_cast<uint16_t>(sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0));
+			}
+			if (magnitude >= 0x477ff000) {
+				return static_cast<uint16_t>(sign | 0x7c00);
+			}
+			if (magnitude < 0x38800000) {
+				// subnormal: shift the implicit one in and round
+				if (magnitude < 0x33000000) {
+					return static_cast<uint16_t>(sign);
+				}
+				uint32_t exponent = magnitude >> 23;
+				uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+				uint32_t shift = 126 - exponent;
+				uint32_t value = mantissa >> shift;
+				uint32_t rest = mantissa & ((1u << shift) - 1);
+				uint32_t halfway = 1u << (shift - 1);
+				if (rest > halfway || (rest == halfway && (value & 1))) {
+					value++;
+				}
+				return static_cast<uint16_t>(sign | value);
+			}
+			uint32_t value = ((magnitude - 0x38000000) >> 13);
+			uint32_t rest = magnitude & 0x1fff;
+			if (rest > 0x1000 || (rest == 0x1000 && (value & 1))) {
+				value++;
+			}
+			return static_cast<uint16_t>(sign | value);
+		}
+
+		// Folds the unit sphere onto the [-1, 1] square: the upper half projected onto the
+		// octahedron, the lower half mirrored over its diagonals.
+		glm::vec2 octEncode(glm::vec3 n)
+		{
+			float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+			if (l1 <= 0.0f) {
+				return glm::vec2(0.0f);
+			}
+			glm::vec2 e(n.x / l1, n.y / l1);
+			if (n.z < 0.0f) {
+				glm::vec2 folded(1.0f - std::abs(e.y), 1.0f - std::abs(e.x));
+				e = glm::vec2(e.x >= 0.0f ? folded.x : -folded.x, e.y >= 0.0f ? folded.y : -folded.y);
+			}
+			return e;
+		}
+
+		// Tipsify (Sander, Nehab and Barczak 2007): fans around one vertex at a time and moves on
+		// to the neighbour that is still in the cache and has the fewest triangles left, or to
+		// a vertex emitted recently when none is. clusters receives the first triangle of every
+		// run started from scratch; the cache is cold there, so runs can be reordered freely.
+		void tipsify(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize, std::vector<uint32_t>& clusters)
+		{
+			uint32_t triangles = static_cast<uint32_t>(indices.size() / 3);
+			clusters.clear();
+			if (!triangles) {
+				return;
+			}
+
+			std::vector<uint32_t> offsets(vertexCount + 1, 0);
+			for (auto i : indices) {
+				offsets[i + 1]++;
+			}
+			for (uint32_t v = 0; v < vertexCount; v++) {
+				offsets[v + 1] += offsets[v];
+			}
+			std::vector<uint32_t> adjacency(indices.size());
+			std::vector<uint32_t> live(vertexCount, 0);
+			{
+				auto fill = offsets;
+				for (uint32_t c = 0; c < indices.size(); c++) {
+					adjacency[fill[indices[c]]++] = c / 3;
+					live[indices[c]]++;
+				}
+			}
+
+			int64_t k = cacheSize;
+			std::vector<int64_t> stamps(vertexCount, 0);
+			int64_t time = k + 1;
+			std::vector<uint8_t> emitted(triangles, 0);
+			std::vector<uint32_t> deadEnds;
+			std::vector<uint32_t> candidates;
+			std::vector<uint32_t> result;
+			result.reserve(indices.size());
+			uint32_t cursor = 0;
+
+			auto skipDeadEnd = [&]() -> uint32_t {
+				while (!deadEnds.empty()) {
+					uint32_t d = deadEnds.back();
+					deadEnds.pop_back();
+					if (live[d]) {
+						return d;
+					}
+				}
+				while (cursor < vertexCount) {
+					if (live[cursor]) {
+						return cursor;
+					}
+					cursor++;
+				}
+				return ~0u;
+			};
+
+			uint32_t fan = skipDeadEnd();
+			clusters.push_back(0);
+			while (fan != ~0u) {
+				candidates.clear();
+				for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; a++) {
+					uint32_t t = adjacency[a];
+					if (emitted[t]) {
+						continue;
+					}
+					emitted[t] = 1;
+					for (uint32_t c = 0; c < 3; c++) {
+						uint32_t v = indices[t * 3 + c];
+						result.push_back(v);
+						deadEnds.push_back(v);
+						candidates.push_back(v);
+						live[v]--;
+						if (time - stamps[v] > k) {
+							stamps[v] = time++;
+						}
+					}
+				}
+
+				uint32_t best = ~0u;
+				int64_t priority = -1;
+				for (auto v : candidates) {
+					if (!live[v]) {
+						continue;
+					}
+					// still cached after the triangles of v are emitted
+					int64_t p = 0;
+					if (time - stamps[v] + 2 * int64_t(live[v]) <= k) {
+						p = time - stamps[v];
+					}
+					if (p > priority) {
+						priority = p;
+						best = v;
+					}
+				}
+				if (best == ~0u) {
+					best = skipDeadEnd();
+					if (best != ~0u && result.size() < indices.size()) {
+						clusters.push_back(static_cast<uint32_t>(result.size() / 3));
+					}
+				}
+				fan = best;
+			}
+			indices = std::move(result);
+		}
+
+		// Orders the clusters so the ones facing away from the centre of the mesh come first;
+		// seen from any direction they tend to occlude the rest (Sander et al.). Clusters are
+		// compared by the area weighted centroid and normal of their triangles.
+		void sortClusters(MeshData& mesh, const std::vector<uint32_t>& clusters)
+		{
+			uint32_t triangles = static_cast<uint32_t>(mesh.indices.size() / 3);
+			if (clusters.size() < 2) {
+				return;
+			}
+
+			uint32_t floats = mesh.stride() / sizeof(float);
+			auto position = [&](uint32_t v) {
+				const float* p = mesh.vertices.data() + size_t(v) * floats;
+				return glm::vec3(p[0], p[1], p[2]);
+			};
+
+			struct Cluster
+			{
+				uint32_t begin, end;
+				glm::vec3 centroid;
+				glm::vec3 normal;
+				float area;
+				float key;
+			};
+			std::vector<Cluster> sorted(clusters.size());
+			glm::vec3 center(0.0f);
+			float totalArea = 0.0f;
+			for (size_t c = 0; c < clusters.size(); c++) {
+				auto& cluster = sorted[c];
+				cluster.begin = clusters[c];
+				cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : triangles;
+				cluster.centroid = glm::vec3(0.0f);
+				cluster.normal = glm::vec3(0.0f);
+				cluster.area = 0.0f;
+				for (uint32_t t = cluster.begin; t < cluster.end; t++) {
+					auto a = position(mesh.indices[t * 3]);
+					auto b = position(mesh.indices[t * 3 + 1]);
+					auto d = position(mesh.indices[t * 3 + 2]);
+					auto n = glm::cross(b - a, d - a);
+					float area = glm::length(n);
+					cluster.centroid += (a + b + d) * (area / 3.0f);
+					cluster.normal += n;
+					cluster.area += area;
+				}
+				center += cluster.centroid;
+				totalArea += cluster.area;
+				if (cluster.area > 0.0f) {
+					cluster.centroid /= cluster.area;
+				}
+			}
+			if (totalArea > 0.0f) {
+				center /= totalArea;
+			}
+			for (auto& cluster : sorted) {
+				float length = glm::length(cluster.normal);
+				cluster.key = length > 0.0f ? glm::dot(cluster.centroid - center, cluster.normal / length) : 0.0f;
+			}
+
+			std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.key > b.key; });
+			std::vector<uint32_t> result;
+			result.reserve(mesh.indices.size());
+			for (auto& cluster : sorted) {
+				result.insert(result.end(), mesh.indices.begin() + cluster.begin * 3, mesh.indices.begin() + cluster.end * 3);
+			}
+			mesh.indices = std::move(result);
+		}
+
+		// Renumbers the vertices in the order the triangles first use them, so vertex fetches
+		// walk the buffer forward; unused vertices are dropped.
+		void reorderVertices(MeshData& mesh)
+		{
+			uint32_t floats = mesh.stride() / sizeof(float);
+			std::vector<uint32_t> remap(mesh.vertexCount(), ~0u);
+			std::vector<float> vertices;
+			vertices.reserve(mesh.vertices.size());
+			uint32_t next = 0;
+			for (auto& i : mesh.indices) {
+				if (remap[i] == ~0u) {
+					remap[i] = next++;
+					auto v = mesh.vertices.begin() + size_t(i) * floats;
+					vertices.insert(vertices.end(), v, v + floats);
+				}
+				i = remap[i];
+			}
+			mesh.vertices = std::move(vertices);
+		}
+
+		void narrowIndices(MeshData& mesh)
+		{
+			mesh.shortIndices.clear();
+			if (mesh.vertexCount() <= std::numeric_limits<uint16_t>::max() + 1u) {
+				mesh.shortIndices.assign(mesh.indices.begin(), mesh.indices.end());
+			}
+		}
+
+		// 10 bits per axis of a point within [0, 1] interleaved
+		uint32_t mortonCode(glm::vec3 unit)
+		{
+			auto spread = [](uint32_t x) {
+				x = (x | (x << 16)) & 0x030000ff;
+				x = (x | (x << 8)) & 0x0300f00f;
+				x = (x | (x << 4)) & 0x030c30c3;
+				x = (x | (x << 2)) & 0x09249249;
+				return x;
+			};
+			auto q = glm::clamp(unit, glm::vec3(0.0f), glm::vec3(1.0f)) * 1023.0f;
+			return (spread(uint32_t(q.x)) << 2) | (spread(uint32_t(q.y)) << 1) | spread(uint32_t(q.z));
+		}
+
+		// float attributes a part contributes to a batch
+		VertexType batchFlags(const VertexFormat& format)
+		{
+			return static_cast<VertexType>(VertexType::position |
+				(format.normal.format == AttributeFormat::Float3 ? VertexType::normal : 0) |
+				(format.texcoord.format == AttributeFormat::Float2 ? VertexType::texcoord : 0));
+		}
+	}
+
+	GeometryBounds computeBounds(const void* vertex, uint32_t vertexSize, uint32_t stride, uint32_t positionOffset)
+	{
+		GeometryBounds bounds;
+		uint32_t count = stride ? vertexSize / stride : 0;
+		if (!count) {
+			return bounds;
+		}
+
+		auto data = static_cast<const uint8_t*>(vertex);
+		auto position = [&](uint32_t i) {
+			glm::vec3 p;
+			std::memcpy(&p, data + size_t(i) * stride + positionOffset, sizeof(p));
+			return p;
+		};
+
+		bounds.min = glm::vec3(std::numeric_limits<float>::max());
+		bounds.max = glm::vec3(-std::numeric_limits<float>::max());
+		for (uint32_t i = 0; i < count; i++) {
+			auto p = position(i);
+			bounds.min = glm::min(bounds.min, p);
+			bounds.max = glm::max(bounds.max, p);
+		}
+
+		// Ritter's sphere: start from two far apart points and grow over the outliers
+		auto farthest = [&](glm::vec3 from) {
+			uint32_t best = 0;
+			float distance = -1.0f;
+			for (uint32_t i = 0; i < count; i++) {
+				auto d = position(i) - from;
+				if (glm::dot(d, d) > distance) {
+					distance = glm::dot(d, d);
+					best = i;
+				}
+			}
+			return position(best);
+		};
+		auto a = farthest(position(0));
+		auto b = farthest(a);
+		auto center = (a + b) * 0.5f;
+		float radius = glm::length(b - a) * 0.5f;
+		for (uint32_t i = 0; i < count; i++) {
+			auto p = position(i);
+			float d = glm::length(p - center);
+			if (d > radius) {
+				float grown = (radius + d) * 0.5f;
+				center += (p - center) * ((grown - radius) / d);
+				radius = grown;
+			}
+		}
+
+		// the sphere around the box is smaller for some shapes, e.g. boxes
+		auto boxCenter = (bounds.min + bounds.max) * 0.5f;
+		float boxRadius = 0.0f;
+		for (uint32_t i = 0; i < count; i++) {
+			boxRadius = std::max(boxRadius, glm::length(position(i) - boxCenter));
+		}
+		bounds.center = boxRadius < radius ? boxCenter : center;
+		bounds.radius = std::min(boxRadius, radius);
+		return bounds;
+	}
+
+	MeshData importMesh(const GeometryBufferInfo& source, const MeshImportOptions& options)
+	{
+		MeshData mesh;
+		auto& format = source.format;
+		if (!format.position.present() || !format.stride || !source.vertex || !source.index) {
+			log_error("mesh import needs positions and indices");
+			return mesh;
+		}
+		if (format.position.format != AttributeFormat::Float3 && format.position.format != AttributeFormat::Float4) {
+			log_error("mesh import needs float positions");
+			return mesh;
+		}
+
+		auto vertices = decodeVertices(source);
+		auto indices = decodeIndices(source, static_cast<uint32_t>(vertices.size()));
+		mesh.stats.inputVertices = static_cast<uint32_t>(vertices.size());
+		mesh.stats.inputTriangles = static_cast<uint32_t>(indices.size() / 3);
+
+		bool normals = options.generateNormals || format.normal.format != AttributeFormat::Float3;
+		// generated normals are split again where needed, so they do not keep vertices apart
+		vertices = weld(vertices, indices, options, !normals);
+		mesh.stats.weldedVertices = static_cast<uint32_t>(vertices.size());
+
+		if (options.removeDegenerates) {
+			mesh.stats.degenerateTriangles = removeDegenerates(vertices, indices, options.weldTolerance);
+		}
+
+		if (normals) {
+			vertices = generateNormals(vertices, indices, options.creaseAngle, options.weldTolerance, mesh.stats.creaseVertices);
+		}
+		else {
+			// vertices only used by removed triangles
+			std::vector<uint32_t> remap(vertices.size(), ~0u);
+			std::vector<Vertex> used;
+			used.reserve(vertices.size());
+			for (auto& i : indices) {
+				if (remap[i] == ~0u) {
+					remap[i] = static_cast<uint32_t>(used.size());
+					used.push_back(vertices[i]);
+				}
+				i = remap[i];
+			}
+			vertices = std::move(used);
+		}
+
+		mesh.flags = static_cast<VertexType>(VertexType::position | VertexType::normal | (format.texcoord.format == AttributeFormat::Float2 ? VertexType::texcoord : 0));
+		uint32_t floats = mesh.stride() / sizeof(float);
+		mesh.vertices.resize(vertices.size() * floats);
+		float* out = mesh.vertices.data();
+		for (auto& v : vertices) {
+			std::memcpy(out, &v.position, sizeof(glm::vec3));
+			std::memcpy(out + 3, &v.normal, sizeof(glm::vec3));
+			if (has(mesh.flags, VertexType::texcoord)) {
+				std::memcpy(out + 6, &v.texcoord, sizeof(glm::vec2));
+			}
+			out += floats;
+		}
+
+		mesh.indices = std::move(indices);
+		if (options.optimize) {
+			optimizeMesh(mesh, options.cacheSize);
+		}
+		else {
+			narrowIndices(mesh);
+		}
+		mesh.bounds = computeBounds(mesh.vertices.data(), static_cast<uint32_t>(mesh.vertices.size() * sizeof(float)), mesh.stride());
+		encodeMesh(mesh, options.encoding);
+		mesh.stats.vertexBytes = static_cast<uint32_t>(mesh.encoded.empty() ? mesh.vertices.size() * sizeof(float) : mesh.encoded.size());
+		return mesh;
+	}
+
+	float computeACMR(const std::vector<uint32_t>& indices, uint32_t cacheSize)
+	{
+		if (indices.size() < 3) {
+			return 0.0f;
+		}
+		// FIFO of the last cacheSize vertices, looked up by a linear scan
+		std::vector<uint32_t> cache(std::max(cacheSize, 1u), ~0u);
+		size_t head = 0;
+		uint32_t misses = 0;
+		for (auto i : indices) {
+			if (std::find(cache.begin(), cache.end(), i) == cache.end()) {
+				cache[head] = i;
+				head = (head + 1) % cache.size();
+				misses++;
+			}
+		}
+		return float(misses) / float(indices.size() / 3);
+	}
+
+	void optimizeMesh(MeshData& mesh, uint32_t cacheSize)
+	{
+		uint32_t vertexCount = mesh.vertexCount();
+		mesh.stats.acmrBefore = computeACMR(mesh.indices, cacheSize);
+
+		std::vector<uint32_t> clusters;
+		tipsify(mesh.indices, vertexCount, cacheSize, clusters);
+		sortClusters(mesh, clusters);
+		reorderVertices(mesh);
+
+		mesh.stats.acmrAfter = computeACMR(mesh.indices, cacheSize);
+		narrowIndices(mesh);
+	}
+
+	void encodeMesh(MeshData& mesh, VertexEncoding encoding)
+	{
+		mesh.encoding = encoding;
+		mesh.encoded.clear();
+		if (encoding.isFloat() && !encoding.separatePositions) {
+			return;
+		}
+
+		auto offsets = vertexFormat(mesh.flags, encoding);
+		auto source = vertexFormat(mesh.flags);
+		uint32_t floats = source.stride / sizeof(float);
+		uint32_t count = mesh.vertexCount();
+		mesh.encoded.assign(size_t(count) * offsets.vertexSize(), 0);
+		// the same when interleaved
+		uint8_t* positions = mesh.encoded.data();
+		uint8_t* attributes = positions + size_t(count) * offsets.positionStride;
+
+		auto extent = mesh.bounds.max - mesh.bounds.min;
+		glm::vec3 scale(0.0f);
+		for (int k = 0; k < 3; k++) {
+			scale[k] = extent[k] > 0.0f ? 1.0f / extent[k] : 0.0f;
+		}
+
+		for (uint32_t v = 0; v < count; v++) {
+			const float* in = mesh.vertices.data() + size_t(v) * floats;
+			uint8_t* outPosition = positions + size_t(v) * offsets.positionBindingStride();
+			uint8_t* out = attributes + size_t(v) * offsets.stride;
+
+			glm::vec3 position(in[0], in[1], in[2]);
+			if (encoding.position == PositionEncoding::Unorm16) {
+				uint16_t q[4] = {};
+				for (int k = 0; k < 3; k++) {
+					q[k] = unorm16((position[k] - mesh.bounds.min[k]) * scale[k]);
+				}
+				std::memcpy(outPosition + offsets.position.offset, q, sizeof(q));
+			}
+			else {
+				std::memcpy(outPosition + offsets.position.offset, &position, sizeof(position));
+			}
+
+			if (has(mesh.flags, VertexType::normal)) {
+				glm::vec3 normal;
+				std::memcpy(&normal, in + source.normal.offset / sizeof(float), sizeof(normal));
+				if (encoding.normal == NormalEncoding::Float) {
+					std::memcpy(out + offsets.normal.offset, &normal, sizeof(normal));
+				}
+				else {
+					auto e = octEncode(normal);
+					if (encoding.normal == NormalEncoding::Oct16) {
+						int16_t q[2] = { snorm16(e.x), snorm16(e.y) };
+						std::memcpy(out + offsets.normal.offset, q, sizeof(q));
+					}
+					else {
+						int8_t q[2] = { snorm8(e.x), snorm8(e.y) };
+						std::memcpy(out + offsets.normal.offset, q, sizeof(q));
+					}
+				}
+			}
+
+			if (has(mesh.flags, VertexType::texcoord)) {
+				glm::vec2 texcoord;
+				std::memcpy(&texcoord, in + source.texcoord.offset / sizeof(float), sizeof(texcoord));
+				if (encoding.texcoord == TexcoordEncoding::Float) {
+					std::memcpy(out + offsets.texcoord.offset, &texcoord, sizeof(texcoord));
+				}
+				else {
+					uint16_t q[2];
+					for (int k = 0; k < 2; k++) {
+						q[k] = encoding.texcoord == TexcoordEncoding::Half ? half(texcoord[k]) : unorm16(texcoord[k]);
+					}
+					std::memcpy(out + offsets.texcoord.offset, q, sizeof(q));
+				}
+			}
+		}
+	}
+
+	uint32_t MeshData::stride() const
+	{
+		return vertexFormat(flags).stride;
+	}
+
+	uint32_t MeshData::vertexCount() const
+	{
+		uint32_t s = stride();
+		return s ? static_cast<uint32_t>(vertices.size() * sizeof(float) / s) : 0;
+	}
+
+	GeometryBufferInfo MeshData::info() const
+	{
+		// GeometryBufferInfo holds mutable pointers, but the data is only ever read through them
+		GeometryBufferInfo info;
+		if (encoded.empty()) {
+			info.vertexData(static_cast<uint32_t>(vertices.size() * sizeof(float)), const_cast<float*>(vertices.data()), flags);
+		}
+		else {
+			info.vertexData(static_cast<uint32_t>(encoded.size()), const_cast<uint8_t*>(encoded.data()), vertexFormat(flags, encoding));
+		}
+		if (!shortIndices.empty() || indices.empty()) {
+			info.indexData(static_cast<uint32_t>(shortIndices.size() * sizeof(uint16_t)), const_cast<uint16_t*>(shortIndices.data()), IndexType::u16);
+		}
+		else {
+			info.indexData(static_cast<uint32_t>(indices.size() * sizeof(uint32_t)), const_cast<uint32_t*>(indices.data()), IndexType::u32);
+		}
+		info.bounds = bounds;
+		info.hasBounds = true;
+		return info;
+	}
+
+	std::vector<StaticBatch> buildStaticBatches(const std::vector<StaticPart>& parts, const StaticBatchOptions& options)
+	{
+		struct Entry
+		{
+			const StaticPart* part;
+			VertexType flags;
+			glm::vec3 center;
+			uint32_t vertexCount;
+			uint32_t code;
+		};
+
+		std::vector<Entry> entries;
+		entries.reserve(parts.size());
+		glm::vec3 lo(std::numeric_limits<float>::max());
+		glm::vec3 hi(-std::numeric_limits<float>::max());
+		for (auto& part : parts) {
+			auto& format = part.geometry.format;
+			if (!format.position.present() || !part.geometry.vertex || !part.geometry.index ||
+				(format.position.format != AttributeFormat::Float3 && format.position.format != AttributeFormat::Float4)) {
+				log_error("static part ", part.id, " needs float positions and indices");
+				continue;
+			}
+			uint32_t count = format.vertexCount(part.geometry.vertexSize);
+			if (!count) {
+				continue;
+			}
+			auto bounds = part.geometry.hasBounds ? part.geometry.bounds :
+				computeBounds(part.geometry.vertex, count * format.positionBindingStride(), format.positionBindingStride(), format.position.offset);
+			auto center = glm::vec3(part.transform * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f));
+			lo = glm::min(lo, center);
+			hi = glm::max(hi, center);
+			entries.push_back({ &part, batchFlags(format), center, count, 0 });
+		}
+
+		auto extent = hi - lo;
+		glm::vec3 scale(0.0f);
+		for (int k = 0; k < 3; k++) {
+			scale[k] = extent[k] > 0.0f ? 1.0f / extent[k] : 0.0f;
+		}
+		for (auto& e : entries) {
+			e.code = mortonCode((e.center - lo) * scale);
+		}
+		// groups that can share a pipeline, each along the curve
+		std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+			if (a.part->material != b.part->material) return a.part->material < b.part->material;
+			if (a.flags != b.flags) return a.flags < b.flags;
+			return a.code < b.code;
+		});
+
+		std::vector<StaticBatch> batches;
+		auto finish = [&](StaticBatch& batch) {
+			auto& mesh = batch.mesh;
+			narrowIndices(mesh);
+			mesh.bounds = computeBounds(mesh.vertices.data(), static_cast<uint32_t>(mesh.vertices.size() * sizeof(float)), mesh.stride());
+			encodeMesh(mesh, options.encoding);
+			mesh.stats.vertexBytes = static_cast<uint32_t>(mesh.encoded.empty() ? mesh.vertices.size() * sizeof(float) : mesh.encoded.size());
+		};
+
+		for (size_t i = 0; i < entries.size(); i++) {
+			auto& e = entries[i];
+			auto& part = *e.part;
+			bool open = !batches.empty() && batches.back().material == part.material && batches.back().mesh.flags == e.flags &&
+				batches.back().mesh.vertexCount() + e.vertexCount <= options.maxVertices;
+			if (!open) {
+				if (!batches.empty()) {
+					finish(batches.back());
+				}
+				batches.emplace_back();
+				batches.back().material = part.material;
+				batches.back().mesh.flags = e.flags;
+			}
+			auto& batch = batches.back();
+			auto& mesh = batch.mesh;
+
+			auto vertices = decodeVertices(part.geometry);
+			auto indices = decodeIndices(part.geometry, static_cast<uint32_t>(vertices.size()));
+			mesh.stats.inputVertices += static_cast<uint32_t>(vertices.size());
+			mesh.stats.inputTriangles += static_cast<uint32_t>(indices.size() / 3);
+
+			// normals go through the inverse transpose; a mirroring transform flips the winding
+			glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(part.transform)));
+			bool mirrored = glm::determinant(glm::mat3(part.transform)) < 0.0f;
+
+			uint32_t base = mesh.vertexCount();
+			uint32_t floats = mesh.stride() / sizeof(float);
+			size_t out = mesh.vertices.size();
+			mesh.vertices.resize(out + vertices.size() * floats);
+			for (auto& v : vertices) {
+				float* dst = mesh.vertices.data() + out;
+				auto position = glm::vec3(part.transform * glm::vec4(v.position, 1.0f));
+				std::memcpy(dst, &position, sizeof(glm::vec3));
+				uint32_t at = 3;
+				if (has(e.flags, VertexType::normal)) {
+					auto normal = normalMatrix * v.normal;
+					float length = glm::length(normal);
+					normal = length > 0.0f ? normal / length : normal;
+					std::memcpy(dst + at, &normal, sizeof(glm::vec3));
+					at += 3;
+				}
+				if (has(e.flags, VertexType::texcoord)) {
+					std::memcpy(dst + at, &v.texcoord, sizeof(glm::vec2));
+				}
+				out += floats;
+			}
+
+			StaticBatchPart range;
+			range.id = part.id;
+			range.firstTriangle = static_cast<uint32_t>(mesh.indices.size() / 3);
+			range.triangleCount = static_cast<uint32_t>(indices.size() / 3);
+			batch.parts.push_back(range);
+			for (size_t t = 0; t < indices.size(); t += 3) {
+				mesh.indices.push_back(base + indices[t]);
+				mesh.indices.push_back(base + indices[t + (mirrored ? 2 : 1)]);
+				mesh.indices.push_back(base + indices[t + (mirrored ? 1 : 2)]);
+			}
+		}
+		if (!batches.empty()) {
+			finish(batches.back());
+		}
+		return batches;
+	}
+
+	const StaticBatchPart* findBatchPart(const std::vector<StaticBatchPart>& parts, uint32_t triangle)
+	{
+		auto it = std::upper_bound(parts.begin(), parts.end(), triangle, [](uint32_t t, const StaticBatchPart& part) {
+			return t < part.firstTriangle;
+		});
+		if (it == parts.begin()) {
+			return nullptr;
+		}
+		--it;
+		return triangle < it->firstTriangle + it->triangleCount ? &*it : nullptr;
+	}
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include <render/geometryInfo.h>
+#include <cstdint>
+#include <vector>
+
+namespace vg
+{
+	struct MeshImportOptions
+	{
+		// Vertices closer than this and with equal texcoords and normals become one; 0 only
+		// merges exact duplicates.
+		float weldTolerance = 1e-5f;
+		// Texcoords and given normals of welded vertices may differ by this much per component.
+		float attributeTolerance = 1e-4f;
+
+		// Replace the normals of the source, which are always generated when it has none.
+		bool generateNormals = false;
+		// Faces meeting at a larger angle in degrees get separate normals along their edge.
+		float creaseAngle = 60.0f;
+
+		// Drop triangles with repeated indices or an area below weldTolerance squared.
+		bool removeDegenerates = true;
+
+		// Reorder triangles and vertices for the post-transform cache, overdraw and vertex
+		// fetch; see optimizeMesh.
+		bool optimize = true;
+		uint32_t cacheSize = 16;
+
+		// Storage of the uploaded vertices, e.g. VertexEncoding::compact(); see encodeMesh.
+		VertexEncoding encoding;
+	};
+
+	struct MeshImportStats
+	{
+		uint32_t inputVertices = 0;
+		uint32_t inputTriangles = 0;
+		uint32_t weldedVertices = 0;
+		uint32_t degenerateTriangles = 0;
+		// extra vertices made for normals split along creases
+		uint32_t creaseVertices = 0;
+
+		// average cache misses per triangle before and after optimizeMesh
+		float acmrBefore = 0.0f;
+		float acmrAfter = 0.0f;
+
+		// size of the vertices info() hands out
+		uint32_t vertexBytes = 0;
+	};
+
+	// Vertices in the interleaved layout of flags (position, normal, texcoord as floats)
+	// and triangle lists, ready to upload.
+	struct MeshData
+	{
+		VertexType flags = VertexType::none;
+		std::vector<float> vertices;
+		// the vertices in encoding once encodeMesh ran; uploaded instead of the floats
+		VertexEncoding encoding;
+		std::vector<uint8_t> encoded;
+		std::vector<uint32_t> indices;
+		// indices narrowed to 16 bits, filled when every vertex is reachable with them
+		std::vector<uint16_t> shortIndices;
+		GeometryBounds bounds;
+		MeshImportStats stats;
+
+		uint32_t stride() const;
+		uint32_t vertexCount() const;
+
+		// Points into this mesh, which must stay alive and unchanged while info is used.
+		GeometryBufferInfo info() const;
+	};
+
+	// Welds the vertices of a geometry, removes degenerate triangles, generates angle
+	// weighted normals split at creases, optimizes the order and computes the bounds. Runs
+	// on any thread; the source needs float positions and u16 or u32 triangle lists, and
+	// quantized normals or texcoords are dropped.
+	MeshData importMesh(const GeometryBufferInfo& source, const MeshImportOptions& options = {});
+
+	// Reorders the triangles for the post-transform vertex cache (Tipsify), then the runs
+	// between cache restarts so outward facing ones are drawn first, which lowers overdraw
+	// from any viewpoint, and renumbers the vertices in order of first use.
+	void optimizeMesh(MeshData& mesh, uint32_t cacheSize = 16);
+
+	// Average cache misses per triangle of a FIFO post-transform cache; 0.5 to 1 is good,
+	// 3 means no vertex is ever reused.
+	float computeACMR(const std::vector<uint32_t>& indices, uint32_t cacheSize = 16);
+
+	// Quantizes the vertices into mesh.encoded: positions relative to mesh.bounds, normals
+	// through an octahedral map, texcoords as half floats or clamped unorm16. With
+	// separatePositions the positions are written first as a stream of their own.
+	void encodeMesh(MeshData& mesh, VertexEncoding encoding);
+
+	// Box and sphere around vertexSize bytes of vertices with a float position at positionOffset.
+	GeometryBounds computeBounds(const void* vertex, uint32_t vertexSize, uint32_t stride, uint32_t positionOffset = 0);
+
+	// A static object for buildStaticBatches: its geometry, with float positions and u16 or
+	// u32 triangle lists as for importMesh, placed in the world by transform.
+	struct StaticPart
+	{
+		uint32_t id = 0;
+		GeometryBufferInfo geometry;
+		glm::mat4 transform = glm::mat4(1.0f);
+		// Parts of different materials, e.g. the virtual texture they will be bound to, are
+		// never merged.
+		uint32_t material = 0;
+	};
+
+	struct StaticBatchOptions
+	{
+		// A batch is closed before it grows past this many vertices; the default keeps
+		// 16 bit indices. Larger parts get a batch of their own.
+		uint32_t maxVertices = 0x10000;
+		// Storage of the merged vertices; see encodeMesh.
+		VertexEncoding encoding;
+	};
+
+	// The triangles of one part within a batch.
+	struct StaticBatchPart
+	{
+		uint32_t id = 0;
+		uint32_t firstTriangle = 0;
+		uint32_t triangleCount = 0;
+	};
+
+	struct StaticBatch
+	{
+		MeshData mesh;
+		uint32_t material = 0;
+		// in triangle order
+		std::vector<StaticBatchPart> parts;
+	};
+
+	// Merges parts with the same attributes and material into batches of pre-transformed
+	// vertices, each one draw. Parts are taken in Morton order of their centers, so the
+	// batches are spatially coherent and cull well. The triangles of a part stay together
+	// and in order; findBatchPart maps a picked triangle back to its part. Runs on any thread.
+	std::vector<StaticBatch> buildStaticBatches(const std::vector<StaticPart>& parts, const StaticBatchOptions& options = {});
+
+	// The part triangle belongs to, nullptr when it is past the last one.
+	const StaticBatchPart* findBatchPart(const std::vector<StaticBatchPart>& parts, uint32_t triangle);
+}
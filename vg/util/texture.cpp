@@ -0,0 +1,547 @@
+#include "texture.h"
+#include <core/log.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace vg
+{
+	static uint32_t blockBytes(TextureFormat format)
+	{
+		switch (format)
+		{
+		case TextureFormat::BC1:
+		case TextureFormat::BC1_SRGB:
+			return 8;
+		case TextureFormat::BC3:
+		case TextureFormat::BC3_SRGB:
+		case TextureFormat::BC5:
+		case TextureFormat::BC7:
+		case TextureFormat::BC7_SRGB:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	bool isCompressed(TextureFormat format)
+	{
+		return blockBytes(format) != 0;
+	}
+
+	bool isSRGB(TextureFormat format)
+	{
+		return format == TextureFormat::RGBA8_SRGB || format == TextureFormat::BC1_SRGB ||
+			format == TextureFormat::BC3_SRGB || format == TextureFormat::BC7_SRGB;
+	}
+
+	size_t levelSize(TextureFormat format, uint32_t width, uint32_t height)
+	{
+		if (isCompressed(format)) {
+			return size_t((width + 3) / 4) * size_t((height + 3) / 4) * blockBytes(format);
+		}
+		return size_t(width) * size_t(height) * 4;
+	}
+
+	uint32_t mipChainLength(uint32_t width, uint32_t height)
+	{
+		uint32_t levels = 1;
+		for (uint32_t size = std::max(width, height); size > 1; size >>= 1) {
+			levels++;
+		}
+		return levels;
+	}
+
+	TextureData TextureData::fromPixels(uint32_t width, uint32_t height, const void* rgba, bool srgb)
+	{
+		TextureData texture;
+		texture.format = srgb ? TextureFormat::RGBA8_SRGB : TextureFormat::RGBA8;
+		texture.width = width;
+		texture.height = height;
+		size_t size = levelSize(texture.format, width, height);
+		texture.levels.push_back({ width, height, 0, size });
+		texture.data.assign(static_cast<const uint8_t*>(rgba), static_cast<const uint8_t*>(rgba) + size);
+		return texture;
+	}
+
+	// Fills levels for `count` tightly packed mips starting at `offset` and copies them.
+	static bool readLevels(const uint8_t* file, size_t fileSize, size_t offset, uint32_t count, TextureData& texture)
+	{
+		size_t total = 0;
+		for (uint32_t i = 0; i < count; i++) {
+			uint32_t w = std::max(texture.width >> i, 1u);
+			uint32_t h = std::max(texture.height >> i, 1u);
+			size_t size = levelSize(texture.format, w, h);
+			texture.levels.push_back({ w, h, total, size });
+			total += size;
+		}
+		if (offset + total > fileSize) {
+			log_error("texture data truncated");
+			return false;
+		}
+		texture.data.assign(file + offset, file + offset + total);
+		return true;
+	}
+
+	template<typename T> static T read(const uint8_t* p)
+	{
+		T value;
+		std::memcpy(&value, p, sizeof(T));
+		return value;
+	}
+
+	static constexpr uint32_t fourCC(char a, char b, char c, char d)
+	{
+		return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+	}
+
+	bool parseDDS(const void* data, size_t size, TextureData& texture)
+	{
+		// magic, DDS_HEADER (124 bytes), optional DDS_HEADER_DXT10 (20 bytes)
+		auto file = static_cast<const uint8_t*>(data);
+		if (size < 128 || read<uint32_t>(file) != fourCC('D', 'D', 'S', ' ')) {
+			return false;
+		}
+		auto header = file + 4;
+		uint32_t flags = read<uint32_t>(header + 4);
+		texture = {};
+		texture.height = read<uint32_t>(header + 8);
+		texture.width = read<uint32_t>(header + 12);
+		uint32_t mipCount = (flags & 0x20000) ? std::max(read<uint32_t>(header + 24), 1u) : 1;
+		// a corrupt count would otherwise have readLevels describe billions of levels
+		if (mipCount > mipChainLength(texture.width, texture.height)) {
+			log_error("DDS mip count ", mipCount, " exceeds the chain of a ", texture.width, "x", texture.height, " texture");
+			return false;
+		}
+
+		auto pixelFormat = header + 72;
+		uint32_t pfFlags = read<uint32_t>(pixelFormat + 4);
+		uint32_t code = read<uint32_t>(pixelFormat + 8);
+		size_t offset = 128;
+
+		if (pfFlags & 0x4) {
+			switch (code)
+			{
+			case fourCC('D', 'X', 'T', '1'): texture.format = TextureFormat::BC1; break;
+			case fourCC('D', 'X', 'T', '5'): texture.format = TextureFormat::BC3; break;
+			case fourCC('A', 'T', 'I', '2'):
+			case fourCC('B', 'C', '5', 'U'): texture.format = TextureFormat::BC5; break;
+			case fourCC('D', 'X', '1', '0'):
+			{
+				if (size < 148) {
+					return false;
+				}
+				switch (read<uint32_t>(file + 128))
+				{
+				case 28: texture.format = TextureFormat::RGBA8; break;
+				case 29: texture.format = TextureFormat::RGBA8_SRGB; break;
+				case 71: texture.format = TextureFormat::BC1; break;
+				case 72: texture.format = TextureFormat::BC1_SRGB; break;
+				case 77: texture.format = TextureFormat::BC3; break;
+				case 78: texture.format = TextureFormat::BC3_SRGB; break;
+				case 83: texture.format = TextureFormat::BC5; break;
+				case 98: texture.format = TextureFormat::BC7; break;
+				case 99: texture.format = TextureFormat::BC7_SRGB; break;
+				}
+				offset = 148;
+				break;
+			}
+			}
+		}
+		else if ((pfFlags & 0x40) && read<uint32_t>(pixelFormat + 12) == 32 &&
+			read<uint32_t>(pixelFormat + 16) == 0x000000ff && read<uint32_t>(pixelFormat + 20) == 0x0000ff00 &&
+			read<uint32_t>(pixelFormat + 24) == 0x00ff0000) {
+			texture.format = TextureFormat::RGBA8;
+		}
+
+		if (texture.format == TextureFormat::Undefined) {
+			log_error("unsupported DDS pixel format");
+			return false;
+		}
+		return readLevels(file, size, offset, mipCount, texture);
+	}
+
+	bool parseKTX2(const void* data, size_t size, TextureData& texture)
+	{
+		static const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+		auto file = static_cast<const uint8_t*>(data);
+		if (size < 80 || std::memcmp(file, identifier, sizeof(identifier)) != 0) {
+			return false;
+		}
+
+		texture = {};
+		uint32_t vkFormat = read<uint32_t>(file + 12);
+		texture.width = read<uint32_t>(file + 20);
+		texture.height = std::max(read<uint32_t>(file + 24), 1u);
+		// 0 asks the loader to generate the chain
+		uint32_t levelCount = std::max(read<uint32_t>(file + 40), 1u);
+		uint32_t supercompression = read<uint32_t>(file + 44);
+
+		if (levelCount > mipChainLength(texture.width, texture.height)) {
+			log_error("KTX2 level count ", levelCount, " exceeds the chain of a ", texture.width, "x", texture.height, " texture");
+			return false;
+		}
+
+		if (supercompression != 0) {
+			log_error("supercompressed KTX2 files are not supported");
+			return false;
+		}
+
+		switch (vkFormat)
+		{
+		case 37: texture.format = TextureFormat::RGBA8; break;
+		case 43: texture.format = TextureFormat::RGBA8_SRGB; break;
+		case 131: case 133: texture.format = TextureFormat::BC1; break;
+		case 132: case 134: texture.format = TextureFormat::BC1_SRGB; break;
+		case 137: texture.format = TextureFormat::BC3; break;
+		case 138: texture.format = TextureFormat::BC3_SRGB; break;
+		case 141: texture.format = TextureFormat::BC5; break;
+		case 145: texture.format = TextureFormat::BC7; break;
+		case 146: texture.format = TextureFormat::BC7_SRGB; break;
+		default:
+			log_error("unsupported KTX2 format ", vkFormat);
+			return false;
+		}
+
+		// level index follows the 80 byte header: byteOffset, byteLength, uncompressedByteLength
+		if (80 + size_t(levelCount) * 24 > size) {
+			return false;
+		}
+		size_t total = 0;
+		for (uint32_t i = 0; i < levelCount; i++) {
+			uint32_t w = std::max(texture.width >> i, 1u);
+			uint32_t h = std::max(texture.height >> i, 1u);
+			size_t expected = levelSize(texture.format, w, h);
+			auto entry = file + 80 + i * 24;
+			uint64_t offset = read<uint64_t>(entry);
+			uint64_t length = read<uint64_t>(entry + 8);
+			// only the first layer and face are used
+			if (length < expected || offset + expected > size) {
+				log_error("texture data truncated");
+				return false;
+			}
+			texture.levels.push_back({ w, h, total, expected });
+			total += expected;
+		}
+		texture.data.resize(total);
+		for (uint32_t i = 0; i < levelCount; i++) {
+			auto entry = file + 80 + i * 24;
+			std::memcpy(texture.data.data() + texture.levels[i].offset, file + read<uint64_t>(entry), texture.levels[i].size);
+		}
+		return true;
+	}
+
+	bool loadTexture(const char* path, TextureData& texture)
+	{
+		FILE* file = std::fopen(path, "rb");
+		if (!file) {
+			log_error("can not open ", path);
+			return false;
+		}
+		std::fseek(file, 0, SEEK_END);
+		long size = std::ftell(file);
+		std::fseek(file, 0, SEEK_SET);
+		std::vector<uint8_t> bytes(size > 0 ? size_t(size) : 0);
+		size_t read = std::fread(bytes.data(), 1, bytes.size(), file);
+		std::fclose(file);
+
+		if (parseKTX2(bytes.data(), read, texture) || parseDDS(bytes.data(), read, texture)) {
+			return true;
+		}
+		log_error("unrecognized texture file ", path);
+		return false;
+	}
+
+	// block decoders, each writes a 4x4 block of RGBA8 texels
+
+	static void decodeColor(const uint8_t* block, uint8_t* out, bool allowAlpha)
+	{
+		uint16_t c0 = read<uint16_t>(block);
+		uint16_t c1 = read<uint16_t>(block + 2);
+		uint32_t bits = read<uint32_t>(block + 4);
+
+		uint8_t palette[4][4];
+		auto expand = [](uint16_t c, uint8_t* rgba) {
+			uint32_t r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+			rgba[0] = uint8_t((r << 3) | (r >> 2));
+			rgba[1] = uint8_t((g << 2) | (g >> 4));
+			rgba[2] = uint8_t((b << 3) | (b >> 2));
+			rgba[3] = 255;
+		};
+		expand(c0, palette[0]);
+		expand(c1, palette[1]);
+		for (int c = 0; c < 3; c++) {
+			if (c0 > c1 || !allowAlpha) {
+				palette[2][c] = uint8_t((2 * palette[0][c] + palette[1][c]) / 3);
+				palette[3][c] = uint8_t((palette[0][c] + 2 * palette[1][c]) / 3);
+			}
+			else {
+				palette[2][c] = uint8_t((palette[0][c] + palette[1][c]) / 2);
+				palette[3][c] = 0;
+			}
+		}
+		palette[2][3] = 255;
+		palette[3][3] = (c0 > c1 || !allowAlpha) ? 255 : 0;
+
+		for (int i = 0; i < 16; i++) {
+			std::memcpy(out + i * 4, palette[(bits >> (i * 2)) & 3], 4);
+		}
+	}
+
+	// BC4 style 8 byte single channel block, written to `channel` of every texel
+	static void decodeChannel(const uint8_t* block, uint8_t* out, int channel)
+	{
+		uint32_t a0 = block[0], a1 = block[1];
+		uint8_t palette[8] = { uint8_t(a0), uint8_t(a1) };
+		if (a0 > a1) {
+			for (uint32_t i = 1; i < 7; i++) palette[i + 1] = uint8_t(((7 - i) * a0 + i * a1) / 7);
+		}
+		else {
+			for (uint32_t i = 1; i < 5; i++) palette[i + 1] = uint8_t(((5 - i) * a0 + i * a1) / 5);
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+		uint64_t bits = 0;
+		std::memcpy(&bits, block + 2, 6);
+		for (int i = 0; i < 16; i++) {
+			out[i * 4 + channel] = palette[(bits >> (i * 3)) & 7];
+		}
+	}
+
+	struct BitReader
+	{
+		const uint8_t* data;
+		uint32_t position = 0;
+
+		uint32_t bits(uint32_t count) {
+			uint32_t value = 0;
+			for (uint32_t i = 0; i < count; i++, position++) {
+				value |= uint32_t((data[position >> 3] >> (position & 7)) & 1) << i;
+			}
+			return value;
+		}
+	};
+
+	// subset of every texel for the 64 two- and three-subset partitions
+	static const uint16_t bc7Partitions2[64] = {
+		0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80, 0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+		0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce, 0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+		0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a, 0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+		0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c, 0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22
+	};
+
+	static const uint32_t bc7Partitions3[64] = {
+		0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0, 0x5a5a5050,
+		0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250,
+		0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+		0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200,
+		0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50,
+		0x500aa550, 0xaaaa4444, 0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+		0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+		0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254
+	};
+
+	// texel whose index drops its top bit, for the second subset of two and the second and
+	// third subsets of three; the first subset always anchors at texel 0
+	static const uint8_t bc7Anchor2[64] = {
+		15,15,15,15,15,15,15,15, 15,15,15,15,15,15,15,15,
+		15, 2, 8, 2, 2, 8, 8,15,  2, 8, 2, 2, 8, 8, 2, 2,
+		15,15, 6, 8, 2, 8,15,15,  2, 8, 2, 2, 2,15,15, 6,
+		 6, 2, 6, 8,15,15, 2, 2, 15,15,15,15,15, 2, 2,15
+	};
+
+	static const uint8_t bc7Anchor3a[64] = {
+		 3, 3,15,15, 8, 3,15,15,  8, 8, 6, 6, 6, 5, 3, 3,
+		 3, 3, 8,15, 3, 3, 6,10,  5, 8, 8, 6, 8, 5,15,15,
+		 8,15, 3, 5, 6,10, 8,15, 15, 3,15, 5,15,15,15,15,
+		 3,15, 5, 5, 5, 8, 5,10,  5,10, 8,13,15,12, 3, 3
+	};
+
+	static const uint8_t bc7Anchor3b[64] = {
+		15, 8, 8, 3,15,15, 3, 8, 15,15,15,15,15,15,15, 8,
+		15, 8,15, 3,15, 8,15, 8,  3,15, 6,10,15,15,10, 8,
+		15, 3,15,10,10, 8, 9,10,  6,15, 8,15, 3, 6, 6, 8,
+		15, 3,15,15,15,15,15,15, 15,15,15,15, 3,15,15, 8
+	};
+
+	static const uint8_t bc7Weights2[4] = { 0, 21, 43, 64 };
+	static const uint8_t bc7Weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+	static const uint8_t bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	static uint8_t bc7Interpolate(uint32_t e0, uint32_t e1, uint32_t index, uint32_t indexBits)
+	{
+		uint32_t w = indexBits == 2 ? bc7Weights2[index] : indexBits == 3 ? bc7Weights3[index] : bc7Weights4[index];
+		return uint8_t(((64 - w) * e0 + w * e1 + 32) >> 6);
+	}
+
+	static void decodeBC7(const uint8_t* block, uint8_t* out)
+	{
+		struct Mode
+		{
+			uint8_t subsets, partitionBits, rotationBits, selectorBits, colorBits, alphaBits, endpointPBits, sharedPBits, indexBits, index2Bits;
+		};
+		static const Mode modes[8] = {
+			{ 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+			{ 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+			{ 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+			{ 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+			{ 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+			{ 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+			{ 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+			{ 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+		};
+
+		BitReader reader = { block };
+		uint32_t m = 0;
+		while (m < 8 && reader.bits(1) == 0) m++;
+		if (m == 8) {
+			// reserved mode decodes to transparent black
+			std::memset(out, 0, 64);
+			return;
+		}
+		const Mode& mode = modes[m];
+
+		uint32_t partition = reader.bits(mode.partitionBits);
+		uint32_t rotation = reader.bits(mode.rotationBits);
+		uint32_t selector = reader.bits(mode.selectorBits);
+
+		uint32_t endpoints[6][4] = {};
+		uint32_t count = mode.subsets * 2;
+		for (uint32_t c = 0; c < 3; c++) {
+			for (uint32_t e = 0; e < count; e++) endpoints[e][c] = reader.bits(mode.colorBits);
+		}
+		for (uint32_t e = 0; e < count; e++) endpoints[e][3] = mode.alphaBits ? reader.bits(mode.alphaBits) : 255;
+
+		uint32_t colorBits = mode.colorBits;
+		uint32_t alphaBits = mode.alphaBits;
+		if (mode.endpointPBits || mode.sharedPBits) {
+			uint32_t pbits[6];
+			for (uint32_t e = 0; e < count; e++) {
+				pbits[e] = mode.endpointPBits ? reader.bits(1) : (e % 2 == 0 ? reader.bits(1) : pbits[e - 1]);
+			}
+			for (uint32_t e = 0; e < count; e++) {
+				for (uint32_t c = 0; c < 3; c++) endpoints[e][c] = (endpoints[e][c] << 1) | pbits[e];
+				if (alphaBits) endpoints[e][3] = (endpoints[e][3] << 1) | pbits[e];
+			}
+			colorBits++;
+			if (alphaBits) alphaBits++;
+		}
+
+		for (uint32_t e = 0; e < count; e++) {
+			for (uint32_t c = 0; c < 3; c++) endpoints[e][c] = (endpoints[e][c] << (8 - colorBits)) | (endpoints[e][c] >> (2 * colorBits - 8));
+			if (alphaBits) endpoints[e][3] = (endpoints[e][3] << (8 - alphaBits)) | (endpoints[e][3] >> (2 * alphaBits - 8));
+		}
+
+		uint32_t subsetOf[16] = {};
+		uint32_t anchors[3] = { 0, 0, 0 };
+		if (mode.subsets == 2) {
+			for (uint32_t i = 0; i < 16; i++) subsetOf[i] = (bc7Partitions2[partition] >> i) & 1;
+			anchors[1] = bc7Anchor2[partition];
+		}
+		else if (mode.subsets == 3) {
+			for (uint32_t i = 0; i < 16; i++) subsetOf[i] = (bc7Partitions3[partition] >> (i * 2)) & 3;
+			anchors[1] = bc7Anchor3a[partition];
+			anchors[2] = bc7Anchor3b[partition];
+		}
+
+		auto isAnchor = [&](uint32_t i) {
+			for (uint32_t s = 0; s < mode.subsets; s++) {
+				if (anchors[s] == i) return true;
+			}
+			return false;
+		};
+
+		uint32_t indices[16];
+		uint32_t indices2[16] = {};
+		for (uint32_t i = 0; i < 16; i++) indices[i] = reader.bits(isAnchor(i) ? mode.indexBits - 1 : mode.indexBits);
+		for (uint32_t i = 0; mode.index2Bits && i < 16; i++) indices2[i] = reader.bits(i == 0 ? mode.index2Bits - 1 : mode.index2Bits);
+
+		for (uint32_t i = 0; i < 16; i++) {
+			const uint32_t* e0 = endpoints[subsetOf[i] * 2];
+			const uint32_t* e1 = endpoints[subsetOf[i] * 2 + 1];
+			uint8_t* texel = out + i * 4;
+
+			uint32_t colorIndex = indices[i], colorIndexBits = mode.indexBits;
+			uint32_t alphaIndex = indices[i], alphaIndexBits = mode.indexBits;
+			if (mode.index2Bits) {
+				alphaIndex = indices2[i];
+				alphaIndexBits = mode.index2Bits;
+				if (selector) {
+					std::swap(colorIndex, alphaIndex);
+					std::swap(colorIndexBits, alphaIndexBits);
+				}
+			}
+
+			for (uint32_t c = 0; c < 3; c++) texel[c] = bc7Interpolate(e0[c], e1[c], colorIndex, colorIndexBits);
+			texel[3] = bc7Interpolate(e0[3], e1[3], alphaIndex, alphaIndexBits);
+
+			if (rotation) {
+				std::swap(texel[3], texel[rotation - 1]);
+			}
+		}
+	}
+
+	TextureData decompress(const TextureData& texture)
+	{
+		if (!isCompressed(texture.format)) {
+			return texture;
+		}
+
+		TextureData result;
+		result.format = isSRGB(texture.format) ? TextureFormat::RGBA8_SRGB : TextureFormat::RGBA8;
+		result.width = texture.width;
+		result.height = texture.height;
+		size_t total = 0;
+		for (auto& level : texture.levels) {
+			size_t size = levelSize(result.format, level.width, level.height);
+			result.levels.push_back({ level.width, level.height, total, size });
+			total += size;
+		}
+		result.data.resize(total);
+
+		uint32_t bytes = blockBytes(texture.format);
+		for (size_t l = 0; l < texture.levels.size(); l++) {
+			auto& src = texture.levels[l];
+			auto& dst = result.levels[l];
+			uint32_t blocksX = (src.width + 3) / 4;
+			uint32_t blocksY = (src.height + 3) / 4;
+			for (uint32_t by = 0; by < blocksY; by++) {
+				for (uint32_t bx = 0; bx < blocksX; bx++) {
+					const uint8_t* block = texture.data.data() + src.offset + (size_t(by) * blocksX + bx) * bytes;
+					uint8_t texels[64];
+					switch (texture.format)
+					{
+					case TextureFormat::BC1:
+					case TextureFormat::BC1_SRGB:
+						decodeColor(block, texels, true);
+						break;
+					case TextureFormat::BC3:
+					case TextureFormat::BC3_SRGB:
+						decodeColor(block + 8, texels, false);
+						decodeChannel(block, texels, 3);
+						break;
+					case TextureFormat::BC5:
+						for (int i = 0; i < 16; i++) {
+							texels[i * 4 + 2] = 0;
+							texels[i * 4 + 3] = 255;
+						}
+						decodeChannel(block, texels, 0);
+						decodeChannel(block + 8, texels, 1);
+						break;
+					default:
+						decodeBC7(block, texels);
+						break;
+					}
+
+					// edge blocks of levels that are not a multiple of 4 are clipped
+					for (uint32_t y = 0; y < 4 && by * 4 + y < src.height; y++) {
+						uint32_t columns = std::min(4u, src.width - bx * 4);
+						std::memcpy(result.data.data() + dst.offset + (size_t(by * 4 + y) * src.width + bx * 4) * 4, texels + y * 16, columns * 4);
+					}
+				}
+			}
+		}
+		return result;
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vg
+{
+	enum class TextureFormat
+	{
+		Undefined,
+		RGBA8,
+		RGBA8_SRGB,
+		BC1,
+		BC1_SRGB,
+		BC3,
+		BC3_SRGB,
+		BC5,
+		BC7,
+		BC7_SRGB
+	};
+
+	struct TextureLevel
+	{
+		uint32_t width;
+		uint32_t height;
+		size_t offset;
+		size_t size;
+	};
+
+	// Texture in CPU memory: every mip level stored tightly packed in one blob, level 0 first.
+	struct TextureData
+	{
+		TextureFormat format = TextureFormat::Undefined;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<TextureLevel> levels;
+		std::vector<uint8_t> data;
+
+		static TextureData fromPixels(uint32_t width, uint32_t height, const void* rgba, bool srgb = false);
+	};
+
+	bool isCompressed(TextureFormat format);
+	bool isSRGB(TextureFormat format);
+
+	// Size in bytes of one width x height level.
+	size_t levelSize(TextureFormat format, uint32_t width, uint32_t height);
+
+	// Number of levels of a full mip chain down to 1x1.
+	uint32_t mipChainLength(uint32_t width, uint32_t height);
+
+	// Parse the first 2D image (first layer and face) of a file in memory.
+	// Supercompressed KTX2 files (BasisLZ, zstd) are rejected.
+	bool parseDDS(const void* data, size_t size, TextureData& texture);
+	bool parseKTX2(const void* data, size_t size, TextureData& texture);
+
+	// Loads a .dds or .ktx2 file, detected from its header.
+	bool loadTexture(const char* path, TextureData& texture);
+
+	// Decodes block-compressed data to RGBA8, for devices that can not sample BC formats.
+	TextureData decompress(const TextureData& texture);
+}
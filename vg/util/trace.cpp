@@ -0,0 +1,136 @@
+#include "trace.h"
+#include <core/log.h>
+#include <algorithm>
+
+namespace vg
+{
+	static void writeVarint(FILE* file, uint64_t value)
+	{
+		uint8_t bytes[10];
+		size_t count = 0;
+		do {
+			uint8_t b = value & 0x7f;
+			value >>= 7;
+			bytes[count++] = b | (value ? 0x80 : 0);
+		} while (value);
+		std::fwrite(bytes, 1, count, file);
+	}
+
+	static bool readVarint(FILE* file, uint64_t& value)
+	{
+		value = 0;
+		for (uint32_t shift = 0; shift < 64; shift += 7) {
+			int c = std::fgetc(file);
+			if (c == EOF) {
+				return false;
+			}
+			value |= uint64_t(c & 0x7f) << shift;
+			if (!(c & 0x80)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	TraceWriter::TraceWriter(const char* path) : start(std::chrono::steady_clock::now())
+	{
+		file = std::fopen(path, "wb");
+		if (!file) {
+			log_error("can not create trace ", path);
+			return;
+		}
+		uint32_t header[2] = { magic, version };
+		std::fwrite(header, sizeof(header), 1, file);
+	}
+
+	TraceWriter::~TraceWriter()
+	{
+		if (file) {
+			std::fclose(file);
+		}
+	}
+
+	void TraceWriter::write(TraceCall call, const void* payload, size_t size)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (!file) {
+			return;
+		}
+
+		// taken under the lock, so times never go backwards between threads
+		uint64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		std::fputc(static_cast<int>(call), file);
+		writeVarint(file, now - lastMicroseconds);
+		writeVarint(file, size);
+		if (size) {
+			std::fwrite(payload, 1, size, file);
+		}
+		lastMicroseconds = now;
+		records++;
+	}
+
+	void TraceWriter::flush()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (file) {
+			std::fflush(file);
+		}
+	}
+
+	TraceReader::TraceReader(const char* path)
+	{
+		file = std::fopen(path, "rb");
+		if (!file) {
+			log_error("can not open trace ", path);
+			return;
+		}
+		uint32_t header[2] = {};
+		if (std::fread(header, sizeof(header), 1, file) != 1 || header[0] != TraceWriter::magic || header[1] != TraceWriter::version) {
+			log_error("not a trace of version ", TraceWriter::version, " : ", path);
+			std::fclose(file);
+			file = nullptr;
+			return;
+		}
+		long at = std::ftell(file);
+		std::fseek(file, 0, SEEK_END);
+		long end = std::ftell(file);
+		std::fseek(file, at, SEEK_SET);
+		fileSize = end > 0 ? static_cast<uint64_t>(end) : 0;
+	}
+
+	TraceReader::~TraceReader()
+	{
+		if (file) {
+			std::fclose(file);
+		}
+	}
+
+	bool TraceReader::next(TraceRecord& record)
+	{
+		if (!file) {
+			return false;
+		}
+
+		int call = std::fgetc(file);
+		uint64_t delta = 0, size = 0;
+		if (call == EOF || !readVarint(file, delta) || !readVarint(file, size)) {
+			return false;
+		}
+
+		// a corrupt size must not turn into a huge allocation
+		long at = std::ftell(file);
+		if (at < 0 || size > fileSize - std::min(fileSize, static_cast<uint64_t>(at))) {
+			log_warning("trace ends in a truncated record");
+			return false;
+		}
+		record.payload.resize(static_cast<size_t>(size));
+		if (size && std::fread(record.payload.data(), 1, record.payload.size(), file) != record.payload.size()) {
+			log_warning("trace ends in a truncated record");
+			return false;
+		}
+		microseconds += delta;
+		record.call = static_cast<TraceCall>(call);
+		record.time = microseconds * 1000;
+		return true;
+	}
+}
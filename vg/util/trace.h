@@ -0,0 +1,155 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace vg
+{
+	// Everything a trace records: the public Renderer calls and the input events of Entry.
+	enum class TraceCall : uint8_t
+	{
+		Setup = 1,
+		Shutdown,
+		AddGeometry,
+		AddTexture,
+		BindVirtualTexture,
+		BindCamera,
+		Click,
+		Resize,
+		Draw,
+		MouseEvent,
+		WindowEvent,
+		KeyEvent
+	};
+
+	// Payload of a record. Trivially copyable values are stored as raw bytes, so a trace is
+	// only meant to be replayed on the platform that wrote it.
+	class TraceBuffer
+	{
+	public:
+		std::vector<uint8_t> data;
+
+		template<typename T> void put(const T& value) {
+			static_assert(std::is_trivially_copyable<T>::value, "trace values must be trivially copyable");
+			bytes(&value, sizeof(T));
+		}
+
+		void bytes(const void* value, size_t size) {
+			auto p = static_cast<const uint8_t*>(value);
+			data.insert(data.end(), p, p + size);
+		}
+
+		// length-prefixed
+		template<typename T> void array(const std::vector<T>& values) {
+			put(static_cast<uint64_t>(values.size()));
+			bytes(values.data(), values.size() * sizeof(T));
+		}
+	};
+
+	// Reads a payload back; once a read runs past the end every further read fails.
+	class TraceCursor
+	{
+		const uint8_t* data;
+		size_t size;
+		size_t offset = 0;
+		bool ok = true;
+	public:
+		TraceCursor(const std::vector<uint8_t>& payload) : data(payload.data()), size(payload.size()) {}
+
+		template<typename T> bool get(T& value) {
+			static_assert(std::is_trivially_copyable<T>::value, "trace values must be trivially copyable");
+			return bytes(&value, sizeof(T));
+		}
+
+		bool bytes(void* value, size_t count) {
+			if (!ok || count > size - offset) {
+				ok = false;
+				return false;
+			}
+			std::memcpy(value, data + offset, count);
+			offset += count;
+			return true;
+		}
+
+		template<typename T> bool array(std::vector<T>& values) {
+			uint64_t count = 0;
+			if (!get(count) || count > (size - offset) / sizeof(T)) {
+				ok = false;
+				return false;
+			}
+			values.resize(static_cast<size_t>(count));
+			return bytes(values.data(), values.size() * sizeof(T));
+		}
+
+		bool valid() const { return ok; }
+	};
+
+	struct TraceRecord
+	{
+		TraceCall call = TraceCall::Setup;
+		// nanoseconds since the trace was started
+		uint64_t time = 0;
+		std::vector<uint8_t> payload;
+	};
+
+	// Appends records to a binary trace file: a header, then per record the call, the time
+	// since the previous record in microseconds and the payload size as varints, and the
+	// payload. May be shared by threads; records are written in the order they arrive.
+	class TraceWriter
+	{
+		FILE* file = nullptr;
+		std::mutex lock;
+		std::chrono::steady_clock::time_point start;
+		uint64_t lastMicroseconds = 0;
+		uint64_t records = 0;
+	public:
+		static constexpr uint32_t magic = 0x52544756; // "VGTR"
+		static constexpr uint32_t version = 5;
+
+		explicit TraceWriter(const char* path);
+		~TraceWriter();
+
+		TraceWriter(const TraceWriter&) = delete;
+		TraceWriter& operator=(const TraceWriter&) = delete;
+
+		bool isOpen() const { return file != nullptr; }
+
+		void write(TraceCall call, const TraceBuffer& payload) { write(call, payload.data.data(), payload.data.size()); }
+		void write(TraceCall call, const void* payload = nullptr, size_t size = 0);
+
+		void flush();
+		uint64_t count() const { return records; }
+	};
+
+	class TraceReader
+	{
+		FILE* file = nullptr;
+		// payload sizes are checked against it before anything is allocated
+		uint64_t fileSize = 0;
+		uint64_t microseconds = 0;
+	public:
+		explicit TraceReader(const char* path);
+		~TraceReader();
+
+		TraceReader(const TraceReader&) = delete;
+		TraceReader& operator=(const TraceReader&) = delete;
+
+		// False when the file is missing or not a trace of this version.
+		bool isOpen() const { return file != nullptr; }
+
+		// False at the end of the trace or at a truncated record.
+		bool next(TraceRecord& record);
+	};
+
+	enum class TraceTiming
+	{
+		// sleep so every call is issued as far into the replay as it was into the recording
+		Recorded,
+		// issue calls back to back and wait for each recorded frame to be drawn
+		AsFastAsPossible
+	};
+}
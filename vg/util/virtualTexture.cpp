@@ -0,0 +1,179 @@
+#include "virtualTexture.h"
+#include <core/log.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace vg
+{
+	TextureTileSource::TextureTileSource(const TextureData& texture)
+	{
+		if (texture.levels.empty()) {
+			log_error("tile source without data");
+			return;
+		}
+
+		TextureData base = isCompressed(texture.format) ? decompress(texture) : texture;
+		// only level 0 is kept, the rest is rebuilt so every level exists
+		base.levels.resize(1);
+		base.data.resize(base.levels[0].size);
+		levels.push_back(std::move(base));
+
+		while (levels.back().width > 1 || levels.back().height > 1) {
+			const auto& src = levels.back();
+			uint32_t w = std::max(src.width >> 1, 1u);
+			uint32_t h = std::max(src.height >> 1, 1u);
+
+			TextureData dst;
+			dst.format = src.format;
+			dst.width = w;
+			dst.height = h;
+			dst.levels.push_back({ w, h, 0, size_t(w) * h * 4 });
+			dst.data.resize(dst.levels[0].size);
+
+			for (uint32_t y = 0; y < h; y++) {
+				uint32_t y0 = std::min(y * 2, src.height - 1);
+				uint32_t y1 = std::min(y * 2 + 1, src.height - 1);
+				for (uint32_t x = 0; x < w; x++) {
+					uint32_t x0 = std::min(x * 2, src.width - 1);
+					uint32_t x1 = std::min(x * 2 + 1, src.width - 1);
+					const uint8_t* p[4] = {
+						&src.data[(size_t(y0) * src.width + x0) * 4],
+						&src.data[(size_t(y0) * src.width + x1) * 4],
+						&src.data[(size_t(y1) * src.width + x0) * 4],
+						&src.data[(size_t(y1) * src.width + x1) * 4]
+					};
+					uint8_t* out = &dst.data[(size_t(y) * w + x) * 4];
+					for (int c = 0; c < 4; c++) {
+						out[c] = static_cast<uint8_t>((p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2) / 4);
+					}
+				}
+			}
+			levels.push_back(std::move(dst));
+		}
+	}
+
+	bool TextureTileSource::readTile(uint32_t level, uint32_t x, uint32_t y, uint32_t tileSize, uint32_t border, uint8_t* rgba) const
+	{
+		if (level >= levels.size()) {
+			return false;
+		}
+
+		const auto& src = levels[level];
+		uint32_t pageSize = tileSize + border * 2;
+		int64_t originX = int64_t(x) * tileSize - border;
+		int64_t originY = int64_t(y) * tileSize - border;
+		for (uint32_t j = 0; j < pageSize; j++) {
+			int64_t sy = std::min<int64_t>(std::max<int64_t>(originY + j, 0), src.height - 1);
+			const uint8_t* row = &src.data[size_t(sy) * src.width * 4];
+			uint8_t* out = rgba + size_t(j) * pageSize * 4;
+			for (uint32_t i = 0; i < pageSize; i++) {
+				int64_t sx = std::min<int64_t>(std::max<int64_t>(originX + i, 0), src.width - 1);
+				std::memcpy(out + size_t(i) * 4, row + size_t(sx) * 4, 4);
+			}
+		}
+		return true;
+	}
+
+	int32_t PageCache::allocate(uint32_t tile, uint64_t generation, uint32_t& evicted)
+	{
+		int32_t best = -1;
+		for (uint32_t i = 0; i < pages.size(); i++) {
+			const auto& page = pages[i];
+			if (page.pinned) {
+				continue;
+			}
+			if (page.tile == TileId::none) {
+				best = static_cast<int32_t>(i);
+				break;
+			}
+			if (page.used < generation && (best < 0 || page.used < pages[best].used)) {
+				best = static_cast<int32_t>(i);
+			}
+		}
+		if (best < 0) {
+			return -1;
+		}
+
+		auto& page = pages[best];
+		evicted = page.tile;
+		if (page.tile != TileId::none) {
+			lookup.erase(page.tile);
+		}
+		else {
+			resident++;
+		}
+		page.tile = tile;
+		page.used = generation;
+		lookup[tile] = static_cast<uint32_t>(best);
+		return best;
+	}
+
+	PageTable::PageTable(uint32_t tilesX, uint32_t tilesY) : tilesX(tilesX), tilesY(tilesY)
+	{
+		uint32_t count = mipChainLength(tilesX, tilesY);
+		levels.resize(count);
+		dirty.resize(count);
+		for (uint32_t level = 0; level < count; level++) {
+			levels[level].resize(size_t(width(level)) * height(level));
+			dirty[level] = { 0, height(level) };
+		}
+	}
+
+	void PageTable::map(uint32_t level, uint32_t x, uint32_t y, uint32_t pageX, uint32_t pageY)
+	{
+		Entry value;
+		value.pageX = static_cast<uint8_t>(pageX);
+		value.pageY = static_cast<uint8_t>(pageY);
+		value.level = static_cast<uint8_t>(level);
+		value.valid = 1;
+		// finer tiles that are already resident keep their own pages
+		fill(level, x, y, level, 0xff, value);
+	}
+
+	void PageTable::unmap(uint32_t level, uint32_t x, uint32_t y)
+	{
+		Entry value;
+		for (uint32_t parent = level + 1; parent < levelCount(); parent++) {
+			uint32_t shift = parent - level;
+			const auto& candidate = entry(parent, x >> shift, y >> shift);
+			if (candidate.level == parent) {
+				value = candidate;
+				break;
+			}
+		}
+		fill(level, x, y, level, level, value);
+	}
+
+	void PageTable::fill(uint32_t level, uint32_t x, uint32_t y, uint32_t minLevel, uint32_t maxLevel, const Entry& value)
+	{
+		for (uint32_t l = 0; l <= level; l++) {
+			uint32_t shift = level - l;
+			uint32_t x0 = x << shift, x1 = std::min((x + 1) << shift, width(l));
+			uint32_t y0 = y << shift, y1 = std::min((y + 1) << shift, height(l));
+			if (x0 >= x1 || y0 >= y1) {
+				continue;
+			}
+
+			auto& entries = levels[l];
+			uint32_t w = width(l);
+			for (uint32_t ty = y0; ty < y1; ty++) {
+				for (uint32_t tx = x0; tx < x1; tx++) {
+					auto& e = entries[ty * w + tx];
+					if (e.level >= minLevel && e.level <= maxLevel) {
+						e = value;
+					}
+				}
+			}
+			dirty[l].begin = std::min(dirty[l].begin, y0);
+			dirty[l].end = std::max(dirty[l].end, y1);
+		}
+	}
+
+	void PageTable::clearDirty()
+	{
+		for (auto& rows : dirty) {
+			rows = {};
+		}
+	}
+}
@@ -0,0 +1,150 @@
+#pragma once
+#include "texture.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace vg
+{
+	// Tile address as the feedback pass writes it: texture(4) | level(4) | y(12) | x(12).
+	struct TileId
+	{
+		static constexpr uint32_t none = 0xffffffff;
+		static constexpr uint32_t maxTextures = 15;
+		static constexpr uint32_t maxTiles = 4096;
+
+		static constexpr uint32_t pack(uint32_t texture, uint32_t level, uint32_t x, uint32_t y) {
+			return (texture << 28) | ((level & 0xf) << 24) | ((y & 0xfff) << 12) | (x & 0xfff);
+		}
+
+		static constexpr uint32_t texture(uint32_t id) { return id >> 28; }
+		static constexpr uint32_t level(uint32_t id) { return (id >> 24) & 0xf; }
+		static constexpr uint32_t y(uint32_t id) { return (id >> 12) & 0xfff; }
+		static constexpr uint32_t x(uint32_t id) { return id & 0xfff; }
+	};
+
+	// Provides the texels of a virtual texture one tile at a time. Implementations read their
+	// own storage, so only the tiles the cache asks for are ever in memory.
+	class TileSource
+	{
+	public:
+		virtual ~TileSource() {}
+
+		virtual uint32_t width() const = 0;
+		virtual uint32_t height() const = 0;
+		virtual bool srgb() const { return false; }
+
+		// Writes the (tileSize + 2 * border)^2 RGBA8 texels of tile (x, y) of a level: the
+		// tile itself surrounded by border texels of its neighbours, clamped at the edges.
+		// Called from worker threads, possibly for several tiles at once.
+		virtual bool readTile(uint32_t level, uint32_t x, uint32_t y, uint32_t tileSize, uint32_t border, uint8_t* rgba) const = 0;
+	};
+
+	// Tiles cut out of a texture in memory, with the mip chain box filtered on the CPU.
+	// Handy for moderately sized images; datasets that do not fit in memory implement
+	// TileSource over pre-tiled files instead.
+	class TextureTileSource : public TileSource
+	{
+		std::vector<TextureData> levels;
+	public:
+		explicit TextureTileSource(const TextureData& texture);
+
+		uint32_t width() const override { return levels.empty() ? 0 : levels[0].width; }
+		uint32_t height() const override { return levels.empty() ? 0 : levels[0].height; }
+		bool srgb() const override { return !levels.empty() && isSRGB(levels[0].format); }
+
+		bool readTile(uint32_t level, uint32_t x, uint32_t y, uint32_t tileSize, uint32_t border, uint8_t* rgba) const override;
+	};
+
+	// Fixed set of physical pages, recycled least recently used first. Pages used by the
+	// current generation of feedback are never taken, so a view that needs more pages than
+	// there are drops requests instead of thrashing.
+	class PageCache
+	{
+		struct Page
+		{
+			uint32_t tile = TileId::none;
+			uint64_t used = 0;
+			bool pinned = false;
+		};
+
+		std::vector<Page> pages;
+		std::unordered_map<uint32_t, uint32_t> lookup;
+		uint32_t resident = 0;
+	public:
+		PageCache() {}
+		explicit PageCache(uint32_t count) : pages(count) {}
+
+		// Page that holds tile, or -1.
+		int32_t find(uint32_t tile) const {
+			auto it = lookup.find(tile);
+			return it == lookup.end() ? -1 : static_cast<int32_t>(it->second);
+		}
+
+		void touch(uint32_t page, uint64_t generation) {
+			pages[page].used = std::max(pages[page].used, generation);
+		}
+
+		void pin(uint32_t page) { pages[page].pinned = true; }
+
+		// Takes a free page, or the least recently used one that generation has not
+		// touched. evicted receives the tile the page held, TileId::none if it was free.
+		int32_t allocate(uint32_t tile, uint64_t generation, uint32_t& evicted);
+
+		uint32_t size() const { return static_cast<uint32_t>(pages.size()); }
+		uint32_t residentCount() const { return resident; }
+	};
+
+	// CPU copy of the indirection texture of one virtual texture. Every tile of every level
+	// points at the page of its finest resident ancestor (itself included), so the shader
+	// always finds something to sample. Rows touched since the last upload are tracked per
+	// level.
+	class PageTable
+	{
+	public:
+		// Layout of an R8G8B8A8_UINT texel.
+		struct Entry
+		{
+			uint8_t pageX = 0;
+			uint8_t pageY = 0;
+			uint8_t level = 0xff;
+			uint8_t valid = 0;
+		};
+
+		struct DirtyRows
+		{
+			uint32_t begin = ~0u;
+			uint32_t end = 0;
+
+			bool empty() const { return begin >= end; }
+		};
+	private:
+		uint32_t tilesX = 0;
+		uint32_t tilesY = 0;
+		std::vector<std::vector<Entry>> levels;
+		std::vector<DirtyRows> dirty;
+	public:
+		PageTable() {}
+		PageTable(uint32_t tilesX, uint32_t tilesY);
+
+		uint32_t levelCount() const { return static_cast<uint32_t>(levels.size()); }
+		uint32_t width(uint32_t level) const { return std::max(tilesX >> level, 1u); }
+		uint32_t height(uint32_t level) const { return std::max(tilesY >> level, 1u); }
+
+		const Entry& entry(uint32_t level, uint32_t x, uint32_t y) const { return levels[level][y * width(level) + x]; }
+		bool resident(uint32_t level, uint32_t x, uint32_t y) const { return entry(level, x, y).level == level; }
+
+		// Tile (level, x, y) now lives in page (pageX, pageY).
+		void map(uint32_t level, uint32_t x, uint32_t y, uint32_t pageX, uint32_t pageY);
+
+		// Tile (level, x, y) lost its page; its area falls back to the nearest resident ancestor.
+		void unmap(uint32_t level, uint32_t x, uint32_t y);
+
+		const Entry* data(uint32_t level) const { return levels[level].data(); }
+		const DirtyRows& dirtyRows(uint32_t level) const { return dirty[level]; }
+		void clearDirty();
+	private:
+		// Replaces the entries covered by tile (level, x, y) that point at a level in [minLevel, maxLevel].
+		void fill(uint32_t level, uint32_t x, uint32_t y, uint32_t minLevel, uint32_t maxLevel, const Entry& value);
+	};
+}